@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <string>
+#include <string_view>
 
 struct employee {
     std::string surname;
@@ -12,8 +13,21 @@ struct employee {
     int clearanceLevel;
 };
 
+//same record as employee, but the names point into a buffer owned by
+//someone else (i.e. a memory mapped input file), so creating one never allocates
+struct employee_view {
+    std::string_view surname;
+    std::string_view name;
+    float salary;
+    int age;
+    int clearanceLevel;
+};
+
+//works for employee as well as employee_view (and a mix of both)
+//since both have a salary member
 struct employee_cmp {
-    bool operator()(const employee &a, employee &b) const {
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
         return a.salary < b.salary;
     }
 };
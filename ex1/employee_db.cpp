@@ -0,0 +1,468 @@
+#include "employee_db.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+static const char dbMagic[8] = {'E', 'M', 'P', 'D', 'B', '\0', '\0', '\0'};
+static const char indexMagic[8] = {'E', 'M', 'P', 'I', 'D', 'X', '\0', '\0'};
+static const std::uint32_t dbVersion = 2;
+static const char *fieldNames[field_count] = {"salary", "age", "clearance"};
+
+std::uint32_t fieldKey(db_field field, float value) {
+    if (field == field_salary) {
+        //-0 and +0 compare equal, so they get the same key
+        return salarySortKey(value == 0.0f ? 0.0f : value);
+    }
+    //values out of the range of int (from a query) map to the smallest or largest key
+    int number = value < INT_MAX ? (value > INT_MIN ? static_cast<int>(value) : INT_MIN) : INT_MAX;
+    return static_cast<std::uint32_t>(number) ^ 0x80000000u;
+}
+
+std::string indexPath(const std::string &dbPath, db_field field) {
+    return dbPath + "." + fieldNames[field] + ".idx";
+}
+
+std::uint32_t newStamp() {
+    std::uint64_t now = std::chrono::system_clock::now().time_since_epoch().count();
+    std::uint32_t stamp = static_cast<std::uint32_t>(now ^ (now >> 32)) ^ (static_cast<std::uint32_t>(getpid()) << 16);
+    static std::uint32_t last = 0;
+    //two databases written within one clock tick still get different stamps
+    if (stamp == last) {
+        stamp++;
+    }
+    last = stamp;
+    return stamp;
+}
+
+db_header makeHeader(db_sort_order order, std::uint64_t n, std::uint64_t heapSize, std::uint32_t stamp) {
+    //the 64 bit columns come first, so every column is naturally aligned
+    db_header header;
+    std::memcpy(header.magic, dbMagic, sizeof(dbMagic));
+    header.version = dbVersion;
+    header.sortOrder = order;
+    header.recordCount = n;
+    header.heapSize = heapSize;
+    header.surnameOffsets = sizeof(db_header);
+    header.nameOffsets = header.surnameOffsets + 8 * n;
+    header.surnameLengths = header.nameOffsets + 8 * n;
+    header.nameLengths = header.surnameLengths + 4 * n;
+    header.salaries = header.nameLengths + 4 * n;
+    header.ages = header.salaries + 4 * n;
+    header.clearanceLevels = header.ages + 4 * n;
+    header.heap = header.clearanceLevels + 4 * n;
+    header.stamp = stamp;
+    header.reserved = 0;
+    return header;
+}
+
+index_header makeIndexHeader(db_field field, std::uint64_t n, std::uint32_t stamp) {
+    index_header header;
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.field = field;
+    header.stamp = stamp;
+    header.recordCount = n;
+    return header;
+}
+
+template <typename T>
+static void writeValue(std::ofstream &output, T value) {
+    output.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+bool writeDatabase(const employee_table &table, db_sort_order order, const std::string &dbPath) {
+    std::ofstream output(dbPath, std::ios::binary);
+    if (!output.is_open()) {
+        std::cerr << "Error: could not create " << dbPath << std::endl;
+        return false;
+    }
+    const std::vector<std::uint32_t> &rows = table.order();
+    const string_pool &pool = table.pool();
+    std::uint64_t n = rows.size();
+
+    //heap offset of every pool string
+    std::vector<std::uint64_t> heapOffsets(pool.size());
+    std::uint64_t heapSize = 0;
+    for (std::uint32_t id = 0; id < pool.size(); id++) {
+        heapOffsets[id] = heapSize;
+        heapSize += pool.get(id).size();
+    }
+
+    std::uint32_t stamp = newStamp();
+    writeValue(output, makeHeader(order, n, heapSize, stamp));
+
+    for (std::uint32_t r : rows) {
+        writeValue<std::uint64_t>(output, heapOffsets[table.surnameId(r)]);
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<std::uint64_t>(output, heapOffsets[table.nameId(r)]);
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<std::uint32_t>(output, pool.get(table.surnameId(r)).size());
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<std::uint32_t>(output, pool.get(table.nameId(r)).size());
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<float>(output, table.row(r).salary);
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<std::int32_t>(output, table.row(r).age);
+    }
+    for (std::uint32_t r : rows) {
+        writeValue<std::int32_t>(output, table.row(r).clearanceLevel);
+    }
+    for (std::uint32_t id = 0; id < pool.size(); id++) {
+        output.write(pool.get(id).data(), pool.get(id).size());
+    }
+    output.close();
+    if (!output) {
+        std::cerr << "Error: could not write " << dbPath << std::endl;
+        return false;
+    }
+
+    //one sidecar per field, sorted by key. Equal keys keep the database order
+    std::vector<index_entry> entries(n);
+    for (int f = 0; f < field_count; f++) {
+        db_field field = static_cast<db_field>(f);
+        for (std::uint64_t i = 0; i < n; i++) {
+            employee_view emp = table.row(rows[i]);
+            float value = field == field_salary ? emp.salary
+                        : field == field_age ? emp.age : emp.clearanceLevel;
+            entries[i].key = fieldKey(field, value);
+            entries[i].row = i;
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const index_entry &a, const index_entry &b) {
+            return a.key < b.key;
+        });
+        std::ofstream index(indexPath(dbPath, field), std::ios::binary);
+        writeValue(index, makeIndexHeader(field, n, stamp));
+        index.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(index_entry));
+        index.close();
+        if (!index) {
+            std::cerr << "Error: could not write " << indexPath(dbPath, field) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+employee_db::employee_db() : _header(NULL) {
+    for (int f = 0; f < field_count; f++) {
+        _indexes[f] = NULL;
+    }
+}
+
+bool employee_db::open(const std::string &dbPath) {
+    if (!_file.open(dbPath) || _file.size() < sizeof(db_header)) {
+        std::cerr << "Error: could not open database " << dbPath << std::endl;
+        return false;
+    }
+    _header = reinterpret_cast<const db_header *>(_file.begin());
+    if (std::memcmp(_header->magic, dbMagic, sizeof(dbMagic)) == 0 && _header->version != dbVersion) {
+        std::cerr << "Error: " << dbPath << " was written by another version, rebuild it with --build-db" << std::endl;
+        return false;
+    }
+    if (std::memcmp(_header->magic, dbMagic, sizeof(dbMagic)) != 0
+        || _header->heap + _header->heapSize != _file.size()) {
+        std::cerr << "Error: " << dbPath << " is not an employee database" << std::endl;
+        return false;
+    }
+    for (int f = 0; f < field_count; f++) {
+        std::string path = indexPath(dbPath, static_cast<db_field>(f));
+        mapped_file &index = _indexFiles[f];
+        if (!index.open(path) || index.size() < sizeof(index_header)) {
+            std::cerr << "Error: missing index " << path << std::endl;
+            return false;
+        }
+        const index_header *idxHeader = reinterpret_cast<const index_header *>(index.begin());
+        if (std::memcmp(idxHeader->magic, indexMagic, sizeof(indexMagic)) != 0
+            || idxHeader->field != static_cast<std::uint32_t>(f)
+            || idxHeader->stamp != _header->stamp
+            || idxHeader->recordCount != _header->recordCount
+            || index.size() != sizeof(index_header) + idxHeader->recordCount * sizeof(index_entry)) {
+            std::cerr << "Error: index " << path << " does not belong to " << dbPath << std::endl;
+            return false;
+        }
+        _indexes[f] = reinterpret_cast<const index_entry *>(index.begin() + sizeof(index_header));
+    }
+    return true;
+}
+
+std::size_t employee_db::size() const {
+    return _header->recordCount;
+}
+
+db_sort_order employee_db::sortOrder() const {
+    return static_cast<db_sort_order>(_header->sortOrder);
+}
+
+template <typename T>
+static inline T column(const char *base, std::uint64_t offset, std::size_t i) {
+    T value;
+    std::memcpy(&value, base + offset + i * sizeof(T), sizeof(T));
+    return value;
+}
+
+employee_view employee_db::row(std::size_t i) const {
+    const char *base = _file.begin();
+    const char *heap = base + _header->heap;
+    employee_view emp;
+    emp.surname = std::string_view(heap + column<std::uint64_t>(base, _header->surnameOffsets, i),
+                                   column<std::uint32_t>(base, _header->surnameLengths, i));
+    emp.name = std::string_view(heap + column<std::uint64_t>(base, _header->nameOffsets, i),
+                                column<std::uint32_t>(base, _header->nameLengths, i));
+    emp.salary = column<float>(base, _header->salaries, i);
+    emp.age = column<std::int32_t>(base, _header->ages, i);
+    emp.clearanceLevel = column<std::int32_t>(base, _header->clearanceLevels, i);
+    return emp;
+}
+
+std::uint32_t employee_db::key(db_field field, std::size_t i) const {
+    const char *base = _file.begin();
+    switch (field) {
+        case field_salary: return fieldKey(field, column<float>(base, _header->salaries, i));
+        case field_age: return fieldKey(field, column<std::int32_t>(base, _header->ages, i));
+        default: return fieldKey(field, column<std::int32_t>(base, _header->clearanceLevels, i));
+    }
+}
+
+const char *employee_db::heap() const {
+    return _file.begin() + _header->heap;
+}
+
+std::uint64_t employee_db::heapSize() const {
+    return _header->heapSize;
+}
+
+const index_entry *employee_db::entries(db_field field) const {
+    return _indexes[field];
+}
+
+const index_entry *employee_db::lowerBound(db_field field, std::uint32_t low) const {
+    return std::lower_bound(_indexes[field], _indexes[field] + size(), low,
+                            [](const index_entry &e, std::uint32_t k) { return e.key < k; });
+}
+
+const index_entry *employee_db::upperBound(db_field field, std::uint32_t high) const {
+    return std::upper_bound(_indexes[field], _indexes[field] + size(), high,
+                            [](std::uint32_t k, const index_entry &e) { return k < e.key; });
+}
+
+//splits the expression into words, numbers and comparison operators
+static std::vector<std::string> tokenize(const std::string &expression) {
+    std::vector<std::string> tokens;
+    std::size_t i = 0;
+    while (i < expression.size()) {
+        char c = expression[i];
+        std::size_t start = i;
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+            continue;
+        } else if (std::isalpha(static_cast<unsigned char>(c))) {
+            while (i < expression.size() && (std::isalpha(static_cast<unsigned char>(expression[i])) || expression[i] == '_')) {
+                i++;
+            }
+        } else if (c == '<' || c == '>' || c == '=' || c == '!') {
+            while (i < expression.size() && std::strchr("<>=!", expression[i]) != NULL) {
+                i++;
+            }
+        } else {
+            while (i < expression.size() && !std::isspace(static_cast<unsigned char>(expression[i]))
+                   && std::strchr("<>=!", expression[i]) == NULL) {
+                i++;
+            }
+        }
+        tokens.push_back(expression.substr(start, i - start));
+    }
+    return tokens;
+}
+
+static bool parseField(std::string word, db_field &field) {
+    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    if (word == "salary") {
+        field = field_salary;
+    } else if (word == "age") {
+        field = field_age;
+    } else if (word == "clearance" || word == "clearancelevel") {
+        field = field_clearance;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parseNumber(const std::string &token, float &value) {
+    char *end;
+    value = std::strtof(token.c_str(), &end);
+    return !token.empty() && *end == '\0' && !std::isnan(value);
+}
+
+//smallest key of field which satisfies "field >= value" (or "field > value"
+//if strict). Returns false if no key can satisfy it
+static bool lowerKey(db_field field, float value, bool strict, std::uint32_t &key) {
+    if (field != field_salary) {
+        //age > 3.5 is the same as age >= 4, age > 3 the same as age >= 4
+        value = strict ? std::floor(value) + 1 : std::ceil(value);
+        if (double(value) > INT_MAX) {
+            return false;
+        }
+        key = fieldKey(field, value);
+        return true;
+    }
+    key = fieldKey(field, value);
+    if (strict) {
+        if (key == UINT32_MAX) {
+            return false;
+        }
+        key++;
+    }
+    return true;
+}
+
+//largest key of field which satisfies "field <= value" (or "field < value")
+static bool upperKey(db_field field, float value, bool strict, std::uint32_t &key) {
+    if (field != field_salary) {
+        value = strict ? std::ceil(value) - 1 : std::floor(value);
+        if (double(value) < INT_MIN) {
+            return false;
+        }
+        key = fieldKey(field, value);
+        return true;
+    }
+    key = fieldKey(field, value);
+    if (strict) {
+        if (key == 0) {
+            return false;
+        }
+        key--;
+    }
+    return true;
+}
+
+//parses the conjunction into one inclusive key range per field
+static bool parseExpression(const std::string &expression, std::uint32_t low[], std::uint32_t high[],
+                            bool constrained[]) {
+    std::vector<std::string> tokens = tokenize(expression);
+    std::size_t t = 0;
+    while (t < tokens.size()) {
+        db_field field;
+        float value;
+        if (!parseField(tokens[t], field)) {
+            std::cerr << "Error: expected salary, age or clearance in query, got " << tokens[t] << std::endl;
+            return false;
+        }
+        if (t + 2 >= tokens.size() || !parseNumber(tokens[t + 2], value)) {
+            std::cerr << "Error: expected '<field> <operator> <number>' in query" << std::endl;
+            return false;
+        }
+        std::string op = tokens[t + 1];
+        std::uint32_t lo = 0;
+        std::uint32_t hi = UINT32_MAX;
+        bool possible = true;
+        if (op == "between") {
+            float upper;
+            if (t + 4 >= tokens.size() || tokens[t + 3] != "and" || !parseNumber(tokens[t + 4], upper)) {
+                std::cerr << "Error: expected '<field> between <low> and <high>' in query" << std::endl;
+                return false;
+            }
+            possible = lowerKey(field, value, false, lo) && upperKey(field, upper, false, hi);
+            t += 5;
+        } else {
+            if (op == ">=" || op == ">") {
+                possible = lowerKey(field, value, op == ">", lo);
+            } else if (op == "<=" || op == "<") {
+                possible = upperKey(field, value, op == "<", hi);
+            } else if (op == "=" || op == "==") {
+                possible = lowerKey(field, value, false, lo) && upperKey(field, value, false, hi);
+            } else {
+                std::cerr << "Error: unknown operator " << op << " in query" << std::endl;
+                return false;
+            }
+            t += 3;
+        }
+        if (!possible) {
+            lo = 1;
+            hi = 0;
+        }
+        low[field] = std::max(low[field], lo);
+        high[field] = std::min(high[field], hi);
+        constrained[field] = true;
+        if (t < tokens.size()) {
+            if (tokens[t] != "and" || t + 1 == tokens.size()) {
+                std::cerr << "Error: terms of a query have to be joined with 'and'" << std::endl;
+                return false;
+            }
+            t++;
+        }
+    }
+    return true;
+}
+
+bool queryDatabase(const std::string &dbPath, const std::string &expression, employee_writer &output) {
+    std::uint32_t low[field_count];
+    std::uint32_t high[field_count];
+    bool constrained[field_count];
+    for (int f = 0; f < field_count; f++) {
+        low[f] = 0;
+        high[f] = UINT32_MAX;
+        constrained[f] = false;
+    }
+    if (!parseExpression(expression, low, high, constrained)) {
+        return false;
+    }
+    employee_db db;
+    if (!db.open(dbPath)) {
+        return false;
+    }
+
+    //binary search every constrained index and walk the smallest range.
+    //without any constraint every row matches
+    std::vector<std::uint32_t> matches;
+    bool anyConstraint = false;
+    const index_entry *first = NULL;
+    const index_entry *last = NULL;
+    for (int f = 0; f < field_count; f++) {
+        if (!constrained[f]) {
+            continue;
+        }
+        const index_entry *begin = db.lowerBound(static_cast<db_field>(f), low[f]);
+        const index_entry *end = low[f] <= high[f] ? db.upperBound(static_cast<db_field>(f), high[f]) : begin;
+        if (!anyConstraint || end - begin < last - first) {
+            first = begin;
+            last = end;
+        }
+        anyConstraint = true;
+    }
+    if (!anyConstraint) {
+        for (std::size_t i = 0; i < db.size(); i++) {
+            matches.push_back(i);
+        }
+    }
+    for (const index_entry *e = first; e < last; e++) {
+        bool match = true;
+        for (int f = 0; f < field_count && match; f++) {
+            if (constrained[f]) {
+                std::uint32_t k = db.key(static_cast<db_field>(f), e->row);
+                match = k >= low[f] && k <= high[f];
+            }
+        }
+        if (match) {
+            matches.push_back(e->row);
+        }
+    }
+    //back to database order, i.e. sorted by salary for a sorted database
+    std::sort(matches.begin(), matches.end());
+    for (std::uint32_t row : matches) {
+        output.write(db.row(row));
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef employee_db_hpp
+#define employee_db_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "employee.hpp"
+#include "employee_parser.hpp"
+#include "employee_table.hpp"
+#include "employee_writer.hpp"
+
+//binary employee database. The file starts with a db_header, followed by one
+//array per column (offsets and lengths of the names, salary, age, clearance
+//level) and a heap holding the names (every distinct name once when built
+//with --build-db, an incremental update appends the names it adds). All numbers
+//are stored in host byte order, so the file can be used through mmap without
+//any decoding
+
+enum db_sort_order {
+    order_input = 0,
+    order_salary = 1
+};
+
+enum db_field {
+    field_salary = 0,
+    field_age = 1,
+    field_clearance = 2,
+    field_count = 3
+};
+
+struct db_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t sortOrder;
+    std::uint64_t recordCount;
+    std::uint64_t heapSize;
+    //file offsets of the columns and the heap
+    std::uint64_t surnameOffsets;
+    std::uint64_t nameOffsets;
+    std::uint64_t surnameLengths;
+    std::uint64_t nameLengths;
+    std::uint64_t salaries;
+    std::uint64_t ages;
+    std::uint64_t clearanceLevels;
+    std::uint64_t heap;
+    //the sidecar indexes carry the same stamp, an index of another version of
+    //the database is refused
+    std::uint32_t stamp;
+    std::uint32_t reserved;
+};
+
+//a sidecar index ("<db>.salary.idx", ...) is an index_header followed by
+//recordCount entries sorted by key. Keys are the field values mapped to
+//unsigned integers with the same order, so one binary search works for all
+struct index_header {
+    char magic[8];
+    std::uint32_t field;
+    std::uint32_t stamp;
+    std::uint64_t recordCount;
+};
+
+struct index_entry {
+    std::uint32_t key;
+    std::uint32_t row;
+};
+
+//order preserving keys of the indexed fields
+std::uint32_t fieldKey(db_field field, float value);
+
+std::string indexPath(const std::string &dbPath, db_field field);
+
+//a new stamp for every database that is written
+std::uint32_t newStamp();
+
+//header of a database of n records and a heap of heapSize bytes, the columns
+//and the heap follow it in the order of db_header
+db_header makeHeader(db_sort_order order, std::uint64_t n, std::uint64_t heapSize, std::uint32_t stamp);
+index_header makeIndexHeader(db_field field, std::uint64_t n, std::uint32_t stamp);
+
+//writes table in table.order() to dbPath and creates the three sidecar indexes
+bool writeDatabase(const employee_table &table, db_sort_order order, const std::string &dbPath);
+
+//read only view of a database and its indexes, everything is mmapped
+class employee_db {
+public:
+    employee_db();
+
+    bool open(const std::string &dbPath);
+
+    std::size_t size() const;
+    db_sort_order sortOrder() const;
+    employee_view row(std::size_t i) const;
+    std::uint32_t key(db_field field, std::size_t i) const;
+
+    //the names of row(i) point into this
+    const char *heap() const;
+    std::uint64_t heapSize() const;
+
+    //all size() entries of the index of field
+    const index_entry *entries(db_field field) const;
+
+    //entries of the index of field whose keys lie in [low, high]
+    const index_entry *lowerBound(db_field field, std::uint32_t low) const;
+    const index_entry *upperBound(db_field field, std::uint32_t high) const;
+
+private:
+    mapped_file _file;
+    mapped_file _indexFiles[field_count];
+    const db_header *_header;
+    const index_entry *_indexes[field_count];
+};
+
+//answers expression (i.e. "clearance >= 3 and salary between 30000 and 50000")
+//from the database and writes the matching records in database order to output.
+//returns false if the database can't be opened or the expression is invalid
+bool queryDatabase(const std::string &dbPath, const std::string &expression, employee_writer &output);
+
+#endif
@@ -0,0 +1,215 @@
+#include "employee_parser.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file() : _addr(NULL), _size(0) {}
+
+mapped_file::~mapped_file() {
+    close();
+}
+
+bool mapped_file::open(const std::string &fileName) {
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    _size = st.st_size;
+    //mmap refuses empty mappings, an empty file is simply an empty range
+    if (_size > 0) {
+        _addr = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (_addr == MAP_FAILED) {
+            _addr = NULL;
+            _size = 0;
+            ::close(fd);
+            return false;
+        }
+        //we read the file front to back exactly once
+        madvise(_addr, _size, MADV_SEQUENTIAL);
+    }
+    //the mapping stays valid after closing the descriptor
+    ::close(fd);
+    return true;
+}
+
+void mapped_file::close() {
+    if (_addr != NULL) {
+        munmap(_addr, _size);
+    }
+    _addr = NULL;
+    _size = 0;
+}
+
+const char *mapped_file::begin() const {
+    return static_cast<const char *>(_addr);
+}
+
+const char *mapped_file::end() const {
+    return begin() + _size;
+}
+
+std::size_t mapped_file::size() const {
+    return _size;
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline void skipBlanks(const char *&cursor, const char *end) {
+    while (cursor < end && isBlank(*cursor)) {
+        cursor++;
+    }
+}
+
+std::string_view parseToken(const char *&cursor, const char *end) {
+    skipBlanks(cursor, end);
+    const char *start = cursor;
+    while (cursor < end && !isBlank(*cursor) && *cursor != '\n') {
+        cursor++;
+    }
+    return std::string_view(start, cursor - start);
+}
+
+//powers of ten which are exactly representable as float
+static const float exactPowers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                    1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+bool parseFloat(const char *&cursor, const char *end, float &value) {
+    skipBlanks(cursor, end);
+    const char *start = cursor;
+    bool negative = false;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        negative = *cursor == '-';
+        cursor++;
+    }
+    //digits beyond what fits into the mantissa only make the fast path inexact
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+    bool truncated = false;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        if (mantissa < 100000000000000000ull) {
+            mantissa = mantissa * 10 + (*cursor - '0');
+        } else {
+            truncated = true;
+            exponent++;
+        }
+        anyDigit = true;
+        cursor++;
+    }
+    if (cursor < end && *cursor == '.') {
+        cursor++;
+        while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+            if (mantissa < 100000000000000000ull) {
+                mantissa = mantissa * 10 + (*cursor - '0');
+                exponent--;
+            } else {
+                truncated = true;
+            }
+            anyDigit = true;
+            cursor++;
+        }
+    }
+    bool hasExponent = cursor < end && (*cursor == 'e' || *cursor == 'E');
+    if (!anyDigit || (cursor < end && !isBlank(*cursor) && *cursor != '\n' && !hasExponent)) {
+        cursor = start;
+        return false;
+    }
+    //if mantissa and power of ten are exact floats, one IEEE multiplication or
+    //division rounds correctly, which is exactly what strtof would return.
+    //everything else (exponents, long mantissas) takes the slow but exact road
+    if (!hasExponent && !truncated && mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+        float f = static_cast<float>(mantissa);
+        f = exponent < 0 ? f / exactPowers[-exponent] : f * exactPowers[exponent];
+        value = negative ? -f : f;
+        return true;
+    }
+    char tmp[64];
+    const char *tokenEnd = cursor;
+    while (tokenEnd < end && !isBlank(*tokenEnd) && *tokenEnd != '\n') {
+        tokenEnd++;
+    }
+    std::size_t length = tokenEnd - start;
+    if (length >= sizeof(tmp)) {
+        cursor = start;
+        return false;
+    }
+    std::memcpy(tmp, start, length);
+    tmp[length] = '\0';
+    char *parsedEnd;
+    value = std::strtof(tmp, &parsedEnd);
+    if (parsedEnd != tmp + length) {
+        cursor = start;
+        return false;
+    }
+    cursor = tokenEnd;
+    return true;
+}
+
+bool parseInt(const char *&cursor, const char *end, int &value) {
+    skipBlanks(cursor, end);
+    const char *start = cursor;
+    bool negative = false;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        negative = *cursor == '-';
+        cursor++;
+    }
+    long long result = 0;
+    const char *digitsStart = cursor;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        result = result * 10 + (*cursor - '0');
+        if (result > (negative ? 2147483648ll : 2147483647ll)) {
+            cursor = start;
+            return false;
+        }
+        cursor++;
+    }
+    //the number has to end at a blank or the end of the line, "30abc" is no number
+    if (cursor == digitsStart || (cursor < end && !isBlank(*cursor) && *cursor != '\n')) {
+        cursor = start;
+        return false;
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+bool parseRecord(const char *&cursor, const char *end, employee_view &emp) {
+    const char *lineEnd = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+    if (lineEnd == NULL) {
+        lineEnd = end;
+    }
+    const char *p = cursor;
+    cursor = lineEnd < end ? lineEnd + 1 : end;
+
+    emp.surname = parseToken(p, lineEnd);
+    emp.name = parseToken(p, lineEnd);
+    if (emp.surname.empty() || emp.name.empty()) {
+        return false;
+    }
+    return parseFloat(p, lineEnd, emp.salary) && parseInt(p, lineEnd, emp.age)
+        && parseInt(p, lineEnd, emp.clearanceLevel);
+}
+
+std::size_t parseBuffer(const char *begin, const char *end, std::vector<employee_view> &out) {
+    std::size_t count = 0;
+    const char *cursor = begin;
+    employee_view emp;
+    while (cursor < end) {
+        if (parseRecord(cursor, end, emp)) {
+            out.push_back(emp);
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,45 @@
+#ifndef employee_parser_hpp
+#define employee_parser_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "employee.hpp"
+
+//read only memory mapping of a whole file. The mapping lives as long as the
+//object, so every employee_view parsed out of it must not outlive it
+class mapped_file {
+public:
+    mapped_file();
+    ~mapped_file();
+
+    bool open(const std::string &fileName);
+    void close();
+
+    const char *begin() const;
+    const char *end() const;
+    std::size_t size() const;
+
+private:
+    mapped_file(const mapped_file &);
+    mapped_file &operator=(const mapped_file &);
+
+    void *_addr;
+    std::size_t _size;
+};
+
+//parses one "surname name salary age clearanceLevel" line starting at cursor.
+//cursor is moved behind the line in any case, the return value tells if the
+//line contained a complete record (empty or broken lines are skipped)
+bool parseRecord(const char *&cursor, const char *end, employee_view &emp);
+
+//parses all records in [begin, end) and appends them to out
+std::size_t parseBuffer(const char *begin, const char *end, std::vector<employee_view> &out);
+
+//token and number parsing used by parseRecord, exposed for the other readers.
+//tokens are separated by blanks, a newline is never part of a token
+std::string_view parseToken(const char *&cursor, const char *end);
+bool parseFloat(const char *&cursor, const char *end, float &value);
+bool parseInt(const char *&cursor, const char *end, int &value);
+
+#endif
@@ -0,0 +1,122 @@
+#include "employee_table.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+string_pool::string_pool() : _blockUsed(0), _blockSize(0) {}
+
+std::string_view string_pool::store(std::string_view value) {
+    if (_blocks.empty() || _blockUsed + value.size() > _blockSize) {
+        _blockSize = std::max<std::size_t>(64 * 1024, value.size());
+        _blocks.push_back(std::unique_ptr<char[]>(new char[_blockSize]));
+        _blockUsed = 0;
+    }
+    char *destination = _blocks.back().get() + _blockUsed;
+    std::memcpy(destination, value.data(), value.size());
+    _blockUsed += value.size();
+    return std::string_view(destination, value.size());
+}
+
+std::uint32_t string_pool::intern(std::string_view value) {
+    std::unordered_map<std::string_view, std::uint32_t>::const_iterator it = _ids.find(value);
+    if (it != _ids.end()) {
+        return it->second;
+    }
+    //the key has to point into the pool, value might be gone tomorrow
+    std::string_view stored = store(value);
+    std::uint32_t id = _strings.size();
+    _strings.push_back(stored);
+    _ids.emplace(stored, id);
+    return id;
+}
+
+std::string_view string_pool::get(std::uint32_t id) const {
+    return _strings[id];
+}
+
+std::size_t string_pool::size() const {
+    return _strings.size();
+}
+
+void employee_table::append(const employee_view &emp) {
+    _order.push_back(_salaries.size());
+    _surnames.push_back(_pool.intern(emp.surname));
+    _names.push_back(_pool.intern(emp.name));
+    _salaries.push_back(emp.salary);
+    _ages.push_back(emp.age);
+    _clearanceLevels.push_back(emp.clearanceLevel);
+}
+
+void employee_table::reserve(std::size_t n) {
+    _order.reserve(n);
+    _surnames.reserve(n);
+    _names.reserve(n);
+    _salaries.reserve(n);
+    _ages.reserve(n);
+    _clearanceLevels.reserve(n);
+}
+
+std::size_t employee_table::size() const {
+    return _salaries.size();
+}
+
+void employee_table::sortBySalary() {
+    std::size_t n = _salaries.size();
+    std::vector<std::uint32_t> keys(n);
+    std::vector<std::uint32_t> keysTmp(n);
+    std::vector<std::uint32_t> orderTmp(n);
+    //all four byte histograms in one pass over the column
+    std::size_t counts[4][256] = {};
+    for (std::size_t i = 0; i < n; i++) {
+        keys[i] = salarySortKey(_salaries[_order[i]]);
+        for (int pass = 0; pass < 4; pass++) {
+            counts[pass][(keys[i] >> (8 * pass)) & 0xff]++;
+        }
+    }
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = 8 * pass;
+        //a byte which is the same for every key would only copy the arrays
+        if (n == 0 || counts[pass][(keys[0] >> shift) & 0xff] == n) {
+            continue;
+        }
+        std::size_t offsets[256];
+        std::size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            offsets[b] = sum;
+            sum += counts[pass][b];
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            std::size_t target = offsets[(keys[i] >> shift) & 0xff]++;
+            keysTmp[target] = keys[i];
+            orderTmp[target] = _order[i];
+        }
+        keys.swap(keysTmp);
+        _order.swap(orderTmp);
+    }
+}
+
+const std::vector<std::uint32_t> &employee_table::order() const {
+    return _order;
+}
+
+employee_view employee_table::row(std::size_t i) const {
+    employee_view emp;
+    emp.surname = _pool.get(_surnames[i]);
+    emp.name = _pool.get(_names[i]);
+    emp.salary = _salaries[i];
+    emp.age = _ages[i];
+    emp.clearanceLevel = _clearanceLevels[i];
+    return emp;
+}
+
+std::uint32_t employee_table::surnameId(std::size_t i) const {
+    return _surnames[i];
+}
+
+std::uint32_t employee_table::nameId(std::size_t i) const {
+    return _names[i];
+}
+
+const string_pool &employee_table::pool() const {
+    return _pool;
+}
@@ -0,0 +1,77 @@
+#ifndef employee_table_hpp
+#define employee_table_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "employee.hpp"
+
+//maps the bit pattern of a float to an unsigned key with the same order:
+//positive floats get the sign bit set, negative ones are inverted completely
+inline std::uint32_t salarySortKey(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+//stores every distinct string once. The characters live in fixed blocks
+//which are never moved, so the returned views stay valid as long as the pool
+class string_pool {
+public:
+    string_pool();
+
+    std::uint32_t intern(std::string_view value);
+    std::string_view get(std::uint32_t id) const;
+    std::size_t size() const;
+
+private:
+    string_pool(const string_pool &);
+    string_pool &operator=(const string_pool &);
+
+    std::string_view store(std::string_view value);
+
+    std::vector<std::unique_ptr<char[]> > _blocks;
+    std::size_t _blockUsed;
+    std::size_t _blockSize;
+    std::vector<std::string_view> _strings;
+    std::unordered_map<std::string_view, std::uint32_t> _ids;
+};
+
+//struct of arrays variant of std::vector<employee>. Every column is a plain
+//array, names are ids into a string_pool, and sorting only permutes an index
+//array instead of moving whole records around
+class employee_table {
+public:
+    void append(const employee_view &emp);
+    void reserve(std::size_t n);
+    std::size_t size() const;
+
+    //stable LSD radix sort of the row order by salary
+    void sortBySalary();
+
+    //row positions in sorted order (identity until sortBySalary is called)
+    const std::vector<std::uint32_t> &order() const;
+
+    //view of a single row, the names point into the string pool
+    employee_view row(std::size_t i) const;
+
+    //string pool ids of the names of row i
+    std::uint32_t surnameId(std::size_t i) const;
+    std::uint32_t nameId(std::size_t i) const;
+    const string_pool &pool() const;
+
+private:
+    string_pool _pool;
+    std::vector<std::uint32_t> _surnames;
+    std::vector<std::uint32_t> _names;
+    std::vector<float> _salaries;
+    std::vector<int> _ages;
+    std::vector<int> _clearanceLevels;
+    std::vector<std::uint32_t> _order;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "employee_writer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+employee_writer::employee_writer(bool background, std::size_t bufferSize)
+    : _fd(-1), _ownsFd(false), _failed(false), _bufferSize(std::max<std::size_t>(bufferSize, 4096)),
+      _current(0), _cursor(NULL), _end(NULL), _background(background), _pending(0),
+      _pendingBuffer(0), _stop(false) {
+    _buffers[0].resize(_bufferSize);
+    _cursor = _buffers[0].data();
+    _end = _cursor + _bufferSize;
+    if (_background) {
+        _buffers[1].resize(_bufferSize);
+    }
+}
+
+employee_writer::~employee_writer() {
+    close();
+}
+
+bool employee_writer::open(const std::string &fileName) {
+    close();
+    _fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        return false;
+    }
+    _ownsFd = true;
+    return openFd(_fd);
+}
+
+bool employee_writer::openFd(int fd) {
+    if (fd != _fd) {
+        close();
+    }
+    _fd = fd;
+    _failed = false;
+    _stop = false;
+    if (_background) {
+        _writer = std::thread(&employee_writer::backgroundLoop, this);
+    }
+    return true;
+}
+
+bool employee_writer::writeAll(const char *data, std::size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(_fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+void employee_writer::backgroundLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _changed.wait(lock, [this]() { return _pending > 0 || _stop; });
+        if (_pending == 0) {
+            return;
+        }
+        const char *data = _buffers[_pendingBuffer].data();
+        std::size_t length = _pending;
+        lock.unlock();
+        bool ok = writeAll(data, length);
+        lock.lock();
+        _failed = _failed || !ok;
+        _pending = 0;
+        _changed.notify_all();
+    }
+}
+
+//hands the filled part of the current buffer to the kernel (or to the
+//background writer, which owns it until it is done)
+void employee_writer::flush() {
+    std::size_t length = _cursor - _buffers[_current].data();
+    if (length == 0 || _fd < 0) {
+        return;
+    }
+    if (!_background) {
+        _failed = !writeAll(_buffers[_current].data(), length) || _failed;
+    } else {
+        std::unique_lock<std::mutex> lock(_mutex);
+        //the other buffer has to be written completely before we can reuse it
+        _changed.wait(lock, [this]() { return _pending == 0; });
+        _pendingBuffer = _current;
+        _pending = length;
+        _changed.notify_all();
+        _current = 1 - _current;
+    }
+    _cursor = _buffers[_current].data();
+    _end = _cursor + _bufferSize;
+}
+
+void employee_writer::makeRoom(std::size_t length) {
+    flush();
+    //a single record bigger than the whole buffer (absurdly long names)
+    if (length > _bufferSize) {
+        //the other buffer might still be written by the background thread
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [this]() { return _pending == 0; });
+        _bufferSize = length;
+        for (std::vector<char> &buffer : _buffers) {
+            if (!buffer.empty()) {
+                buffer.resize(_bufferSize);
+            }
+        }
+        _cursor = _buffers[_current].data();
+        _end = _cursor + _bufferSize;
+    }
+}
+
+void employee_writer::writeRaw(const char *data, std::size_t length) {
+    if (length <= static_cast<std::size_t>(_end - _cursor)) {
+        std::memcpy(_cursor, data, length);
+        _cursor += length;
+        return;
+    }
+    if (length < _bufferSize / 2) {
+        flush();
+        std::memcpy(_cursor, data, length);
+        _cursor += length;
+        return;
+    }
+    //big blocks are not copied, the buffer and the block go out with one writev
+    if (_background) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [this]() { return _pending == 0; });
+    }
+    struct iovec parts[2];
+    parts[0].iov_base = _buffers[_current].data();
+    parts[0].iov_len = _cursor - _buffers[_current].data();
+    parts[1].iov_base = const_cast<char *>(data);
+    parts[1].iov_len = length;
+    std::size_t total = parts[0].iov_len + length;
+    ssize_t written;
+    while ((written = writev(_fd, parts, 2)) < 0 && errno == EINTR) {
+    }
+    if (written < 0) {
+        _failed = true;
+    } else if (static_cast<std::size_t>(written) < total) {
+        //short write, the rest goes out the slow way
+        std::size_t done = written;
+        if (done < parts[0].iov_len) {
+            _failed = !writeAll(static_cast<char *>(parts[0].iov_base) + done, parts[0].iov_len - done) || _failed;
+            done = parts[0].iov_len;
+        }
+        _failed = !writeAll(data + (done - parts[0].iov_len), length - (done - parts[0].iov_len)) || _failed;
+    }
+    _cursor = _buffers[_current].data();
+}
+
+//the output has to look exactly like "ostream << float" (printf %g with a
+//precision of 6). Integral salaries below 10^6, by far the most common case,
+//are printed like an int, everything else goes through std::to_chars
+void employee_writer::appendFloat(float value) {
+    if (!std::signbit(value) && value < 1e6f && value == static_cast<float>(static_cast<int>(value))) {
+        appendInt(static_cast<int>(value));
+        return;
+    }
+    if (std::isnan(value) || std::isinf(value)) {
+        //to_chars and printf disagree on these, so spell them the printf way
+        const char *text = std::isnan(value) ? (std::signbit(value) ? "-nan" : "nan")
+                         : (value < 0 ? "-inf" : "inf");
+        appendString(text);
+        return;
+    }
+    std::to_chars_result result = std::to_chars(_cursor, _end, value, std::chars_format::general, 6);
+    _cursor = result.ptr;
+}
+
+void employee_writer::appendInt(int value) {
+    char digits[16];
+    char *p = digits + sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    std::size_t length = digits + sizeof(digits) - p;
+    std::memcpy(_cursor, p, length);
+    _cursor += length;
+}
+
+bool employee_writer::close() {
+    if (_fd < 0) {
+        return !_failed;
+    }
+    flush();
+    if (_background && _writer.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+            _changed.notify_all();
+        }
+        _writer.join();
+    }
+    if (_ownsFd && ::close(_fd) != 0) {
+        _failed = true;
+    }
+    _fd = -1;
+    _ownsFd = false;
+    return !_failed;
+}
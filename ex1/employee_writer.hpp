@@ -0,0 +1,97 @@
+#ifndef employee_writer_hpp
+#define employee_writer_hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+//writes records in the "surname name salary age clearanceLevel" format of the
+//input files. Records are formatted into a large buffer which is handed to
+//the kernel with a single write once it is full, instead of going through an
+//ostream field by field. With background set, a second buffer is filled while
+//a writer thread writes the first one, so formatting and I/O overlap
+class employee_writer {
+public:
+    static const std::size_t defaultBufferSize = 1 << 20;
+
+    explicit employee_writer(bool background = false, std::size_t bufferSize = defaultBufferSize);
+    ~employee_writer();
+
+    //creates (truncates) fileName
+    bool open(const std::string &fileName);
+    //writes to an already open descriptor (i.e. 1 for stdout), which is not closed
+    bool openFd(int fd);
+
+    //works for employee and employee_view
+    template <typename T>
+    void write(const T &emp) {
+        reserve(emp.surname.size() + emp.name.size() + maxNumbersLength);
+        appendString(emp.surname);
+        *_cursor++ = ' ';
+        appendString(emp.name);
+        *_cursor++ = ' ';
+        appendFloat(emp.salary);
+        *_cursor++ = ' ';
+        appendInt(emp.age);
+        *_cursor++ = ' ';
+        appendInt(emp.clearanceLevel);
+        *_cursor++ = '\n';
+    }
+
+    //copies already formatted bytes to the output
+    void writeRaw(const char *data, std::size_t length);
+
+    //writes everything that is buffered and closes the file. Returns false if
+    //any write failed
+    bool close();
+
+private:
+    employee_writer(const employee_writer &);
+    employee_writer &operator=(const employee_writer &);
+
+    //space for the three numbers and the four separators
+    static const std::size_t maxNumbersLength = 64;
+
+    void reserve(std::size_t length) {
+        if (static_cast<std::size_t>(_end - _cursor) < length) {
+            makeRoom(length);
+        }
+    }
+
+    void appendString(std::string_view value) {
+        std::memcpy(_cursor, value.data(), value.size());
+        _cursor += value.size();
+    }
+
+    void appendFloat(float value);
+    void appendInt(int value);
+    void makeRoom(std::size_t length);
+    void flush();
+    bool writeAll(const char *data, std::size_t length);
+    void backgroundLoop();
+
+    int _fd;
+    bool _ownsFd;
+    bool _failed;
+    std::size_t _bufferSize;
+    std::vector<char> _buffers[2];
+    int _current;
+    char *_cursor;
+    char *_end;
+
+    //state shared with the background writer, guarded by _mutex
+    bool _background;
+    std::thread _writer;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::size_t _pending;
+    int _pendingBuffer;
+    bool _stop;
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include "external_sort.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <unistd.h>
+#include "employee.hpp"
+#include "employee_parser.hpp"
+#include "employee_writer.hpp"
+
+//every reader of a merge gets at least this much buffer
+static const std::size_t minReadBuffer = 64 * 1024;
+//upper bound of runs merged at once, keeps us far away from the fd limit
+static const std::size_t maxFanIn = 256;
+
+//binary layout of a spilled record: this header followed by the surname and
+//the name bytes (no terminators)
+struct run_header {
+    std::uint16_t surnameLength;
+    std::uint16_t nameLength;
+    float salary;
+    std::int32_t age;
+    std::int32_t clearanceLevel;
+};
+
+//record of the in memory run, the names live in the arena of the run
+struct run_record {
+    std::uint32_t offset;
+    run_header header;
+};
+
+//opens an anonymous temporary file. It is unlinked right away, so it
+//disappears as soon as it is closed, even if the program crashes
+static FILE *openTemporary() {
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir != NULL && *dir != '\0' ? dir : "/tmp") + "/employee_runXXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path.c_str());
+    FILE *file = fdopen(fd, "w+b");
+    if (file == NULL) {
+        close(fd);
+    }
+    return file;
+}
+
+static bool writeRun(std::vector<run_record> &records, const std::vector<char> &arena,
+                     std::vector<FILE *> &runs) {
+    std::stable_sort(records.begin(), records.end(), [](const run_record &a, const run_record &b) {
+        return a.header.salary < b.header.salary;
+    });
+    FILE *file = openTemporary();
+    if (file == NULL) {
+        std::cerr << "Error: could not create temporary run file" << std::endl;
+        return false;
+    }
+    for (const run_record &rec : records) {
+        std::fwrite(&rec.header, sizeof(run_header), 1, file);
+        std::fwrite(&arena[rec.offset], 1, rec.header.surnameLength + rec.header.nameLength, file);
+    }
+    if (std::fflush(file) != 0 || std::ferror(file)) {
+        std::cerr << "Error: could not write temporary run file" << std::endl;
+        std::fclose(file);
+        return false;
+    }
+    runs.push_back(file);
+    return true;
+}
+
+//reads the input files line by line and spills a sorted run every time the
+//budget is used up. Half of the budget goes to the names, half to the records
+static bool createRuns(const std::vector<std::string> &fileNames, std::size_t memoryBudget,
+                       std::vector<FILE *> &runs) {
+    std::size_t arenaCapacity = memoryBudget / 2;
+    std::size_t recordCapacity = std::max<std::size_t>(1, memoryBudget / 2 / sizeof(run_record));
+    std::vector<char> arena;
+    std::vector<run_record> records;
+    arena.reserve(arenaCapacity);
+    records.reserve(recordCapacity);
+
+    std::string line;
+    for (const std::string &fileName : fileNames) {
+        std::ifstream dataFile(fileName);
+        if (!dataFile.is_open()) {
+            std::cerr << "Error: could not open file " << fileName << std::endl;
+            return false;
+        }
+        while (std::getline(dataFile, line)) {
+            const char *cursor = line.data();
+            employee_view emp;
+            if (!parseRecord(cursor, line.data() + line.size(), emp)
+                || emp.surname.size() > UINT16_MAX || emp.name.size() > UINT16_MAX) {
+                continue;
+            }
+            std::size_t length = emp.surname.size() + emp.name.size();
+            if (records.size() == recordCapacity || arena.size() + length > arenaCapacity) {
+                if (!records.empty() && !writeRun(records, arena, runs)) {
+                    return false;
+                }
+                records.clear();
+                arena.clear();
+            }
+            run_record rec;
+            rec.offset = arena.size();
+            rec.header.surnameLength = emp.surname.size();
+            rec.header.nameLength = emp.name.size();
+            rec.header.salary = emp.salary;
+            rec.header.age = emp.age;
+            rec.header.clearanceLevel = emp.clearanceLevel;
+            arena.insert(arena.end(), emp.surname.begin(), emp.surname.end());
+            arena.insert(arena.end(), emp.name.begin(), emp.name.end());
+            records.push_back(rec);
+        }
+    }
+    return records.empty() || writeRun(records, arena, runs);
+}
+
+//sequential reader of one spilled run with its own read buffer. The current
+//record is kept in an employee whose strings keep their capacity, so reading
+//does not allocate
+class run_reader {
+public:
+    run_reader(FILE *file, std::size_t bufferSize)
+        : _fd(fileno(file)), _buffer(bufferSize), _position(0), _filled(0), _failed(false) {
+        if (lseek(_fd, 0, SEEK_SET) != 0) {
+            _failed = true;
+        }
+    }
+
+    //false at the end of the run or if it could not be read, see failed()
+    bool next() {
+        run_header header;
+        if (_failed || !readBytes(&header, sizeof(run_header), true)) {
+            return false;
+        }
+        current.surname.resize(header.surnameLength);
+        current.name.resize(header.nameLength);
+        if (!readBytes(&current.surname[0], header.surnameLength, false)
+            || !readBytes(&current.name[0], header.nameLength, false)) {
+            return false;
+        }
+        current.salary = header.salary;
+        current.age = header.age;
+        current.clearanceLevel = header.clearanceLevel;
+        return true;
+    }
+
+    //true if a read failed or the run ended inside a record
+    bool failed() const {
+        return _failed;
+    }
+
+    employee current;
+
+private:
+    //the run may only end before the first byte of a record (mayEnd)
+    bool readBytes(void *destination, std::size_t length, bool mayEnd) {
+        char *out = static_cast<char *>(destination);
+        while (length > 0) {
+            if (_position == _filled) {
+                ssize_t got = read(_fd, _buffer.data(), _buffer.size());
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    _failed = got < 0 || !mayEnd || out != destination;
+                    return false;
+                }
+                _position = 0;
+                _filled = got;
+            }
+            std::size_t n = std::min(length, _filled - _position);
+            std::copy(&_buffer[_position], &_buffer[_position] + n, out);
+            _position += n;
+            out += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    int _fd;
+    std::vector<char> _buffer;
+    std::size_t _position;
+    std::size_t _filled;
+    bool _failed;
+};
+
+//merges runs and hands every record in salary order to sink.
+//ties go to the run created first, so the whole sort is stable.
+//Returns false if a run could not be read
+template <typename Sink>
+static bool mergeFiles(const std::vector<FILE *> &runs, std::size_t memoryBudget, Sink sink) {
+    std::size_t bufferSize = std::max(minReadBuffer, memoryBudget / (runs.size() + 1));
+    std::vector<run_reader> readers;
+    readers.reserve(runs.size());
+    for (FILE *file : runs) {
+        readers.push_back(run_reader(file, bufferSize));
+    }
+    employee_cmp cmp;
+    auto later = [&readers, cmp](std::size_t a, std::size_t b) {
+        if (cmp(readers[b].current, readers[a].current)) {
+            return true;
+        }
+        return !cmp(readers[a].current, readers[b].current) && a > b;
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap(later);
+    for (std::size_t r = 0; r < readers.size(); r++) {
+        if (readers[r].next()) {
+            heap.push(r);
+        }
+    }
+    while (!heap.empty()) {
+        std::size_t r = heap.top();
+        heap.pop();
+        sink(readers[r].current);
+        if (readers[r].next()) {
+            heap.push(r);
+        }
+    }
+    for (const run_reader &reader : readers) {
+        if (reader.failed()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void closeRuns(std::vector<FILE *> &runs) {
+    for (FILE *file : runs) {
+        std::fclose(file);
+    }
+    runs.clear();
+}
+
+bool externalSort(const std::vector<std::string> &fileNames, employee_writer &output,
+                  std::size_t memoryBudget) {
+    std::vector<FILE *> runs;
+    if (!createRuns(fileNames, memoryBudget, runs)) {
+        closeRuns(runs);
+        return false;
+    }
+
+    //reduce the number of runs until a single merge can handle all of them
+    std::size_t fanIn = std::min(maxFanIn, std::max<std::size_t>(2, memoryBudget / minReadBuffer - 1));
+    while (runs.size() > fanIn) {
+        std::vector<FILE *> merged;
+        for (std::size_t first = 0; first < runs.size(); first += fanIn) {
+            std::vector<FILE *> group(runs.begin() + first,
+                                      runs.begin() + std::min(runs.size(), first + fanIn));
+            FILE *file = openTemporary();
+            if (file == NULL) {
+                std::cerr << "Error: could not create temporary run file" << std::endl;
+                std::vector<FILE *> rest(runs.begin() + first, runs.end());
+                closeRuns(rest);
+                closeRuns(merged);
+                return false;
+            }
+            std::setvbuf(file, NULL, _IOFBF, minReadBuffer);
+            bool readAll = mergeFiles(group, memoryBudget, [file](const employee &emp) {
+                run_header header;
+                header.surnameLength = emp.surname.size();
+                header.nameLength = emp.name.size();
+                header.salary = emp.salary;
+                header.age = emp.age;
+                header.clearanceLevel = emp.clearanceLevel;
+                std::fwrite(&header, sizeof(run_header), 1, file);
+                std::fwrite(emp.surname.data(), 1, emp.surname.size(), file);
+                std::fwrite(emp.name.data(), 1, emp.name.size(), file);
+            });
+            bool written = std::fflush(file) == 0 && !std::ferror(file);
+            closeRuns(group);
+            merged.push_back(file);
+            if (!readAll || !written) {
+                std::cerr << "Error: could not " << (readAll ? "write" : "read")
+                          << " temporary run file" << std::endl;
+                std::vector<FILE *> rest(runs.begin() + std::min(runs.size(), first + fanIn), runs.end());
+                closeRuns(rest);
+                closeRuns(merged);
+                return false;
+            }
+        }
+        runs.swap(merged);
+    }
+
+    bool readAll = mergeFiles(runs, memoryBudget, [&output](const employee &emp) {
+        output.write(emp);
+    });
+    closeRuns(runs);
+    if (!readAll) {
+        std::cerr << "Error: could not read temporary run file" << std::endl;
+    }
+    return readAll;
+}
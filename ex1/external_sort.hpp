@@ -0,0 +1,17 @@
+#ifndef external_sort_hpp
+#define external_sort_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "employee_writer.hpp"
+
+//sorts all records of fileNames by salary into output without ever
+//holding more than roughly memoryBudget bytes of records. Sorted runs which
+//fit into the budget are spilled to temporary files (in $TMPDIR or /tmp) in
+//a compact binary form and stream merged afterwards. If there are more runs
+//than the budget allows to merge at once, intermediate merge passes are made
+bool externalSort(const std::vector<std::string> &fileNames, employee_writer &output,
+                  std::size_t memoryBudget);
+
+#endif
@@ -0,0 +1,352 @@
+#include "incremental.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "employee.hpp"
+#include "employee_db.hpp"
+#include "employee_parser.hpp"
+#include "employee_writer.hpp"
+
+//parsed delta file. The upserts point into the mapping of the file
+struct employee_delta {
+    mapped_file file;
+    std::vector<employee_view> upserts;
+    //"surname name" of every inserted, updated or deleted employee
+    std::unordered_set<std::string> keys;
+};
+
+static void makeKey(std::string_view surname, std::string_view name, std::string &key) {
+    key.assign(surname.data(), surname.size());
+    key += ' ';
+    key.append(name.data(), name.size());
+}
+
+static bool loadDelta(const std::string &deltaPath, employee_delta &delta) {
+    if (!delta.file.open(deltaPath)) {
+        std::cerr << "Error: could not open file " << deltaPath << std::endl;
+        return false;
+    }
+    //the last line of an employee wins, so collect the lines by key first
+    std::unordered_map<std::string, std::size_t> lastLine;
+    std::vector<employee_view> lines;
+    std::vector<bool> deleted;
+    std::string key;
+    const char *cursor = delta.file.begin();
+    const char *end = delta.file.end();
+    while (cursor < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        const char *p = cursor;
+        std::string_view first = parseToken(p, lineEnd);
+        employee_view emp;
+        if (first == "-") {
+            //"- surname name" deletes an employee
+            emp.surname = parseToken(p, lineEnd);
+            emp.name = parseToken(p, lineEnd);
+            cursor = lineEnd < end ? lineEnd + 1 : end;
+            if (emp.surname.empty() || emp.name.empty()) {
+                continue;
+            }
+            deleted.push_back(true);
+        } else if (parseRecord(cursor, end, emp)) {
+            deleted.push_back(false);
+        } else {
+            continue;
+        }
+        makeKey(emp.surname, emp.name, key);
+        lastLine[key] = lines.size();
+        lines.push_back(emp);
+    }
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        makeKey(lines[i].surname, lines[i].name, key);
+        delta.keys.insert(key);
+        if (!deleted[i] && lastLine[key] == i) {
+            delta.upserts.push_back(lines[i]);
+        }
+    }
+    //ties keep the order of the delta file
+    std::stable_sort(delta.upserts.begin(), delta.upserts.end(), employee_cmp());
+    return true;
+}
+
+//merges the sorted base records with the sorted upserts. next(emp) produces
+//the base records in order and returns false at the end, emitBase and
+//emitDelta write a record. Base records whose key is in the delta are dropped,
+//on equal salaries the base records come first
+template <typename Next, typename EmitBase, typename EmitDelta>
+static void mergeDelta(const employee_delta &delta, Next next, EmitBase emitBase, EmitDelta emitDelta) {
+    std::string key;
+    std::size_t d = 0;
+    employee_view emp;
+    while (next(emp)) {
+        if (!delta.keys.empty()) {
+            makeKey(emp.surname, emp.name, key);
+            if (delta.keys.count(key) != 0) {
+                continue;
+            }
+        }
+        while (d < delta.upserts.size() && delta.upserts[d].salary < emp.salary) {
+            emitDelta(delta.upserts[d++]);
+        }
+        emitBase(emp);
+    }
+    while (d < delta.upserts.size()) {
+        emitDelta(delta.upserts[d++]);
+    }
+}
+
+//the records of the base file are copied verbatim, only the delta gets formatted
+static bool updateText(const std::string &basePath, const employee_delta &delta, bool writerThread) {
+    mapped_file base;
+    if (!base.open(basePath)) {
+        std::cerr << "Error: could not open file " << basePath << std::endl;
+        return false;
+    }
+    std::string tmpPath = basePath + ".tmp";
+    employee_writer output(writerThread);
+    if (!output.open(tmpPath)) {
+        std::cerr << "Error: could not create " << tmpPath << std::endl;
+        return false;
+    }
+    const char *cursor = base.begin();
+    const char *line = cursor;
+    auto next = [&cursor, &line, &base](employee_view &emp) {
+        while (cursor < base.end()) {
+            line = cursor;
+            if (parseRecord(cursor, base.end(), emp)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto emitBase = [&output, &cursor, &line](const employee_view &) {
+        std::size_t length = cursor - line;
+        output.writeRaw(line, length);
+        if (length == 0 || line[length - 1] != '\n') {
+            output.writeRaw("\n", 1);
+        }
+    };
+    auto emitDelta = [&output](const employee_view &emp) {
+        output.write(emp);
+    };
+    mergeDelta(delta, next, emitBase, emitDelta);
+    if (!output.close() || std::rename(tmpPath.c_str(), basePath.c_str()) != 0) {
+        std::cerr << "Error: could not write " << basePath << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void writeValue(std::ofstream &output, T value) {
+    output.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void removeFiles(const std::vector<std::string> &paths) {
+    for (const std::string &path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+//a binary database is updated without rebuilding it. The merge decides the new
+//position of every row, the columns and the heap of the old file are copied
+//in that order, and every index is merged with the sorted keys of the delta
+//with its row ids remapped. Only the delta is sorted, everything else is
+//one linear pass
+static bool updateBinary(const std::string &dbPath, const employee_delta &delta) {
+    employee_db db;
+    if (!db.open(dbPath)) {
+        return false;
+    }
+    if (db.sortOrder() != order_salary) {
+        std::cerr << "Error: " << dbPath << " is not sorted by salary" << std::endl;
+        return false;
+    }
+
+    //rows of the new database in order, i < db.size() is row i of the old
+    //database, the others upsert i - db.size()
+    const std::uint32_t dropped = UINT32_MAX;
+    std::vector<std::uint32_t> sources;
+    std::vector<std::uint32_t> newRows(db.size(), dropped);
+    std::vector<std::uint32_t> newDeltaRows;
+    sources.reserve(db.size() + delta.upserts.size());
+    newDeltaRows.reserve(delta.upserts.size());
+    std::size_t row = 0;
+    auto next = [&db, &row](employee_view &emp) {
+        if (row == db.size()) {
+            return false;
+        }
+        emp = db.row(row++);
+        return true;
+    };
+    auto emitBase = [&sources, &newRows, &row](const employee_view &) {
+        newRows[row - 1] = sources.size();
+        sources.push_back(row - 1);
+    };
+    auto emitDelta = [&sources, &newDeltaRows, &db](const employee_view &) {
+        newDeltaRows.push_back(sources.size());
+        sources.push_back(db.size() + newDeltaRows.size() - 1);
+    };
+    mergeDelta(delta, next, emitBase, emitDelta);
+
+    //the names of the delta are appended to the heap, unless the delta
+    //already had them or they belong to an employee it replaces
+    const char *heap = db.heap();
+    std::uint64_t heapSize = db.heapSize();
+    std::unordered_map<std::string_view, std::uint64_t> names;
+    for (std::size_t i = 0; i < newRows.size(); i++) {
+        if (newRows[i] == dropped) {
+            employee_view emp = db.row(i);
+            names.emplace(emp.surname, emp.surname.data() - heap);
+            names.emplace(emp.name, emp.name.data() - heap);
+        }
+    }
+    std::vector<std::string_view> added;
+    auto heapOffset = [&names, &added, &heapSize](std::string_view value) {
+        auto inserted = names.emplace(value, heapSize);
+        if (inserted.second) {
+            added.push_back(value);
+            heapSize += value.size();
+        }
+        return inserted.first->second;
+    };
+    std::vector<std::uint64_t> surnameOffsets;
+    std::vector<std::uint64_t> nameOffsets;
+    for (const employee_view &emp : delta.upserts) {
+        surnameOffsets.push_back(heapOffset(emp.surname));
+        nameOffsets.push_back(heapOffset(emp.name));
+    }
+
+    //everything goes to temporary files first, which are only renamed once
+    //all of them are written
+    std::string tmpPath = dbPath + ".tmp";
+    std::vector<std::string> tmpPaths(1, tmpPath);
+    for (int f = 0; f < field_count; f++) {
+        tmpPaths.push_back(indexPath(tmpPath, static_cast<db_field>(f)));
+    }
+    std::uint32_t stamp = newStamp();
+    std::uint64_t n = sources.size();
+    std::ofstream output(tmpPath, std::ios::binary);
+    writeValue(output, makeHeader(order_salary, n, heapSize, stamp));
+    auto eachRow = [&sources, &db, &delta](auto write) {
+        for (std::uint32_t source : sources) {
+            if (source < db.size()) {
+                write(db.row(source), source, false);
+            } else {
+                write(delta.upserts[source - db.size()], source - db.size(), true);
+            }
+        }
+    };
+    eachRow([&](const employee_view &emp, std::size_t i, bool fromDelta) {
+        writeValue<std::uint64_t>(output, fromDelta ? surnameOffsets[i] : emp.surname.data() - heap);
+    });
+    eachRow([&](const employee_view &emp, std::size_t i, bool fromDelta) {
+        writeValue<std::uint64_t>(output, fromDelta ? nameOffsets[i] : emp.name.data() - heap);
+    });
+    eachRow([&output](const employee_view &emp, std::size_t, bool) {
+        writeValue<std::uint32_t>(output, emp.surname.size());
+    });
+    eachRow([&output](const employee_view &emp, std::size_t, bool) {
+        writeValue<std::uint32_t>(output, emp.name.size());
+    });
+    eachRow([&output](const employee_view &emp, std::size_t, bool) {
+        writeValue<float>(output, emp.salary);
+    });
+    eachRow([&output](const employee_view &emp, std::size_t, bool) {
+        writeValue<std::int32_t>(output, emp.age);
+    });
+    eachRow([&output](const employee_view &emp, std::size_t, bool) {
+        writeValue<std::int32_t>(output, emp.clearanceLevel);
+    });
+    output.write(heap, db.heapSize());
+    for (std::string_view value : added) {
+        output.write(value.data(), value.size());
+    }
+    output.close();
+    bool written = static_cast<bool>(output);
+
+    //equal keys stay in database order: the old entries keep their relative
+    //order, so both sides are merged by key and new row
+    std::vector<index_entry> deltaEntries(delta.upserts.size());
+    for (int f = 0; f < field_count && written; f++) {
+        db_field field = static_cast<db_field>(f);
+        for (std::size_t i = 0; i < delta.upserts.size(); i++) {
+            const employee_view &emp = delta.upserts[i];
+            float value = field == field_salary ? emp.salary
+                        : field == field_age ? emp.age : emp.clearanceLevel;
+            deltaEntries[i].key = fieldKey(field, value);
+            deltaEntries[i].row = newDeltaRows[i];
+        }
+        auto before = [](const index_entry &a, const index_entry &b) {
+            return a.key < b.key || (a.key == b.key && a.row < b.row);
+        };
+        std::sort(deltaEntries.begin(), deltaEntries.end(), before);
+        std::ofstream index(tmpPaths[1 + f], std::ios::binary);
+        writeValue(index, makeIndexHeader(field, n, stamp));
+        std::size_t d = 0;
+        const index_entry *entries = db.entries(field);
+        for (std::size_t i = 0; i < db.size(); i++) {
+            index_entry entry = entries[i];
+            entry.row = newRows[entry.row];
+            if (entry.row == dropped) {
+                continue;
+            }
+            while (d < deltaEntries.size() && before(deltaEntries[d], entry)) {
+                writeValue(index, deltaEntries[d++]);
+            }
+            writeValue(index, entry);
+        }
+        for (; d < deltaEntries.size(); d++) {
+            writeValue(index, deltaEntries[d]);
+        }
+        index.close();
+        written = static_cast<bool>(index);
+    }
+    if (!written) {
+        std::cerr << "Error: could not write the update of " << dbPath << std::endl;
+        removeFiles(tmpPaths);
+        return false;
+    }
+
+    //the database goes last. If a rename fails, the stamps make the database
+    //refuse the indexes of the other version instead of answering wrongly
+    for (int f = field_count - 1; f >= 0; f--) {
+        std::string path = indexPath(dbPath, static_cast<db_field>(f));
+        if (std::rename(tmpPaths[1 + f].c_str(), path.c_str()) != 0) {
+            std::cerr << "Error: could not replace " << path << std::endl;
+            removeFiles(tmpPaths);
+            return false;
+        }
+        tmpPaths.pop_back();
+    }
+    if (std::rename(tmpPath.c_str(), dbPath.c_str()) != 0) {
+        std::cerr << "Error: could not replace " << dbPath << std::endl;
+        removeFiles(tmpPaths);
+        return false;
+    }
+    return true;
+}
+
+static bool isBinaryDatabase(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    char magic[5] = {};
+    input.read(magic, sizeof(magic));
+    return input && std::memcmp(magic, "EMPDB", 5) == 0;
+}
+
+bool incrementalUpdate(const std::string &basePath, const std::string &deltaPath, bool writerThread) {
+    employee_delta delta;
+    if (!loadDelta(deltaPath, delta)) {
+        return false;
+    }
+    return isBinaryDatabase(basePath) ? updateBinary(basePath, delta) : updateText(basePath, delta, writerThread);
+}
@@ -0,0 +1,20 @@
+#ifndef incremental_hpp
+#define incremental_hpp
+
+#include <string>
+
+//applies the delta file deltaPath to the sorted database basePath, which is
+//either a text output of employee_exec ("sorted_db.txt") or a binary database
+//created with --build-db. Every record line of the delta inserts an employee or
+//replaces the one with the same surname and name, a line "- surname name"
+//deletes one. Only the delta is sorted, it is merged into the existing sorted
+//records in one linear pass. A text database is replaced atomically at the
+//end. The indexes of a binary database are merged with the delta too, all
+//files are written next to it first and renamed over the old ones (the
+//database last) once every one of them is complete. The indexes are stamped
+//with their database, so a rename that fails halfway is detected when the
+//database is opened instead of giving wrong answers.
+//writerThread selects the background writer for text databases
+bool incrementalUpdate(const std::string &basePath, const std::string &deltaPath, bool writerThread);
+
+#endif
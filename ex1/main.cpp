@@ -2,38 +2,322 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
 #include "employee.hpp"
+#include "employee_parser.hpp"
+#include "employee_writer.hpp"
+#include "parallel_sort.hpp"
+#include "external_sort.hpp"
+#include "employee_table.hpp"
+#include "employee_db.hpp"
+#include "incremental.hpp"
+#include "report.hpp"
 
-std::string buffer;
-std::vector<employee> data;
+//command line options, everything which is not an option is an input file
+struct options {
+    bool useMmap = false;
+    bool benchParse = false;
+    bool columnar = false;
+    bool benchSort = false;
+    unsigned threads = 0;
+    std::size_t memoryBudget = 0;
+    std::string buildDb;
+    std::string queryDb;
+    std::string query;
+    std::string delta;
+    bool writerThread = false;
+    std::size_t top = 0;
+    std::vector<double> percentiles;
+    std::vector<std::string> files;
+};
 
-void parseFile(std::string fileName) {
+template <typename T>
+void writeSorted(employee_writer &output, const std::vector<T> &records) {
+    for (const T &emp : records) {
+        output.write(emp);
+    }
+}
+
+//single threaded variant of the default mode, the records are parsed straight
+//out of the mapped files. The views point into the mappings, so they have to
+//stay open until the output is written. Returns false if a file can't be opened
+bool parseFilesMapped(const std::vector<std::string> &fileNames, employee_writer &output) {
+    std::vector<mapped_file> files(fileNames.size());
+    std::vector<employee_view> records;
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        if (!files[i].open(fileNames[i])) {
+            std::cerr << "Error: could not open file " << fileNames[i] << std::endl;
+            return false;
+        }
+        parseBuffer(files[i].begin(), files[i].end(), records);
+    }
+    std::sort(records.begin(), records.end(), employee_cmp());
+    writeSorted(output, records);
+    return true;
+}
+
+//parses fileName with the stream based and with the mmap based reader
+//(without sorting or writing) and prints the throughput of both
+void benchmarkParsers(const std::string &fileName) {
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start = clock::now();
+    std::vector<employee> streamRecords;
     std::ifstream dataFile(fileName);
-    if (dataFile.is_open()) {
-        while (std::getline(dataFile, buffer)) {
-            std::stringstream ss(buffer);
-            employee emp;
-            ss >> emp.surname >> emp.name >> emp.salary >> emp.age >> emp.clearanceLevel;
-            data.push_back(emp);
+    std::string line;
+    while (std::getline(dataFile, line)) {
+        std::stringstream ss(line);
+        employee emp;
+        ss >> emp.surname >> emp.name >> emp.salary >> emp.age >> emp.clearanceLevel;
+        streamRecords.push_back(emp);
+    }
+    double streamTime = std::chrono::duration<double>(clock::now() - start).count();
+
+    start = clock::now();
+    mapped_file file;
+    if (!file.open(fileName)) {
+        std::cerr << "Error: could not open file " << fileName << std::endl;
+        return;
+    }
+    std::vector<employee_view> mappedRecords;
+    parseBuffer(file.begin(), file.end(), mappedRecords);
+    double mappedTime = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::cout << "stream: " << streamRecords.size() << " records in " << streamTime << "s ("
+    << streamRecords.size() / streamTime << " records/s)\n";
+    std::cout << "mmap:   " << mappedRecords.size() << " records in " << mappedTime << "s ("
+    << mappedRecords.size() / mappedTime << " records/s)\n";
+    std::cout << "speedup: " << streamTime / mappedTime << "x" << std::endl;
+}
+
+//loads fileName into an employee_table, returns false if it can't be opened
+bool loadTable(const std::string &fileName, employee_table &table) {
+    mapped_file file;
+    if (!file.open(fileName)) {
+        std::cerr << "Error: could not open file " << fileName << std::endl;
+        return false;
+    }
+    const char *cursor = file.begin();
+    employee_view emp;
+    while (cursor < file.end()) {
+        if (parseRecord(cursor, file.end(), emp)) {
+            table.append(emp);
         }
-        dataFile.close();
     }
-    employee_cmp compare_functor;
-    std::sort(data.begin(), data.end(), compare_functor);
-    std::ofstream output("sorted_db.txt");
-    for (employee emp : data) {
-        output << emp.surname << " " << emp.name << " " << emp.salary << " " << emp.age
-        << " " << emp.clearanceLevel << std::endl;
+    return true;
+}
+
+//sorts fileNames through the columnar store, the output is produced by walking
+//the sorted permutation instead of moving the records. Returns false if a
+//file can't be opened
+bool parseFilesColumnar(const std::vector<std::string> &fileNames, employee_writer &output) {
+    employee_table table;
+    for (const std::string &fileName : fileNames) {
+        if (!loadTable(fileName, table)) {
+            return false;
+        }
     }
-    output.close();
+    table.sortBySalary();
+    for (std::uint32_t row : table.order()) {
+        output.write(table.row(row));
+    }
+    return true;
+}
+
+//times std::sort with employee_cmp on a std::vector<employee> against the
+//radix sort of the columnar table on the same input
+void benchmarkSorts(const std::string &fileName) {
+    typedef std::chrono::steady_clock clock;
+
+    employee_table table;
+    if (!loadTable(fileName, table)) {
+        return;
+    }
+    std::vector<employee> records;
+    records.reserve(table.size());
+    for (std::size_t i = 0; i < table.size(); i++) {
+        employee_view view = table.row(i);
+        employee emp;
+        emp.surname = std::string(view.surname);
+        emp.name = std::string(view.name);
+        emp.salary = view.salary;
+        emp.age = view.age;
+        emp.clearanceLevel = view.clearanceLevel;
+        records.push_back(emp);
+    }
+
+    clock::time_point start = clock::now();
+    std::sort(records.begin(), records.end(), employee_cmp());
+    double structTime = std::chrono::duration<double>(clock::now() - start).count();
+
+    start = clock::now();
+    table.sortBySalary();
+    double radixTime = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::cout << "std::sort (employee_cmp): " << records.size() << " records in " << structTime << "s\n";
+    std::cout << "radix sort (columnar):    " << table.size() << " records in " << radixTime << "s\n";
+    std::cout << "speedup: " << structTime / radixTime << "x" << std::endl;
+}
+
+//parses "p50,p90,p99.9" (the p is optional)
+bool parsePercentiles(const char *list, std::vector<double> &percentiles) {
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty() && (item[0] == 'p' || item[0] == 'P')) {
+            item.erase(0, 1);
+        }
+        char *end;
+        double p = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || p < 0 || p > 100) {
+            return false;
+        }
+        percentiles.push_back(p);
+    }
+    return !percentiles.empty();
+}
+
+bool parseOptions(int argc, const char *argv[], options &opts) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--mmap") == 0) {
+            opts.useMmap = true;
+        } else if (std::strcmp(argv[i], "--bench-parse") == 0) {
+            opts.benchParse = true;
+        } else if (std::strcmp(argv[i], "--columnar") == 0) {
+            opts.columnar = true;
+        } else if (std::strcmp(argv[i], "--bench-sort") == 0) {
+            opts.benchSort = true;
+        } else if (std::strcmp(argv[i], "--writer-thread") == 0) {
+            opts.writerThread = true;
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 == argc || std::atoi(argv[i + 1]) <= 0) {
+                std::cerr << "Error: --threads needs a positive number" << std::endl;
+                return false;
+            }
+            opts.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--memory") == 0) {
+            if (i + 1 == argc || std::atoi(argv[i + 1]) <= 0) {
+                std::cerr << "Error: --memory needs a positive number of megabytes" << std::endl;
+                return false;
+            }
+            opts.memoryBudget = std::size_t(std::atoi(argv[++i])) * 1024 * 1024;
+        } else if (std::strcmp(argv[i], "--build-db") == 0) {
+            if (i + 1 == argc) {
+                std::cerr << "Error: --build-db needs the name of the database" << std::endl;
+                return false;
+            }
+            opts.buildDb = argv[++i];
+        } else if (std::strcmp(argv[i], "--query") == 0) {
+            if (i + 2 >= argc) {
+                std::cerr << "Error: --query needs a database and a query" << std::endl;
+                return false;
+            }
+            opts.queryDb = argv[++i];
+            opts.query = argv[++i];
+        } else if (std::strcmp(argv[i], "--incremental") == 0) {
+            if (i + 1 == argc) {
+                std::cerr << "Error: --incremental needs a delta file" << std::endl;
+                return false;
+            }
+            opts.delta = argv[++i];
+        } else if (std::strcmp(argv[i], "--top") == 0) {
+            if (i + 1 == argc || std::atoi(argv[i + 1]) <= 0) {
+                std::cerr << "Error: --top needs a positive number" << std::endl;
+                return false;
+            }
+            opts.top = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--percentiles") == 0) {
+            if (i + 1 == argc || !parsePercentiles(argv[++i], opts.percentiles)) {
+                std::cerr << "Error: --percentiles needs a list like p50,p90,p99" << std::endl;
+                return false;
+            }
+        } else if (std::strncmp(argv[i], "--", 2) == 0) {
+            std::cerr << "Error: unknown option " << argv[i] << std::endl;
+            return false;
+        } else {
+            opts.files.push_back(argv[i]);
+        }
+    }
+    return true;
 }
 
 int main(int argc, const char * argv[]) {
-    if (argc == 1) {
+    options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        return 1;
+    }
+    if (!opts.queryDb.empty()) {
+        employee_writer output(opts.writerThread);
+        output.openFd(1);
+        bool ok = queryDatabase(opts.queryDb, opts.query, output);
+        return output.close() && ok ? 0 : 1;
+    } else if (!opts.delta.empty()) {
+        //the database to update is the only input file, default is the last output
+        if (opts.files.size() > 1) {
+            std::cerr << "Error: --incremental updates exactly one database" << std::endl;
+            return 1;
+        }
+        return incrementalUpdate(opts.files.empty() ? "sorted_db.txt" : opts.files[0], opts.delta,
+                                 opts.writerThread) ? 0 : 1;
+    } else if (opts.files.empty()) {
         std::cout << argv[0] << " called without input args\n";
+    } else if (opts.benchParse) {
+        for (const std::string &file : opts.files) {
+            benchmarkParsers(file);
+        }
+    } else if (opts.benchSort) {
+        for (const std::string &file : opts.files) {
+            benchmarkSorts(file);
+        }
+    } else if (opts.top > 0 || !opts.percentiles.empty()) {
+        //reports go to stdout and never sort the whole input
+        bool ok = true;
+        if (opts.top > 0) {
+            employee_writer output(opts.writerThread);
+            output.openFd(1);
+            ok = topEarners(opts.files, opts.top, output);
+            ok = output.close() && ok;
+        }
+        if (ok && !opts.percentiles.empty()) {
+            ok = salaryPercentiles(opts.files, opts.percentiles, opts.memoryBudget, std::cout);
+        }
+        return ok ? 0 : 1;
+    } else if (!opts.buildDb.empty()) {
+        //all inputs go into one database, stored sorted by salary
+        employee_table table;
+        for (const std::string &file : opts.files) {
+            if (!loadTable(file, table)) {
+                return 1;
+            }
+        }
+        table.sortBySalary();
+        return writeDatabase(table, order_salary, opts.buildDb) ? 0 : 1;
     } else {
-        for (int i = 1; i < argc; i++) {
-            parseFile(argv[1]);
+        employee_writer output(opts.writerThread);
+        if (!output.open("sorted_db.txt")) {
+            std::cerr << "Error: could not create sorted_db.txt" << std::endl;
+            return 1;
+        }
+        bool ok = true;
+        if (opts.memoryBudget > 0) {
+            //all inputs end up in one sorted file, the memory use does not depend on their size
+            ok = externalSort(opts.files, output, opts.memoryBudget);
+        } else if (opts.columnar) {
+            ok = parseFilesColumnar(opts.files, output);
+        } else if (opts.useMmap) {
+            ok = parseFilesMapped(opts.files, output);
+        } else {
+            //every file is parsed and sorted concurrently, then all sorted runs go
+            //through one k-way merge and the output is written once
+            unsigned threads = opts.threads > 0 ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+            ok = parallelSortFiles(opts.files, output, threads);
+        }
+        if (!output.close() || !ok) {
+            return 1;
         }
     }
     return 0;
@@ -0,0 +1,45 @@
+#ifndef merge_hpp
+#define merge_hpp
+
+#include <cstddef>
+#include <queue>
+#include <vector>
+#include "employee.hpp"
+
+//merges k runs which are each sorted by employee_cmp and hands every record
+//to sink in global order. Uses a binary heap holding the head of every run,
+//so the merge costs O(N log k)
+template <typename T, typename Sink>
+void mergeRuns(const std::vector<std::vector<T> > &runs, Sink sink) {
+    struct head {
+        const T *record;
+        std::size_t run;
+    };
+    //std::priority_queue is a max heap, so the comparison is reversed. Ties
+    //go to the lower run index, which keeps the merge stable across runs
+    employee_cmp cmp;
+    auto later = [cmp](const head &a, const head &b) {
+        if (cmp(*b.record, *a.record)) {
+            return true;
+        }
+        return !cmp(*a.record, *b.record) && a.run > b.run;
+    };
+    std::priority_queue<head, std::vector<head>, decltype(later)> heap(later);
+    std::vector<std::size_t> position(runs.size(), 0);
+    for (std::size_t r = 0; r < runs.size(); r++) {
+        if (!runs[r].empty()) {
+            heap.push(head{&runs[r][0], r});
+        }
+    }
+    while (!heap.empty()) {
+        head top = heap.top();
+        heap.pop();
+        sink(*top.record);
+        std::size_t next = ++position[top.run];
+        if (next < runs[top.run].size()) {
+            heap.push(head{&runs[top.run][next], top.run});
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "parallel_sort.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "employee_parser.hpp"
+#include "employee_writer.hpp"
+#include "merge.hpp"
+
+std::vector<chunk> splitChunks(const char *begin, const char *end, unsigned n) {
+    std::vector<chunk> chunks;
+    if (n == 0) {
+        n = 1;
+    }
+    std::size_t target = (end - begin) / n + 1;
+    const char *start = begin;
+    while (start < end) {
+        const char *stop = start + std::min<std::size_t>(target, end - start);
+        //move the cut behind the next newline
+        if (stop < end) {
+            const char *newline = static_cast<const char *>(std::memchr(stop, '\n', end - stop));
+            stop = newline == NULL ? end : newline + 1;
+        }
+        chunks.push_back(chunk(start, stop));
+        start = stop;
+    }
+    return chunks;
+}
+
+std::vector<std::vector<employee_view> > parseAndSortChunks(const std::vector<chunk> &chunks,
+                                                            unsigned nThreads) {
+    std::vector<std::vector<employee_view> > runs(chunks.size());
+    std::atomic<std::size_t> nextChunk(0);
+    //every chunk is claimed by exactly one worker, which is the only one
+    //touching its run, so no locking is needed
+    auto worker = [&chunks, &runs, &nextChunk]() {
+        std::size_t i;
+        while ((i = nextChunk.fetch_add(1)) < chunks.size()) {
+            parseBuffer(chunks[i].first, chunks[i].second, runs[i]);
+            std::sort(runs[i].begin(), runs[i].end(), employee_cmp());
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < std::min<std::size_t>(std::max(1u, nThreads), chunks.size()); t++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    return runs;
+}
+
+bool parallelSortFiles(const std::vector<std::string> &fileNames, employee_writer &output,
+                       unsigned nThreads) {
+    std::vector<std::unique_ptr<mapped_file> > files;
+    std::size_t totalSize = 0;
+    for (const std::string &fileName : fileNames) {
+        files.push_back(std::unique_ptr<mapped_file>(new mapped_file()));
+        if (!files.back()->open(fileName)) {
+            std::cerr << "Error: could not open file " << fileName << std::endl;
+            return false;
+        }
+        totalSize += files.back()->size();
+    }
+
+    //every file gets its share of the threads, but at least one chunk
+    std::vector<chunk> chunks;
+    for (const std::unique_ptr<mapped_file> &file : files) {
+        unsigned pieces = totalSize == 0 ? 1 : std::max<std::size_t>(1, nThreads * file->size() / totalSize);
+        std::vector<chunk> fileChunks = splitChunks(file->begin(), file->end(), pieces);
+        chunks.insert(chunks.end(), fileChunks.begin(), fileChunks.end());
+    }
+    std::vector<std::vector<employee_view> > runs = parseAndSortChunks(chunks, nThreads);
+
+    mergeRuns(runs, [&output](const employee_view &emp) {
+        output.write(emp);
+    });
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef parallel_sort_hpp
+#define parallel_sort_hpp
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "employee.hpp"
+#include "employee_writer.hpp"
+
+typedef std::pair<const char *, const char *> chunk;
+
+//splits [begin, end) into at most n pieces of roughly equal size. Every piece
+//ends behind a newline (or at end), so no record is cut in half
+std::vector<chunk> splitChunks(const char *begin, const char *end, unsigned n);
+
+//parses every chunk into its own vector and sorts it with employee_cmp.
+//nThreads workers take the chunks one after the other, so a few big and many
+//small chunks still keep every worker busy. The result holds one sorted run per chunk
+std::vector<std::vector<employee_view> > parseAndSortChunks(const std::vector<chunk> &chunks,
+                                                            unsigned nThreads);
+
+//mmaps all fileNames, parses and sorts them with nThreads threads and merges
+//the sorted runs of all files with a single k-way merge into output.
+//a single big file is split into nThreads chunks, many files are roughly one chunk each
+bool parallelSortFiles(const std::vector<std::string> &fileNames, employee_writer &output,
+                       unsigned nThreads);
+
+#endif
@@ -0,0 +1,200 @@
+#include "report.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <queue>
+#include "employee.hpp"
+#include "employee_parser.hpp"
+
+//calls handle for every record of fileNames, without storing them anywhere
+template <typename Handler>
+static bool forEachRecord(const std::vector<std::string> &fileNames, Handler handle) {
+    for (const std::string &fileName : fileNames) {
+        mapped_file file;
+        if (!file.open(fileName)) {
+            std::cerr << "Error: could not open file " << fileName << std::endl;
+            return false;
+        }
+        const char *cursor = file.begin();
+        employee_view emp;
+        while (cursor < file.end()) {
+            if (parseRecord(cursor, file.end(), emp)) {
+                handle(emp);
+            }
+        }
+    }
+    return true;
+}
+
+bool topEarners(const std::vector<std::string> &fileNames, std::size_t k, employee_writer &output) {
+    //min heap by salary, the top is the worst paid employee we still keep.
+    //a record is only copied if it beats the top, which then is overwritten
+    //in place (the strings keep their capacity)
+    employee_cmp cmp;
+    auto worse = [cmp](const employee &a, const employee &b) {
+        return cmp(b, a);
+    };
+    //k comes from the command line and may be far more than there are
+    //records, beyond a first block the heap grows as the records come in
+    std::vector<employee> heap;
+    heap.reserve(std::min<std::size_t>(k, 4096));
+    bool ok = forEachRecord(fileNames, [&heap, &worse, &cmp, k](const employee_view &emp) {
+        if (heap.size() < k) {
+            employee copy;
+            copy.surname.assign(emp.surname.data(), emp.surname.size());
+            copy.name.assign(emp.name.data(), emp.name.size());
+            copy.salary = emp.salary;
+            copy.age = emp.age;
+            copy.clearanceLevel = emp.clearanceLevel;
+            heap.push_back(copy);
+            std::push_heap(heap.begin(), heap.end(), worse);
+        } else if (k > 0 && cmp(heap.front(), emp)) {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            employee &slot = heap.back();
+            slot.surname.assign(emp.surname.data(), emp.surname.size());
+            slot.name.assign(emp.name.data(), emp.name.size());
+            slot.salary = emp.salary;
+            slot.age = emp.age;
+            slot.clearanceLevel = emp.clearanceLevel;
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+    });
+    //sorting the heap with the reversed comparison gives the best paid first
+    std::sort_heap(heap.begin(), heap.end(), worse);
+    for (const employee &emp : heap) {
+        output.write(emp);
+    }
+    return ok;
+}
+
+bool salaryPercentiles(const std::vector<std::string> &fileNames, const std::vector<double> &percentiles,
+                       std::size_t memoryBudget, std::ostream &output) {
+    std::vector<float> salaries;
+    std::vector<p2_quantile> estimators;
+    std::size_t maxSalaries = memoryBudget == 0 ? SIZE_MAX : std::max<std::size_t>(1, memoryBudget / sizeof(float));
+    bool ok = forEachRecord(fileNames, [&](const employee_view &emp) {
+        if (!estimators.empty()) {
+            for (p2_quantile &estimator : estimators) {
+                estimator.add(emp.salary);
+            }
+            return;
+        }
+        salaries.push_back(emp.salary);
+        if (salaries.size() == maxSalaries) {
+            //out of budget, continue approximately with constant memory
+            for (double p : percentiles) {
+                estimators.push_back(p2_quantile(p / 100));
+                for (float salary : salaries) {
+                    estimators.back().add(salary);
+                }
+            }
+            std::vector<float>().swap(salaries);
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+    for (std::size_t i = 0; i < percentiles.size(); i++) {
+        output << "p" << percentiles[i] << ": ";
+        if (!estimators.empty()) {
+            output << static_cast<float>(estimators[i].value()) << " (approximate)\n";
+        } else if (salaries.empty()) {
+            output << "-\n";
+        } else {
+            //nearest rank: the smallest salary with at least p percent of all salaries <= it
+            std::size_t rank = static_cast<std::size_t>(std::ceil(percentiles[i] / 100 * salaries.size()));
+            std::size_t index = rank == 0 ? 0 : std::min(rank, salaries.size()) - 1;
+            std::nth_element(salaries.begin(), salaries.begin() + index, salaries.end());
+            output << salaries[index] << "\n";
+        }
+    }
+    output.flush();
+    return true;
+}
+
+p2_quantile::p2_quantile(double p) : _p(p), _count(0) {
+    for (int i = 0; i < 5; i++) {
+        _heights[i] = 0;
+        _positions[i] = i + 1;
+    }
+    _desired[0] = 1;
+    _desired[1] = 1 + 2 * p;
+    _desired[2] = 1 + 4 * p;
+    _desired[3] = 3 + 2 * p;
+    _desired[4] = 5;
+    _increments[0] = 0;
+    _increments[1] = p / 2;
+    _increments[2] = p;
+    _increments[3] = (1 + p) / 2;
+    _increments[4] = 1;
+}
+
+void p2_quantile::add(double x) {
+    //the first five values simply become the markers
+    if (_count < 5) {
+        _heights[_count++] = x;
+        if (_count == 5) {
+            std::sort(_heights, _heights + 5);
+        }
+        return;
+    }
+    _count++;
+    int k;
+    if (x < _heights[0]) {
+        _heights[0] = x;
+        k = 0;
+    } else if (x >= _heights[4]) {
+        _heights[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= _heights[k + 1]) {
+            k++;
+        }
+    }
+    for (int i = k + 1; i < 5; i++) {
+        _positions[i]++;
+    }
+    for (int i = 0; i < 5; i++) {
+        _desired[i] += _increments[i];
+    }
+    //move the middle markers towards their desired positions
+    for (int i = 1; i <= 3; i++) {
+        double d = _desired[i] - _positions[i];
+        if ((d >= 1 && _positions[i + 1] - _positions[i] > 1) || (d <= -1 && _positions[i - 1] - _positions[i] < -1)) {
+            int step = d > 0 ? 1 : -1;
+            double height = parabolic(i, step);
+            if (_heights[i - 1] < height && height < _heights[i + 1]) {
+                _heights[i] = height;
+            } else {
+                _heights[i] = linear(i, step);
+            }
+            _positions[i] += step;
+        }
+    }
+}
+
+double p2_quantile::parabolic(int i, double d) const {
+    return _heights[i] + d / (_positions[i + 1] - _positions[i - 1])
+        * ((_positions[i] - _positions[i - 1] + d) * (_heights[i + 1] - _heights[i]) / (_positions[i + 1] - _positions[i])
+           + (_positions[i + 1] - _positions[i] - d) * (_heights[i] - _heights[i - 1]) / (_positions[i] - _positions[i - 1]));
+}
+
+double p2_quantile::linear(int i, int d) const {
+    return _heights[i] + d * (_heights[i + d] - _heights[i]) / (_positions[i + d] - _positions[i]);
+}
+
+double p2_quantile::value() const {
+    if (_count >= 5) {
+        return _heights[2];
+    }
+    if (_count == 0) {
+        return 0;
+    }
+    double sorted[5];
+    std::copy(_heights, _heights + _count, sorted);
+    std::sort(sorted, sorted + _count);
+    std::size_t rank = static_cast<std::size_t>(std::ceil(_p * _count));
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
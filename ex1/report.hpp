@@ -0,0 +1,44 @@
+#ifndef report_hpp
+#define report_hpp
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "employee_writer.hpp"
+
+//writes the k best paid employees of all fileNames to output, best paid first.
+//the files are streamed through a heap of k records, so this costs
+//O(N log k) time and O(k) memory instead of a full sort
+bool topEarners(const std::vector<std::string> &fileNames, std::size_t k, employee_writer &output);
+
+//prints the salary percentiles (nearest rank) of all fileNames, one
+//"p<percentile>: <salary>" line each. The salaries are selected with
+//std::nth_element in O(N). If memoryBudget is not 0 and the salaries do not
+//fit into it, the rest of the input is handled by streaming P-square
+//estimators with constant memory and the results are approximations
+bool salaryPercentiles(const std::vector<std::string> &fileNames, const std::vector<double> &percentiles,
+                       std::size_t memoryBudget, std::ostream &output);
+
+//streaming quantile estimator of Jain and Chlamtac (P-square algorithm),
+//keeps five markers no matter how many values are added
+class p2_quantile {
+public:
+    explicit p2_quantile(double p);
+
+    void add(double x);
+    double value() const;
+
+private:
+    double parabolic(int i, double d) const;
+    double linear(int i, int d) const;
+
+    double _p;
+    std::size_t _count;
+    double _heights[5];
+    double _positions[5];
+    double _desired[5];
+    double _increments[5];
+};
+
+#endif
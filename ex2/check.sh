@@ -0,0 +1,43 @@
+#!/bin/sh
+# regression checks for ppgrep, run by "make check". Counts are compared with
+# "grep -o pattern | wc -l"; the long lines once took quadratic time to scan
+
+dir=$( mktemp -d ) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# expect FILE PATTERN [COUNT]: ppgrep has to count COUNT matches (what grep
+# counts if not given) within 10 seconds, mapped and streamed
+expect()
+{
+  expected=${3:-$( grep -o -e "$2" "$1" | wc -l )}
+  counted=$( timeout 10 ./ppgrep "$2" "$1" )
+  streamed=$( timeout 10 ./ppgrep -o "$2" - < "$1" | wc -l )
+  if [ "$counted" != "$expected" ] || [ "$streamed" != "$expected" ]
+  then
+    echo "FAILED: '$2' on $1: $counted / $streamed instead of $expected"
+    failed=1
+  fi
+}
+
+for f in file1.txt file2.txt file3.txt
+do
+  for p in 'the' 'e.' '^T' 'e$' 'a*b' '[a-z]*x' '\(ab\)*c\|d' 'a\|^b\|c$'
+  do
+    expect $f "$p"
+  done
+done
+
+# 400 KB lines on which every run of the dfa reads up to the end of the line.
+# grep itself takes minutes for them, so the counts are given
+awk 'BEGIN { for( i = 0; i < 400000; i++ ) printf "a"; print "" }' > "$dir/a.txt"
+awk 'BEGIN { for( i = 0; i < 400; i++ ) { for( j = 0; j < 1000; j++ ) printf "a"; printf "c" } print "" }' > "$dir/ac.txt"
+expect "$dir/a.txt" 'a*b' 0
+expect "$dir/a.txt" '[ac]*b' 0
+expect "$dir/a.txt" 'a*b\|a$' 1
+expect "$dir/ac.txt" 'a*b' 0
+expect "$dir/ac.txt" 'a*b\|c' 400
+expect "$dir/ac.txt" '[ac]*b\|c$' 1
+
+[ $failed = 0 ] && echo "all checks passed"
+exit $failed
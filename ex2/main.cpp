@@ -1,9 +1,25 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <atomic>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <stdlib.h>
 
+#include "mapped_file.hpp"
+#include "regex.hpp"
+#include "report.hpp"
+#include "search.hpp"
+#include "stream.hpp"
+#include "thread_pool.hpp"
+#include "trigram_index.hpp"
+
 // count the occurrences of pattern_ inside the filename_ and write the result (a single number) to a file called "result_PID.txt",
 // where PID is the process id of the calling process. NOTE: must use execl to perform the count and write to file!
 
@@ -41,19 +57,11 @@ int read_occurrences_file( const std::string& filename_ )
 }
 
 
-// entry point of the application
-
-int main( int argc, char* argv[] )
+// count pattern_ in every file of filenames_ with the original approach:
+// one child process per file running grep, results are passed back through files
+int count_with_grep( const std::string& pattern_, const std::vector< std::string >& filenames_ )
 {
-  // check parameters
-  if (argc < 3) {
-  	std::cerr << "Error: parameters are missing" << std::endl;
-  	exit(EXIT_FAILURE);
-  }
-
-  std::string pattern( argv[ 1 ] );  
-  //argc has one default argument to invoke the name and one argument is the pattern
-  int files_count = argc - 2; 
+  int files_count = filenames_.size();
 
   int* status = new int[ files_count ];
   pid_t* pids = new pid_t[ files_count ];
@@ -69,7 +77,7 @@ int main( int argc, char* argv[] )
     }
     if (pids[f] == 0) {
     	pids[f] = getpid();
-    	occurrences_in_file(argv[f + 2], argv[1]);
+    	occurrences_in_file(filenames_[f], pattern_);
     }
   }
 
@@ -82,21 +90,570 @@ int main( int argc, char* argv[] )
   		std::cerr << "Error on child termination" << std::endl;
   	}
   }
-  
 
-  // open results files, compute overall number of occurrences and print it to standard output
-  // ...
+  // open results files, compute overall number of occurrences
   int result = 0;
 
   for(int i = 0; i < files_count; i++) {
   	std::string filename = "result_" + std::to_string(pids[i]) + ".txt";
   	result += read_occurrences_file(filename);
+  	remove(filename.c_str());
   }
 
-  std::cout << result << std::endl;
-  
   delete[] status;
   delete[] pids;
-  
+
+  return result;
+}
+
+
+// a file which is counted in several ranges, the mapping lives until the
+// ranges are stitched together
+struct split_file
+{
+  std::shared_ptr< mapped_file > file;
+  std::vector< range_count > ranges;
+  // time each range took
+  std::vector< double > seconds;
+};
+
+
+// cuts [begin_, end_) into ranges of chunk_size_ bytes, or a bit more if
+// matcher_ needs the ranges to end behind a newline
+void split_ranges( const matcher& matcher_, const char* begin_, const char* end_, std::size_t chunk_size_,
+		   std::vector< range_count >& ranges_ )
+{
+  while( begin_ < end_ )
+  {
+    range_count range;
+    range.begin = begin_;
+    range.limit = static_cast< std::size_t >( end_ - begin_ ) > chunk_size_ ? begin_ + chunk_size_ : end_;
+    if( matcher_.line_ranges() && range.limit < end_ )
+    {
+      const char* newline = static_cast< const char* >( std::memchr( range.limit, '\n', end_ - range.limit ) );
+      range.limit = newline == NULL ? end_ : newline + 1;
+    }
+    ranges_.push_back( range );
+    begin_ = range.limit;
+  }
+}
+
+
+// adds the position of every match in [begin_, end_) of the file starting at
+// file_. begin_ has to be a line start. counted_ is how far the newlines
+// are counted, line_ the number of the line there, both move along
+void find_positions( const matcher& matcher_, const char* file_, const char* begin_, const char* end_,
+		     const char*& counted_, std::uint64_t& line_, std::vector< match_position >& positions_ )
+{
+  matcher_.find_all( begin_, begin_, end_, [ file_, &counted_, &line_, &positions_ ]( const char* match_begin_,
+											const char* )
+  {
+    line_ += std::count( counted_, match_begin_, '\n' );
+    counted_ = match_begin_;
+    match_position position = { std::uint64_t( match_begin_ - file_ ), line_ };
+    positions_.push_back( position );
+    return true;
+  } );
+}
+
+
+double seconds_since( std::chrono::steady_clock::time_point start_ )
+{
+  return std::chrono::duration< double >( std::chrono::steady_clock::now() - start_ ).count();
+}
+
+
+// count the matches of matcher_ in every file of filenames_ inside this process:
+// a pool of n_threads_ threads maps the files and counts the matches in memory.
+// files larger than chunk_size_ are split into ranges of that size which are
+// queued like files, so one huge file keeps all threads busy as well. If
+// plans_ is given, only the blocks it lists are scanned of the files it has
+// an index for. stats_ receives one entry per file (files which can't be
+// opened count 0), with positions_ including where every match starts; those
+// files are scanned in one piece. returns the total number of matches
+std::size_t count_in_process( const matcher& matcher_, const std::vector< std::string >& filenames_,
+			      unsigned n_threads_, std::size_t chunk_size_, const std::vector< scan_plan >* plans_,
+			      bool positions_, std::vector< file_stats >& stats_ )
+{
+  stats_.assign( filenames_.size(), file_stats() );
+  std::vector< split_file > split( filenames_.size() );
+  // the jobs add their counts without a lock
+  std::atomic< std::size_t > total( 0 );
+  thread_pool pool( n_threads_ );
+  for( std::size_t f = 0; f < filenames_.size(); f++ )
+  {
+    stats_[ f ].file = filenames_[ f ];
+    stats_[ f ].matches = 0;
+    stats_[ f ].bytes_scanned = 0;
+    stats_[ f ].seconds = 0;
+    const scan_plan* plan = plans_ != NULL && !( *plans_ )[ f ].whole_file ? &( *plans_ )[ f ] : NULL;
+    if( plan != NULL && plan->blocks.empty() )
+    {
+      // the index says there is no match
+      continue;
+    }
+    // every job writes only its own slot of stats_ and split
+    pool.submit( [ &matcher_, &filenames_, &stats_, &split, &total, &pool, chunk_size_, plan, positions_, f ]()
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      file_stats& stats = stats_[ f ];
+      std::shared_ptr< mapped_file > file( new mapped_file );
+      if( !file->open( filenames_[ f ] ) )
+      {
+        std::cerr << "Error: could not open file " << filenames_[ f ] << std::endl;
+        return;
+      }
+      // the blocks of the index end behind a newline, no match continues from one into the next
+      std::vector< std::pair< std::uint64_t, std::uint64_t > > blocks;
+      if( plan == NULL )
+      {
+        blocks.push_back( std::make_pair( 0, file->size() ) );
+      }
+      else
+      {
+        for( std::size_t b = 0; b < plan->blocks.size(); b++ )
+        {
+          blocks.push_back( std::make_pair( std::min< std::uint64_t >( plan->blocks[ b ].first, file->size() ),
+                                            std::min< std::uint64_t >( plan->blocks[ b ].second, file->size() ) ) );
+        }
+      }
+      for( std::size_t b = 0; b < blocks.size(); b++ )
+      {
+        stats.bytes_scanned += blocks[ b ].second - blocks[ b ].first;
+      }
+      if( positions_ || ( plan == NULL && file->size() <= chunk_size_ ) )
+      {
+        const char* counted = file->begin();
+        std::uint64_t line = 1;
+        for( std::size_t b = 0; b < blocks.size(); b++ )
+        {
+          const char* begin = file->begin() + blocks[ b ].first;
+          const char* end = file->begin() + blocks[ b ].second;
+          if( positions_ )
+          {
+            find_positions( matcher_, file->begin(), begin, end, counted, line, stats.positions );
+          }
+          else
+          {
+            stats.matches += matcher_.count( begin, end );
+          }
+        }
+        if( positions_ )
+        {
+          stats.matches = stats.positions.size();
+        }
+        total.fetch_add( stats.matches, std::memory_order_relaxed );
+        stats.seconds = seconds_since( start );
+        return;
+      }
+      std::vector< range_count >& ranges = split[ f ].ranges;
+      for( std::size_t b = 0; b < blocks.size(); b++ )
+      {
+        split_ranges( matcher_, file->begin() + blocks[ b ].first, file->begin() + blocks[ b ].second,
+                      chunk_size_, ranges );
+      }
+      split[ f ].file = file;
+      split[ f ].seconds.assign( ranges.size(), 0 );
+      std::vector< double >& seconds = split[ f ].seconds;
+      for( std::size_t r = 0; r < ranges.size(); r++ )
+      {
+        // the job keeps the mapping alive on its own, ranges is not resized any more
+        pool.submit( [ &matcher_, &ranges, &seconds, file, r ]()
+        {
+          std::chrono::steady_clock::time_point range_start = std::chrono::steady_clock::now();
+          range_count& range = ranges[ r ];
+          range.count = matcher_.count_range( range.begin, range.limit, file->end(), range.resume );
+          seconds[ r ] = seconds_since( range_start );
+        } );
+      }
+      stats.seconds = seconds_since( start );
+    } );
+  }
+  pool.wait();
+
+  // matches crossing a range border were counted as if the range started fresh
+  for( std::size_t f = 0; f < filenames_.size(); f++ )
+  {
+    if( split[ f ].file )
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      stats_[ f ].matches = stitch_ranges( matcher_, split[ f ].ranges, split[ f ].file->end() );
+      total.fetch_add( stats_[ f ].matches, std::memory_order_relaxed );
+      split[ f ].file.reset();
+      stats_[ f ].seconds += seconds_since( start );
+      for( std::size_t r = 0; r < split[ f ].seconds.size(); r++ )
+      {
+        stats_[ f ].seconds += split[ f ].seconds[ r ];
+      }
+    }
+  }
+  return total.load();
+}
+
+
+// throughput of counter_ over corpus_ in MB/s, best of a few runs
+template< typename Counter >
+double measure_throughput( const std::string& corpus_, Counter counter_, std::size_t& count_ )
+{
+  typedef std::chrono::steady_clock clock;
+  double best = 0;
+  for( int run = 0; run < 3; run++ )
+  {
+    clock::time_point start = clock::now();
+    count_ = counter_( corpus_.data(), corpus_.data() + corpus_.size() );
+    double seconds = std::chrono::duration< double >( clock::now() - start ).count();
+    best = std::max( best, corpus_.size() / ( 1024.0 * 1024.0 ) / seconds );
+  }
+  return best;
+}
+
+
+// compares the literal kernels, the multi pattern matcher and the grep
+// process on a corpus of about megabytes_ MB made by repeating filenames_
+void benchmark( const std::vector< std::string >& patterns_, const std::vector< std::string >& filenames_,
+		std::size_t megabytes_ )
+{
+  std::string corpus;
+  for( std::size_t f = 0; f < filenames_.size(); f++ )
+  {
+    mapped_file file;
+    if( !file.open( filenames_[ f ] ) )
+    {
+      std::cerr << "Error: could not open file " << filenames_[ f ] << std::endl;
+      return;
+    }
+    corpus.append( file.begin(), file.end() );
+  }
+  if( corpus.empty() )
+  {
+    std::cerr << "Error: the files are empty" << std::endl;
+    return;
+  }
+  std::string input_files = corpus;
+  while( corpus.size() < megabytes_ * 1024 * 1024 )
+  {
+    corpus += input_files;
+  }
+  std::cout << "corpus: " << corpus.size() / ( 1024.0 * 1024.0 ) << " MB, literal kernel in use: "
+	    << literal_kernel_name() << std::endl;
+
+  std::size_t count = 0;
+  const std::string& pattern = patterns_[ 0 ];
+  if( patterns_.size() == 1 && is_literal_pattern( pattern ) )
+  {
+    double mb_s = measure_throughput( corpus, [ &pattern ]( const char* b_, const char* e_ )
+				      { return count_literal_scalar( b_, e_, pattern ); }, count );
+    std::cout << "scalar:       " << mb_s << " MB/s (" << count << " matches)" << std::endl;
+    if( has_sse42() )
+    {
+      mb_s = measure_throughput( corpus, [ &pattern ]( const char* b_, const char* e_ )
+				 { return count_literal_sse42( b_, e_, pattern ); }, count );
+      std::cout << "sse4.2:       " << mb_s << " MB/s (" << count << " matches)" << std::endl;
+    }
+    if( has_avx2() )
+    {
+      mb_s = measure_throughput( corpus, [ &pattern ]( const char* b_, const char* e_ )
+				 { return count_literal_avx2( b_, e_, pattern ); }, count );
+      std::cout << "avx2:         " << mb_s << " MB/s (" << count << " matches)" << std::endl;
+    }
+  }
+  bool all_literal = true;
+  for( std::size_t i = 0; i < patterns_.size(); i++ )
+  {
+    all_literal = all_literal && is_literal_pattern( patterns_[ i ] );
+  }
+  if( all_literal )
+  {
+    aho_corasick automaton( patterns_ );
+    double mb_s = measure_throughput( corpus, [ &automaton ]( const char* b_, const char* e_ )
+				      { return automaton.count( b_, e_ ); }, count );
+    std::cout << "aho-corasick: " << mb_s << " MB/s (" << count << " matches)" << std::endl;
+  }
+
+  // the grep process needs the corpus in a file
+  char corpus_file[] = "/tmp/ppgrep_bench_XXXXXX";
+  int fd = mkstemp( corpus_file );
+  if( fd < 0 || write( fd, corpus.data(), corpus.size() ) != static_cast< ssize_t >( corpus.size() ) )
+  {
+    std::cerr << "Error: could not write the corpus to " << corpus_file << std::endl;
+    if( fd >= 0 )
+    {
+      close( fd );
+      remove( corpus_file );
+    }
+    return;
+  }
+  close( fd );
+  std::string joined = patterns_[ 0 ];
+  for( std::size_t i = 1; i < patterns_.size(); i++ )
+  {
+    joined += "\n" + patterns_[ i ];
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int grep_count = count_with_grep( joined, std::vector< std::string >( 1, corpus_file ) );
+  double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+  std::cout << "grep process: " << corpus.size() / ( 1024.0 * 1024.0 ) / seconds << " MB/s ("
+	    << grep_count << " matches)" << std::endl;
+  remove( corpus_file );
+}
+
+
+// entry point of the application
+
+int main( int argc, char* argv[] )
+{
+  // options come first, "--" ends them
+  unsigned n_threads = std::max( 1u, std::thread::hardware_concurrency() );
+  bool use_grep = false;
+  std::size_t bench_megabytes = 0;
+  std::size_t chunk_size = 4 * 1024 * 1024;
+  std::string build_index;
+  std::string index_file;
+  bool emit_matches = false;
+  std::string stats_format;
+  bool positions = false;
+  std::vector< std::string > patterns;
+  int first_arg = 1;
+  for( ; first_arg < argc && ( std::strncmp( argv[ first_arg ], "--", 2 ) == 0
+			      || std::strcmp( argv[ first_arg ], "-e" ) == 0
+			      || std::strcmp( argv[ first_arg ], "-o" ) == 0 ); first_arg++ )
+  {
+    std::string option( argv[ first_arg ] );
+    if( option == "--" )
+    {
+      first_arg++;
+      break;
+    }
+    else if( option == "-e" && first_arg + 1 < argc )
+    {
+      patterns.push_back( argv[ ++first_arg ] );
+    }
+    else if( option.compare( 0, 10, "--threads=" ) == 0 && std::atoi( option.c_str() + 10 ) > 0 )
+    {
+      n_threads = std::atoi( option.c_str() + 10 );
+    }
+    else if( option.compare( 0, 8, "--bench=" ) == 0 && std::atoi( option.c_str() + 8 ) > 0 )
+    {
+      bench_megabytes = std::atoi( option.c_str() + 8 );
+    }
+    else if( option.compare( 0, 8, "--chunk=" ) == 0 && std::atoi( option.c_str() + 8 ) > 0 )
+    {
+      chunk_size = std::size_t( std::atoi( option.c_str() + 8 ) ) * 1024;
+    }
+    else if( option.compare( 0, 14, "--build-index=" ) == 0 && option.size() > 14 )
+    {
+      build_index = option.substr( 14 );
+    }
+    else if( option.compare( 0, 8, "--index=" ) == 0 && option.size() > 8 )
+    {
+      index_file = option.substr( 8 );
+    }
+    else if( option == "--stats=json" || option == "--stats=csv" )
+    {
+      stats_format = option.substr( 8 );
+    }
+    else if( option == "--positions" )
+    {
+      positions = true;
+    }
+    else if( option == "-o" )
+    {
+      emit_matches = true;
+    }
+    else if( option == "--grep" )
+    {
+      use_grep = true;
+    }
+    else
+    {
+      std::cerr << "Error: unknown option " << option << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // all parameters are files to index
+  if( !build_index.empty() )
+  {
+    std::vector< std::string > filenames( argv + first_arg, argv + argc );
+    if( filenames.empty() )
+    {
+      std::cerr << "Error: parameters are missing" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    trigram_index index;
+    index.load( build_index );
+    std::size_t indexed = index.update( filenames, n_threads );
+    if( !index.save( build_index ) )
+    {
+      std::cerr << "Error: could not write index " << build_index << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::cout << "indexed " << indexed << " of " << filenames.size() << " files, " << build_index
+	      << " holds " << index.files() << " files in " << index.blocks() << " blocks" << std::endl;
+    return 0;
+  }
+
+  // without -e the first parameter is the pattern
+  if( patterns.empty() && first_arg < argc )
+  {
+    patterns.push_back( argv[ first_arg++ ] );
+  }
+
+  // check parameters
+  if (patterns.empty() || (first_arg == argc && bench_megabytes > 0)) {
+  	std::cerr << "Error: parameters are missing" << std::endl;
+  	exit(EXIT_FAILURE);
+  }
+
+  if( emit_matches && !stats_format.empty() )
+  {
+    std::cerr << "Error: -o and --stats can't be combined" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // without files stdin is read
+  std::vector< std::string > filenames( argv + first_arg, argv + argc );
+  if( filenames.empty() )
+  {
+    filenames.push_back( "-" );
+  }
+
+  if( bench_megabytes > 0 )
+  {
+    benchmark( patterns, filenames, bench_megabytes );
+    return 0;
+  }
+
+  bool all_literal = true;
+  for( std::size_t i = 0; i < patterns.size(); i++ )
+  {
+    all_literal = all_literal && is_literal_pattern( patterns[ i ] );
+  }
+
+  // a single pattern uses the SIMD kernels, several are matched in one pass,
+  // regular expressions are compiled once for all files
+  std::unique_ptr< matcher > patterns_matcher;
+  if( !use_grep && !all_literal )
+  {
+    patterns_matcher.reset( regex_matcher::compile( patterns ) );
+  }
+  else if( !use_grep && patterns.size() == 1 )
+  {
+    patterns_matcher.reset( new literal_matcher( patterns[ 0 ] ) );
+  }
+  else if( !use_grep )
+  {
+    patterns_matcher.reset( new aho_corasick( patterns ) );
+  }
+
+  // everything the regex engine can't do goes through grep, which reads one pattern per line
+  if( !patterns_matcher )
+  {
+    if( emit_matches || !stats_format.empty() )
+    {
+      std::cerr << "Error: -o and --stats do not work with this pattern" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string joined = patterns[ 0 ];
+    for( std::size_t i = 1; i < patterns.size(); i++ )
+    {
+      joined += "\n" + patterns[ i ];
+    }
+    std::cout << count_with_grep( joined, filenames ) << std::endl;
+    return 0;
+  }
+
+  // stdin, pipes and compressed files are read as a stream, one after the
+  // other. With -o every file is, so the matches come out in order
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector< std::string > mapped_files;
+  std::vector< std::size_t > mapped_ids;
+  for( std::size_t f = 0; f < filenames.size(); f++ )
+  {
+    if( !emit_matches && !is_stream_input( filenames[ f ] ) )
+    {
+      mapped_files.push_back( filenames[ f ] );
+      mapped_ids.push_back( f );
+    }
+  }
+
+  // the index is brought up to date first, changed files are indexed again
+  std::vector< scan_plan > plans;
+  if( !index_file.empty() && !mapped_files.empty() )
+  {
+    trigram_index index;
+    index.load( index_file );
+    if( index.update( mapped_files, n_threads ) > 0 && !index.save( index_file ) )
+    {
+      std::cerr << "Error: could not write index " << index_file << std::endl;
+    }
+    std::vector< std::string > literals;
+    patterns_matcher->required_literals( literals );
+    plans = index.plan( mapped_files, literals );
+  }
+
+  // stats in the order of the parameters
+  std::vector< file_stats > stats( filenames.size() );
+  std::size_t result = 0;
+  if( !mapped_files.empty() )
+  {
+    std::vector< file_stats > mapped_stats;
+    result += count_in_process( *patterns_matcher, mapped_files, n_threads, chunk_size,
+				plans.empty() ? NULL : &plans, positions, mapped_stats );
+    for( std::size_t i = 0; i < mapped_ids.size(); i++ )
+    {
+      std::swap( stats[ mapped_ids[ i ] ], mapped_stats[ i ] );
+    }
+  }
+  for( std::size_t f = 0, m = 0; f < filenames.size(); f++ )
+  {
+    if( m < mapped_ids.size() && mapped_ids[ m ] == f )
+    {
+      m++;
+      continue;
+    }
+    std::chrono::steady_clock::time_point file_start = std::chrono::steady_clock::now();
+    stats[ f ].file = filenames[ f ];
+    stats[ f ].matches = 0;
+    stats[ f ].bytes_scanned = 0;
+    input_stream input;
+    if( !input.open( filenames[ f ] ) )
+    {
+      std::cerr << "Error: could not open file " << filenames[ f ] << std::endl;
+      stats[ f ].seconds = 0;
+      continue;
+    }
+    bool read_ok;
+    bool line_too_long = false;
+    stats[ f ].matches = count_stream( *patterns_matcher, input.fd(), emit_matches ? stdout : NULL, read_ok,
+				       &stats[ f ].bytes_scanned, &line_too_long );
+    result += stats[ f ].matches;
+    if( line_too_long )
+    {
+      std::cerr << "Error: " << filenames[ f ] << " has lines longer than "
+		<< max_stream_line_length / ( 1024 * 1024 ) << " MB, their matches are not counted" << std::endl;
+    }
+    if( !input.close() || ( !read_ok && !line_too_long ) )
+    {
+      std::cerr << "Error: could not read file " << filenames[ f ] << std::endl;
+    }
+    stats[ f ].seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - file_start ).count();
+  }
+
+  // the stats replace the count, with -o the matches are the output
+  if( stats_format == "json" )
+  {
+    write_json( std::cout, stats, result,
+		std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count(), positions );
+  }
+  else if( stats_format == "csv" )
+  {
+    write_csv( std::cout, stats, result, positions );
+  }
+  else if( !emit_matches )
+  {
+    std::cout << result << std::endl;
+  }
+
   return 0;
 }
@@ -0,0 +1,80 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+mapped_file::mapped_file()
+  : _addr( NULL ),
+    _size( 0 )
+{}
+
+
+mapped_file::~mapped_file()
+{
+  close();
+}
+
+
+bool mapped_file::open( const std::string& filename_ )
+{
+  close();
+  int fd = ::open( filename_.c_str(), O_RDONLY );
+  if( fd < 0 )
+  {
+    return false;
+  }
+  struct stat st;
+  if( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+  {
+    ::close( fd );
+    return false;
+  }
+  _size = st.st_size;
+  // mmap refuses empty mappings, an empty file is just an empty range
+  if( _size > 0 )
+  {
+    _addr = mmap( NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( _addr == MAP_FAILED )
+    {
+      _addr = NULL;
+      _size = 0;
+      ::close( fd );
+      return false;
+    }
+    madvise( _addr, _size, MADV_SEQUENTIAL );
+  }
+  ::close( fd );
+  return true;
+}
+
+
+void mapped_file::close()
+{
+  if( _addr != NULL )
+  {
+    munmap( _addr, _size );
+  }
+  _addr = NULL;
+  _size = 0;
+}
+
+
+const char* mapped_file::begin() const
+{
+  return static_cast< const char* >( _addr );
+}
+
+
+const char* mapped_file::end() const
+{
+  return begin() + _size;
+}
+
+
+std::size_t mapped_file::size() const
+{
+  return _size;
+}
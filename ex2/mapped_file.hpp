@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <string>
+
+
+// read only memory mapping of a whole file, unmapped when the object dies
+class mapped_file
+{
+  public:
+    mapped_file();
+    ~mapped_file();
+
+    bool open( const std::string& filename_ );
+    void close();
+
+    const char* begin() const;
+    const char* end() const;
+    std::size_t size() const;
+
+  private:
+    mapped_file( const mapped_file& );
+    mapped_file& operator=( const mapped_file& );
+
+    void* _addr;
+    std::size_t _size;
+};
+
+
+#endif
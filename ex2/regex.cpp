@@ -0,0 +1,1246 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+
+
+namespace
+{
+
+// syntax tree of a pattern, groups are not kept since nothing is captured
+struct regex_ast
+{
+  enum kind { set, concat, alternation, repeat, bol, eol };
+
+  explicit regex_ast( kind type_ = concat )
+    : type( type_ ),
+      min( 0 ),
+      max( 0 )
+  {}
+
+  kind type;
+  std::bitset< 256 > bytes;
+  std::vector< regex_ast > children;
+  int min;
+  // -1 if unlimited
+  int max;
+};
+
+
+// largest count of an interval, beyond that the nfa gets too big
+const int max_repeat = 255;
+// no pattern may compile into more nfa nodes than this
+const std::size_t max_nfa_nodes = 100000;
+// the dfa cache is never flushed, a run which needs more states goes on without it
+const std::size_t max_dfa_states = 4096;
+const int unknown_state = -1;
+const int cache_full = -2;
+// failed runs may read this much of a line before it is worth marking the starts
+const std::size_t min_marked_read = 64;
+
+
+bool add_class( const std::string& name_, std::bitset< 256 >& bytes_ )
+{
+  int ( *test )( int ) = NULL;
+  if( name_ == "alpha" ) test = isalpha;
+  else if( name_ == "upper" ) test = isupper;
+  else if( name_ == "lower" ) test = islower;
+  else if( name_ == "digit" ) test = isdigit;
+  else if( name_ == "xdigit" ) test = isxdigit;
+  else if( name_ == "alnum" ) test = isalnum;
+  else if( name_ == "punct" ) test = ispunct;
+  else if( name_ == "space" ) test = isspace;
+  else if( name_ == "blank" ) test = isblank;
+  else if( name_ == "cntrl" ) test = iscntrl;
+  else if( name_ == "print" ) test = isprint;
+  else if( name_ == "graph" ) test = isgraph;
+  else return false;
+  // the program never sets a locale, so this is the C locale
+  for( int c = 0; c < 256; c++ )
+  {
+    if( test( c ) )
+    {
+      bytes_.set( c );
+    }
+  }
+  return true;
+}
+
+
+// recursive descent parser for one line of a pattern
+class bre_parser
+{
+  public:
+    explicit bre_parser( const std::string& pattern_ )
+      : _p( pattern_ ),
+	_pos( 0 )
+    {}
+
+    // false if the pattern is invalid or not regular
+    bool parse( regex_ast& ast_ )
+    {
+      return parse_alternation( ast_ ) && _pos == _p.size();
+    }
+
+  private:
+    bool at( const char* s_ ) const
+    {
+      return _p.compare( _pos, std::strlen( s_ ), s_ ) == 0;
+    }
+
+    bool parse_alternation( regex_ast& ast_ )
+    {
+      ast_ = regex_ast( regex_ast::alternation );
+      while( true )
+      {
+	ast_.children.push_back( regex_ast( regex_ast::concat ) );
+	if( !parse_concat( ast_.children.back() ) )
+	{
+	  return false;
+	}
+	if( !at( "\\|" ) )
+	{
+	  return true;
+	}
+	_pos += 2;
+      }
+    }
+
+    bool parse_concat( regex_ast& ast_ )
+    {
+      // ^ is an anchor only at the start, * is literal at the start and behind it
+      if( at( "^" ) )
+      {
+	ast_.children.push_back( regex_ast( regex_ast::bol ) );
+	_pos++;
+      }
+      bool start = true;
+      while( _pos < _p.size() && !at( "\\|" ) && !at( "\\)" ) )
+      {
+	regex_ast atom( regex_ast::set );
+	if( start && at( "*" ) )
+	{
+	  atom.bytes.set( '*' );
+	  _pos++;
+	}
+	else if( at( "$" ) && ( _pos + 1 == _p.size() || _p.compare( _pos + 1, 2, "\\|" ) == 0
+				|| _p.compare( _pos + 1, 2, "\\)" ) == 0 ) )
+	{
+	  // $ is an anchor only at the end
+	  atom = regex_ast( regex_ast::eol );
+	  _pos++;
+	}
+	else if( !parse_atom( atom ) )
+	{
+	  return false;
+	}
+	start = false;
+	if( !parse_postfix( atom ) )
+	{
+	  return false;
+	}
+	ast_.children.push_back( atom );
+      }
+      return true;
+    }
+
+    bool parse_atom( regex_ast& atom_ )
+    {
+      char c = _p[ _pos ];
+      if( c == '.' )
+      {
+	atom_.bytes.set();
+	atom_.bytes.reset( '\n' );
+	_pos++;
+	return true;
+      }
+      if( c == '[' )
+      {
+	return parse_bracket( atom_ );
+      }
+      if( c != '\\' )
+      {
+	atom_.bytes.set( static_cast< unsigned char >( c ) );
+	_pos++;
+	return true;
+      }
+      if( _pos + 1 == _p.size() )
+      {
+	return false;
+      }
+      char escaped = _p[ _pos + 1 ];
+      _pos += 2;
+      if( escaped == '(' )
+      {
+	if( !parse_alternation( atom_ ) || !at( "\\)" ) )
+	{
+	  return false;
+	}
+	_pos += 2;
+	return true;
+      }
+      // back references and word boundaries are not regular, and a repetition
+      // without anything to repeat is left to grep as well
+      if( std::strchr( "123456789<>bB`'{}+?", escaped ) != NULL )
+      {
+	return false;
+      }
+      if( escaped == 'w' || escaped == 'W' )
+      {
+	add_class( "alnum", atom_.bytes );
+	atom_.bytes.set( '_' );
+      }
+      else if( escaped == 's' || escaped == 'S' )
+      {
+	add_class( "space", atom_.bytes );
+      }
+      else
+      {
+	atom_.bytes.set( static_cast< unsigned char >( escaped ) );
+	return true;
+      }
+      if( escaped == 'W' || escaped == 'S' )
+      {
+	atom_.bytes.flip();
+      }
+      atom_.bytes.reset( '\n' );
+      return true;
+    }
+
+    // one character inside a bracket expression, [.c.] and [=c=] stand for c
+    bool parse_bracket_char( int& c_ )
+    {
+      if( at( "[." ) || at( "[=" ) )
+      {
+	char delimiter = _p[ _pos + 1 ];
+	if( _pos + 4 >= _p.size() || _p[ _pos + 3 ] != delimiter || _p[ _pos + 4 ] != ']' )
+	{
+	  return false;
+	}
+	c_ = static_cast< unsigned char >( _p[ _pos + 2 ] );
+	_pos += 5;
+	return true;
+      }
+      c_ = static_cast< unsigned char >( _p[ _pos ] );
+      _pos++;
+      return true;
+    }
+
+    bool parse_bracket( regex_ast& atom_ )
+    {
+      std::size_t open = _pos;
+      _pos++;
+      bool negate = at( "^" );
+      if( negate )
+      {
+	_pos++;
+      }
+      bool first = true;
+      while( true )
+      {
+	if( _pos >= _p.size() )
+	{
+	  return false;
+	}
+	if( at( "]" ) && !first )
+	{
+	  _pos++;
+	  break;
+	}
+	first = false;
+	if( at( "[:" ) )
+	{
+	  std::size_t close = _p.find( ":]", _pos + 2 );
+	  if( close == std::string::npos || !add_class( _p.substr( _pos + 2, close - _pos - 2 ), atom_.bytes ) )
+	  {
+	    return false;
+	  }
+	  _pos = close + 2;
+	  continue;
+	}
+	int low;
+	if( !parse_bracket_char( low ) )
+	{
+	  return false;
+	}
+	if( _pos + 1 < _p.size() && _p[ _pos ] == '-' && _p[ _pos + 1 ] != ']' )
+	{
+	  _pos++;
+	  int high;
+	  if( !parse_bracket_char( high ) || high < low )
+	  {
+	    return false;
+	  }
+	  for( int c = low; c <= high; c++ )
+	  {
+	    atom_.bytes.set( c );
+	  }
+	}
+	else
+	{
+	  atom_.bytes.set( low );
+	}
+      }
+      // grep rejects [:space:] written without the outer brackets
+      if( _pos - open > 3 && _p[ open + 1 ] == ':' && _p[ _pos - 2 ] == ':' )
+      {
+	return false;
+      }
+      if( negate )
+      {
+	atom_.bytes.flip();
+      }
+      atom_.bytes.reset( '\n' );
+      return true;
+    }
+
+    bool parse_number( int& n_ )
+    {
+      if( _pos == _p.size() || !isdigit( static_cast< unsigned char >( _p[ _pos ] ) ) )
+      {
+	return false;
+      }
+      n_ = 0;
+      while( _pos < _p.size() && isdigit( static_cast< unsigned char >( _p[ _pos ] ) ) )
+      {
+	n_ = std::min( n_ * 10 + ( _p[ _pos ] - '0' ), max_repeat + 1 );
+	_pos++;
+      }
+      return true;
+    }
+
+    bool parse_postfix( regex_ast& atom_ )
+    {
+      while( _pos < _p.size() )
+      {
+	int min;
+	int max;
+	if( at( "*" ) )
+	{
+	  min = 0;
+	  max = -1;
+	  _pos++;
+	}
+	else if( at( "\\+" ) || at( "\\?" ) )
+	{
+	  min = at( "\\+" ) ? 1 : 0;
+	  max = at( "\\+" ) ? -1 : 1;
+	  _pos += 2;
+	}
+	else if( at( "\\{" ) )
+	{
+	  // \{m\}, \{m,\}, \{m,n\} and \{,n\}
+	  _pos += 2;
+	  bool has_min = parse_number( min );
+	  if( !has_min )
+	  {
+	    min = 0;
+	  }
+	  if( at( "," ) )
+	  {
+	    _pos++;
+	    if( !parse_number( max ) )
+	    {
+	      max = -1;
+	    }
+	  }
+	  else if( has_min )
+	  {
+	    max = min;
+	  }
+	  else
+	  {
+	    return false;
+	  }
+	  if( !at( "\\}" ) || min > max_repeat || max > max_repeat || ( max >= 0 && max < min ) )
+	  {
+	    return false;
+	  }
+	  _pos += 2;
+	}
+	else
+	{
+	  return true;
+	}
+	regex_ast repeated( regex_ast::repeat );
+	repeated.children.push_back( atom_ );
+	repeated.min = min;
+	repeated.max = max;
+	atom_ = repeated;
+      }
+      return true;
+    }
+
+    const std::string& _p;
+    std::size_t _pos;
+};
+
+
+// bytes every match of ast_ starts with. exact_ tells if every match of ast_
+// is exactly that string, only then the prefix may continue behind it
+std::string literal_prefix( const regex_ast& ast_, bool& exact_ )
+{
+  exact_ = false;
+  switch( ast_.type )
+  {
+    case regex_ast::set:
+      if( ast_.bytes.count() != 1 )
+      {
+	return std::string();
+      }
+      exact_ = true;
+      for( int c = 0; c < 256; c++ )
+      {
+	if( ast_.bytes[ c ] )
+	{
+	  return std::string( 1, static_cast< char >( c ) );
+	}
+      }
+      return std::string();
+    case regex_ast::bol:
+      exact_ = true;
+      return std::string();
+    case regex_ast::concat:
+    {
+      std::string prefix;
+      for( std::size_t i = 0; i < ast_.children.size(); i++ )
+      {
+	bool exact;
+	prefix += literal_prefix( ast_.children[ i ], exact );
+	if( !exact )
+	{
+	  return prefix;
+	}
+      }
+      exact_ = true;
+      return prefix;
+    }
+    case regex_ast::alternation:
+    {
+      if( ast_.children.empty() )
+      {
+	return std::string();
+      }
+      bool all_exact;
+      std::string prefix = literal_prefix( ast_.children[ 0 ], all_exact );
+      for( std::size_t i = 1; i < ast_.children.size(); i++ )
+      {
+	bool exact;
+	std::string other = literal_prefix( ast_.children[ i ], exact );
+	all_exact = all_exact && exact && other == prefix;
+	std::size_t common = 0;
+	while( common < prefix.size() && common < other.size() && prefix[ common ] == other[ common ] )
+	{
+	  common++;
+	}
+	prefix.resize( common );
+      }
+      exact_ = all_exact;
+      return prefix;
+    }
+    case regex_ast::repeat:
+    {
+      if( ast_.min == 0 )
+      {
+	return std::string();
+      }
+      bool exact;
+      std::string prefix = literal_prefix( ast_.children[ 0 ], exact );
+      exact_ = exact && ast_.min == 1 && ast_.max == 1;
+      return prefix;
+    }
+    default:
+      return std::string();
+  }
+}
+
+
+
+// adds a string every match of ast_ contains, one per alternative. False if
+// there is an alternative without such a string
+bool required_literals( const regex_ast& ast_, std::vector< std::string >& literals_ )
+{
+  if( ast_.type == regex_ast::alternation )
+  {
+    for( std::size_t i = 0; i < ast_.children.size(); i++ )
+    {
+      if( !required_literals( ast_.children[ i ], literals_ ) )
+      {
+	return false;
+      }
+    }
+    return !ast_.children.empty();
+  }
+  if( ast_.type == regex_ast::repeat && ast_.min > 0 )
+  {
+    return required_literals( ast_.children[ 0 ], literals_ );
+  }
+  if( ast_.type == regex_ast::concat && ast_.children.size() == 1 )
+  {
+    return required_literals( ast_.children[ 0 ], literals_ );
+  }
+  if( ast_.type == regex_ast::set )
+  {
+    bool exact;
+    std::string byte = literal_prefix( ast_, exact );
+    if( byte.empty() )
+    {
+      return false;
+    }
+    literals_.push_back( byte );
+    return true;
+  }
+  if( ast_.type != regex_ast::concat )
+  {
+    return false;
+  }
+  // the longest run of single bytes in a row
+  std::string longest;
+  std::string run;
+  for( std::size_t i = 0; i < ast_.children.size(); i++ )
+  {
+    const regex_ast& child = ast_.children[ i ];
+    bool exact;
+    std::string byte = child.type == regex_ast::set ? literal_prefix( child, exact ) : std::string();
+    if( byte.empty() )
+    {
+      run.clear();
+    }
+    run += byte;
+    if( run.size() > longest.size() )
+    {
+      longest = run;
+    }
+  }
+  if( longest.empty() )
+  {
+    return false;
+  }
+  literals_.push_back( longest );
+  return true;
+}
+
+}
+
+
+regex_matcher::regex_matcher()
+  : _nfa_start( 0 ),
+    _n_states( 0 ),
+    _start_bol( 0 ),
+    _start( 0 ),
+    _start_reverse( 0 ),
+    _only_bol( false )
+{}
+
+
+regex_matcher::~regex_matcher()
+{
+  for( std::size_t i = 0; i < _n_states; i++ )
+  {
+    delete _states[ i ];
+  }
+}
+
+
+// builds the nfa of a syntax tree back to front, so every part knows where it continues
+class nfa_builder
+{
+  public:
+    explicit nfa_builder( std::vector< regex_matcher::nfa_node >& nfa_ )
+      : _nfa( nfa_ )
+    {}
+
+    // appends the nodes of ast_ followed by next_, returns the first of them.
+    // -1 if there are too many nodes
+    int build( const regex_ast& ast_, int next_ )
+    {
+      if( next_ < 0 || _nfa.size() > max_nfa_nodes )
+      {
+	return -1;
+      }
+      switch( ast_.type )
+      {
+	case regex_ast::set:
+	{
+	  int node = add( regex_matcher::node_set, next_ );
+	  _nfa[ node ].set = ast_.bytes;
+	  return node;
+	}
+	case regex_ast::bol:
+	  return add( regex_matcher::node_bol, next_ );
+	case regex_ast::eol:
+	  return add( regex_matcher::node_eol, next_ );
+	case regex_ast::concat:
+	  for( std::size_t i = ast_.children.size(); i > 0; i-- )
+	  {
+	    next_ = build( ast_.children[ i - 1 ], next_ );
+	  }
+	  return next_;
+	case regex_ast::alternation:
+	{
+	  int start = build( ast_.children.back(), next_ );
+	  for( std::size_t i = ast_.children.size() - 1; i > 0; i-- )
+	  {
+	    int alternative = build( ast_.children[ i - 1 ], next_ );
+	    start = add( regex_matcher::node_split, alternative, start );
+	  }
+	  return start;
+	}
+	case regex_ast::repeat:
+	{
+	  const regex_ast& child = ast_.children[ 0 ];
+	  int start = next_;
+	  if( ast_.max < 0 )
+	  {
+	    // the loop either runs the child once more or leaves
+	    int loop = add( regex_matcher::node_split, -1, next_ );
+	    int body = build( child, loop );
+	    _nfa[ loop ].out1 = body;
+	    start = body < 0 ? -1 : loop;
+	  }
+	  else
+	  {
+	    // optional copies, each one may end the repetition
+	    for( int i = ast_.min; i < ast_.max; i++ )
+	    {
+	      int copy = build( child, start );
+	      start = add( regex_matcher::node_split, copy, next_ );
+	    }
+	  }
+	  for( int i = 0; i < ast_.min; i++ )
+	  {
+	    start = build( child, start );
+	  }
+	  return start;
+	}
+      }
+      return -1;
+    }
+
+    // appends the nfa of the reversed patterns, which reads a line backwards
+    // from its end and starts another match in front of every byte. Its node 0
+    // is reached where a non-empty match of the nfa starting at start_ starts.
+    // every node is there twice, before and after the first byte of a match is
+    // read. ^ becomes $ and the other way round. returns the start node
+    int reverse( int start_ )
+    {
+      int n = _nfa.size();
+      // the nodes which continue with a node
+      std::vector< std::vector< int > > before( n );
+      for( int u = 0; u < n; u++ )
+      {
+	if( _nfa[ u ].type != regex_matcher::node_match )
+	{
+	  before[ _nfa[ u ].out1 ].push_back( u );
+	}
+	if( _nfa[ u ].type == regex_matcher::node_split )
+	{
+	  before[ _nfa[ u ].out2 ].push_back( u );
+	}
+      }
+      std::vector< int > reversed[ 2 ];
+      for( int copy = 0; copy < 2; copy++ )
+      {
+	for( int v = 0; v < n; v++ )
+	{
+	  reversed[ copy ].push_back( add( regex_matcher::node_split, -1, -1 ) );
+	}
+      }
+      // reading the byte of a set node leads into the second copy
+      std::vector< int > read( n, -1 );
+      for( int u = 0; u < n; u++ )
+      {
+	if( _nfa[ u ].type == regex_matcher::node_set )
+	{
+	  read[ u ] = add( regex_matcher::node_set, reversed[ 1 ][ u ] );
+	  _nfa[ read[ u ] ].set = _nfa[ u ].set;
+	}
+      }
+      for( int copy = 0; copy < 2; copy++ )
+      {
+	for( int v = 0; v < n; v++ )
+	{
+	  std::vector< int > targets;
+	  for( std::size_t i = 0; i < before[ v ].size(); i++ )
+	  {
+	    int u = before[ v ][ i ];
+	    switch( _nfa[ u ].type )
+	    {
+	      case regex_matcher::node_set:
+		targets.push_back( read[ u ] );
+		break;
+	      case regex_matcher::node_bol:
+		targets.push_back( add( regex_matcher::node_eol, reversed[ copy ][ u ] ) );
+		break;
+	      case regex_matcher::node_eol:
+		targets.push_back( add( regex_matcher::node_bol, reversed[ copy ][ u ] ) );
+		break;
+	      default:
+		targets.push_back( reversed[ copy ][ u ] );
+	    }
+	  }
+	  if( copy == 1 && v == start_ )
+	  {
+	    targets.push_back( 0 );
+	  }
+	  branch( reversed[ copy ][ v ], targets );
+	}
+      }
+      // reads any byte and starts another match in front of it
+      int loop = add( regex_matcher::node_split, reversed[ 0 ][ 0 ], -1 );
+      int any = add( regex_matcher::node_set, loop );
+      _nfa[ any ].set.set();
+      _nfa[ loop ].out2 = any;
+      return loop;
+    }
+
+  private:
+    // turns the split node node_ into one which continues with all of targets_,
+    // or into one which never continues if there are none
+    void branch( int node_, const std::vector< int >& targets_ )
+    {
+      if( targets_.empty() )
+      {
+	_nfa[ node_ ].type = regex_matcher::node_set;
+	_nfa[ node_ ].out1 = 0;
+	return;
+      }
+      for( std::size_t i = 0; i + 2 < targets_.size(); i++ )
+      {
+	_nfa[ node_ ].out1 = targets_[ i ];
+	int rest = add( regex_matcher::node_split, -1, -1 );
+	_nfa[ node_ ].out2 = rest;
+	node_ = rest;
+      }
+      _nfa[ node_ ].out1 = targets_[ targets_.size() < 2 ? 0 : targets_.size() - 2 ];
+      _nfa[ node_ ].out2 = targets_.back();
+    }
+
+    int add( regex_matcher::node_type type_, int out1_, int out2_ = -1 )
+    {
+      regex_matcher::nfa_node node;
+      node.type = type_;
+      node.out1 = out1_;
+      node.out2 = out2_;
+      _nfa.push_back( node );
+      return _nfa.size() - 1;
+    }
+
+    std::vector< regex_matcher::nfa_node >& _nfa;
+};
+
+
+regex_matcher* regex_matcher::compile( const std::vector< std::string >& patterns_ )
+{
+  // like grep, every line of a pattern is a pattern on its own
+  regex_ast all( regex_ast::alternation );
+  for( std::size_t i = 0; i < patterns_.size(); i++ )
+  {
+    std::size_t line_start = 0;
+    while( true )
+    {
+      std::size_t line_end = std::min( patterns_[ i ].find( '\n', line_start ), patterns_[ i ].size() );
+      all.children.push_back( regex_ast() );
+      if( !bre_parser( patterns_[ i ].substr( line_start, line_end - line_start ) ).parse( all.children.back() ) )
+      {
+	return NULL;
+      }
+      if( line_end == patterns_[ i ].size() )
+      {
+	break;
+      }
+      line_start = line_end + 1;
+    }
+  }
+
+  std::unique_ptr< regex_matcher > compiled( new regex_matcher );
+  nfa_node match;
+  match.type = node_match;
+  match.out1 = -1;
+  match.out2 = -1;
+  compiled->_nfa.push_back( match );
+  nfa_builder builder( compiled->_nfa );
+  compiled->_nfa_start = builder.build( all, 0 );
+  if( compiled->_nfa_start < 0 )
+  {
+    return NULL;
+  }
+  int reverse_start = builder.reverse( compiled->_nfa_start );
+  bool exact;
+  compiled->_prefix = literal_prefix( all, exact );
+  if( !::required_literals( all, compiled->_literals ) )
+  {
+    compiled->_literals.clear();
+  }
+
+  // the dead state first, then both start states
+  compiled->_states.resize( max_dfa_states, NULL );
+  std::vector< int > nodes;
+  compiled->find_state( nodes );
+  nodes.assign( 1, compiled->_nfa_start );
+  compiled->closure( nodes, true, false );
+  compiled->_start_bol = compiled->find_state( nodes );
+  nodes.assign( 1, compiled->_nfa_start );
+  compiled->closure( nodes, false, false );
+  compiled->_start = compiled->find_state( nodes );
+  nodes.assign( 1, reverse_start );
+  compiled->closure( nodes, true, false );
+  compiled->_start_reverse = compiled->find_state( nodes );
+
+  // a non-empty match starts with a byte one of the start nodes consumes
+  compiled->_only_bol = true;
+  for( int c = 0; c < 256; c++ )
+  {
+    compiled->_first_bol[ c ] = false;
+    compiled->_first[ c ] = false;
+    const std::vector< int >& bol_nodes = compiled->_states[ compiled->_start_bol ]->nodes;
+    for( std::size_t i = 0; i < bol_nodes.size(); i++ )
+    {
+      const nfa_node& node = compiled->_nfa[ bol_nodes[ i ] ];
+      compiled->_first_bol[ c ] = compiled->_first_bol[ c ] || ( node.type == node_set && node.set[ c ] );
+    }
+    const std::vector< int >& other_nodes = compiled->_states[ compiled->_start ]->nodes;
+    for( std::size_t i = 0; i < other_nodes.size(); i++ )
+    {
+      const nfa_node& node = compiled->_nfa[ other_nodes[ i ] ];
+      compiled->_first[ c ] = compiled->_first[ c ] || ( node.type == node_set && node.set[ c ] );
+    }
+    compiled->_only_bol = compiled->_only_bol && !compiled->_first[ c ];
+  }
+  return compiled.release();
+}
+
+
+// replaces nodes_ with all nodes reachable from them without consuming a byte,
+// keeping only the ones which consume a byte or end a match. ^ can only be
+// passed at the start of a line, $ only at its end (where the reverse nfa
+// starts and stops reading)
+void regex_matcher::closure( std::vector< int >& nodes_, bool bol_, bool eol_ ) const
+{
+  std::vector< bool > seen( _nfa.size(), false );
+  std::vector< int > stack( nodes_ );
+  nodes_.clear();
+  while( !stack.empty() )
+  {
+    int n = stack.back();
+    stack.pop_back();
+    if( seen[ n ] )
+    {
+      continue;
+    }
+    seen[ n ] = true;
+    const nfa_node& node = _nfa[ n ];
+    switch( node.type )
+    {
+      case node_split:
+	stack.push_back( node.out2 );
+	stack.push_back( node.out1 );
+	break;
+      case node_bol:
+	if( bol_ )
+	{
+	  stack.push_back( node.out1 );
+	}
+	break;
+      case node_eol:
+	if( eol_ )
+	{
+	  stack.push_back( node.out1 );
+	}
+	else
+	{
+	  nodes_.push_back( n );
+	}
+	break;
+      default:
+	nodes_.push_back( n );
+    }
+  }
+  std::sort( nodes_.begin(), nodes_.end() );
+}
+
+
+bool regex_matcher::accepts_at_eol( const std::vector< int >& nodes_ ) const
+{
+  std::vector< int > behind;
+  for( std::size_t i = 0; i < nodes_.size(); i++ )
+  {
+    if( _nfa[ nodes_[ i ] ].type == node_eol )
+    {
+      behind.push_back( _nfa[ nodes_[ i ] ].out1 );
+    }
+  }
+  closure( behind, false, true );
+  // the match node is node 0, so it comes first
+  return !behind.empty() && behind[ 0 ] == 0;
+}
+
+
+// id of the dfa state for the closed set nodes_, creates it if it is new.
+// cache_full if there is no room for another state. Caller holds _mutex
+// (or nobody else knows the matcher yet)
+int regex_matcher::find_state( std::vector< int >& nodes_ ) const
+{
+  std::map< std::vector< int >, int >::const_iterator known = _state_ids.find( nodes_ );
+  if( known != _state_ids.end() )
+  {
+    return known->second;
+  }
+  if( _n_states == max_dfa_states )
+  {
+    return cache_full;
+  }
+  dfa_state* state = new dfa_state;
+  for( int c = 0; c < 256; c++ )
+  {
+    state->next[ c ].store( nodes_.empty() ? 0 : unknown_state, std::memory_order_relaxed );
+  }
+  state->nodes = nodes_;
+  state->accept = !nodes_.empty() && nodes_[ 0 ] == 0;
+  state->accept_eol = state->accept || accepts_at_eol( nodes_ );
+  int id = _n_states;
+  _states[ id ] = state;
+  _n_states++;
+  _state_ids[ nodes_ ] = id;
+  return id;
+}
+
+
+// computes a transition nobody needed before. Other threads only see the new
+// state once the transition is stored, and then it is complete
+int regex_matcher::transition( int state_, unsigned char c_ ) const
+{
+  std::lock_guard< std::mutex > lock( _mutex );
+  int next = _states[ state_ ]->next[ c_ ].load( std::memory_order_relaxed );
+  if( next != unknown_state )
+  {
+    return next;
+  }
+  const std::vector< int >& nodes = _states[ state_ ]->nodes;
+  std::vector< int > targets;
+  for( std::size_t i = 0; i < nodes.size(); i++ )
+  {
+    if( _nfa[ nodes[ i ] ].type == node_set && _nfa[ nodes[ i ] ].set[ c_ ] )
+    {
+      targets.push_back( _nfa[ nodes[ i ] ].out1 );
+    }
+  }
+  closure( targets, false, false );
+  next = find_state( targets );
+  if( next != cache_full )
+  {
+    _states[ state_ ]->next[ c_ ].store( next, std::memory_order_release );
+  }
+  return next;
+}
+
+
+// end of the longest non-empty match starting at begin_, NULL if there is none.
+// stop_ receives the position the dfa stopped reading at
+const char* regex_matcher::longest_match( const char* begin_, const char* line_end_, bool bol_,
+					  const char*& stop_ ) const
+{
+  int state = bol_ ? _start_bol : _start;
+  const char* last = NULL;
+  const char* p = begin_;
+  for( ; p < line_end_; p++ )
+  {
+    unsigned char c = *p;
+    int next = _states[ state ]->next[ c ].load( std::memory_order_acquire );
+    if( next == unknown_state )
+    {
+      next = transition( state, c );
+      if( next == cache_full )
+      {
+	return longest_match_uncached( _states[ state ]->nodes, begin_, p, line_end_, last, stop_ );
+      }
+    }
+    if( next == 0 )
+    {
+      stop_ = p;
+      return last;
+    }
+    state = next;
+    if( _states[ state ]->accept )
+    {
+      last = p + 1;
+    }
+  }
+  stop_ = p;
+  if( p > begin_ && _states[ state ]->accept_eol )
+  {
+    last = p;
+  }
+  return last;
+}
+
+
+// continues longest_match at p_ with the nfa nodes of its current state when
+// the dfa cache is full
+const char* regex_matcher::longest_match_uncached( const std::vector< int >& nodes_, const char* begin_,
+						   const char* p_, const char* line_end_, const char* last_,
+						   const char*& stop_ ) const
+{
+  std::vector< int > nodes( nodes_ );
+  std::vector< int > targets;
+  const char* p = p_;
+  for( ; p < line_end_; p++ )
+  {
+    targets.clear();
+    for( std::size_t i = 0; i < nodes.size(); i++ )
+    {
+      if( _nfa[ nodes[ i ] ].type == node_set && _nfa[ nodes[ i ] ].set[ static_cast< unsigned char >( *p ) ] )
+      {
+	targets.push_back( _nfa[ nodes[ i ] ].out1 );
+      }
+    }
+    closure( targets, false, false );
+    if( targets.empty() )
+    {
+      stop_ = p;
+      return last_;
+    }
+    nodes.swap( targets );
+    if( nodes[ 0 ] == 0 )
+    {
+      last_ = p + 1;
+    }
+  }
+  stop_ = p;
+  if( p > begin_ && ( ( !nodes.empty() && nodes[ 0 ] == 0 ) || accepts_at_eol( nodes ) ) )
+  {
+    last_ = p;
+  }
+  return last_;
+}
+
+
+// first position from p_ on where a non-empty match could start, NULL if
+// there is none before limit_
+const char* regex_matcher::next_candidate( const char* p_, const char* begin_, const char* limit_,
+					   const char* end_ ) const
+{
+  if( _prefix.size() == 1 )
+  {
+    return static_cast< const char* >( std::memchr( p_, _prefix[ 0 ], limit_ - p_ ) );
+  }
+  if( !_prefix.empty() )
+  {
+    // the prefix has to start before limit_ but may end behind it
+    std::size_t length = std::min< std::size_t >( end_ - p_, limit_ - p_ + _prefix.size() - 1 );
+    return static_cast< const char* >( memmem( p_, length, _prefix.data(), _prefix.size() ) );
+  }
+  if( _only_bol )
+  {
+    // only line starts can match
+    while( p_ < limit_ )
+    {
+      if( ( p_ == begin_ || p_[ -1 ] == '\n' ) && _first_bol[ static_cast< unsigned char >( *p_ ) ] )
+      {
+	return p_;
+      }
+      p_ = static_cast< const char* >( std::memchr( p_, '\n', limit_ - p_ ) );
+      if( p_ == NULL )
+      {
+	return NULL;
+      }
+      p_++;
+    }
+    return NULL;
+  }
+  for( ; p_ < limit_; p_++ )
+  {
+    unsigned char c = *p_;
+    if( _first[ c ] || ( _first_bol[ c ] && ( p_ == begin_ || p_[ -1 ] == '\n' ) ) )
+    {
+      return p_;
+    }
+  }
+  return NULL;
+}
+
+
+// finds the matches of a buffer one after the other. A candidate whose run
+// fails is tried again one byte further on, which takes quadratic time where
+// runs read far before they fail (a*b on a long line of a). So once the failed
+// runs of a line have read more than is left of it (and more than a few bytes),
+// one pass of the reverse dfa over the rest of the line marks every position
+// a match starts at
+class regex_matcher::scanner
+{
+  public:
+    scanner( const regex_matcher& regex_, const char* begin_, const char* end_ )
+      : _regex( regex_ ),
+	_begin( begin_ ),
+	_end( end_ ),
+	_line_end( NULL ),
+	_read( 0 ),
+	_marked( NULL )
+    {}
+
+    // the next match starting in [p_, limit_), p_ may not go back
+    bool next( const char* p_, const char* limit_, const char*& match_begin_, const char*& match_end_ )
+    {
+      const char* p = p_;
+      while( p < limit_ )
+      {
+	const char* candidate;
+	if( _marked != NULL && p < _line_end )
+	{
+	  candidate = marked_start( p, std::min( limit_, _line_end ) );
+	  if( candidate == NULL )
+	  {
+	    p = _line_end;
+	    continue;
+	  }
+	}
+	else
+	{
+	  candidate = _regex.next_candidate( p, _begin, limit_, _end );
+	  if( candidate == NULL )
+	  {
+	    return false;
+	  }
+	  if( _line_end == NULL || candidate > _line_end )
+	  {
+	    _line_end = static_cast< const char* >( std::memchr( candidate, '\n', _end - candidate ) );
+	    if( _line_end == NULL )
+	    {
+	      _line_end = _end;
+	    }
+	    _read = 0;
+	    _marked = NULL;
+	  }
+	}
+	const char* stop;
+	const char* match_end = _regex.longest_match( candidate, _line_end,
+						      candidate == _begin || candidate[ -1 ] == '\n', stop );
+	if( match_end != NULL )
+	{
+	  match_begin_ = candidate;
+	  match_end_ = match_end;
+	  return true;
+	}
+	p = candidate + 1;
+	_read += stop - candidate + 1;
+	if( _marked == NULL && _read > std::max< std::size_t >( _line_end - p, min_marked_read ) && !mark( p ) )
+	{
+	  // the dfa cache is full, only try again after as many bytes again
+	  _read = 0;
+	}
+      }
+      return false;
+    }
+
+  private:
+    // reads the line backwards from its end to from_ and marks the positions
+    // a non-empty match starts at. False if the dfa cache is full
+    bool mark( const char* from_ )
+    {
+      _starts.assign( _line_end - from_, false );
+      int state = _regex._start_reverse;
+      for( const char* p = _line_end; p > from_; )
+      {
+	p--;
+	unsigned char c = *p;
+	int next = _regex._states[ state ]->next[ c ].load( std::memory_order_acquire );
+	if( next == unknown_state )
+	{
+	  next = _regex.transition( state, c );
+	  if( next == cache_full )
+	  {
+	    return false;
+	  }
+	}
+	state = next;
+	const dfa_state* reached = _regex._states[ state ];
+	_starts[ p - from_ ] = p == _begin || p[ -1 ] == '\n' ? reached->accept_eol : reached->accept;
+      }
+      _marked = from_;
+      return true;
+    }
+
+    // first marked position in [p_, limit_), NULL if there is none
+    const char* marked_start( const char* p_, const char* limit_ ) const
+    {
+      for( std::size_t i = p_ - _marked; i < static_cast< std::size_t >( limit_ - _marked ); i++ )
+      {
+	if( _starts[ i ] )
+	{
+	  return _marked + i;
+	}
+      }
+      return NULL;
+    }
+
+    const regex_matcher& _regex;
+    const char* _begin;
+    const char* _end;
+    // end of the line of the last candidate
+    const char* _line_end;
+    // bytes the failed runs of that line have read
+    std::size_t _read;
+    // if not NULL, _starts[ i ] tells whether a match starts at _marked + i,
+    // up to the end of the line
+    const char* _marked;
+    std::vector< bool > _starts;
+};
+
+
+std::size_t regex_matcher::count_range( const char* begin_, const char* limit_, const char* end_,
+					const char*& resume_ ) const
+{
+  resume_ = limit_;
+  std::size_t count = 0;
+  scanner scan( *this, begin_, end_ );
+  const char* match_begin;
+  const char* match_end;
+  for( const char* p = begin_; scan.next( p, limit_, match_begin, match_end ); p = match_end )
+  {
+    count++;
+  }
+  return count;
+}
+
+
+bool regex_matcher::find( const char* begin_, const char* p_, const char* end_,
+			  const char*& match_begin_, const char*& match_end_ ) const
+{
+  return scanner( *this, begin_, end_ ).next( p_, end_, match_begin_, match_end_ );
+}
+
+
+void regex_matcher::find_all( const char* begin_, const char* p_, const char* end_,
+			      const std::function< bool( const char*, const char* ) >& found_ ) const
+{
+  scanner scan( *this, begin_, end_ );
+  const char* match_begin;
+  const char* match_end;
+  for( const char* p = p_; scan.next( p, end_, match_begin, match_end ); p = match_end )
+  {
+    if( !found_( match_begin, match_end ) )
+    {
+      return;
+    }
+  }
+}
+
+
+std::size_t regex_matcher::max_match_length() const
+{
+  return static_cast< std::size_t >( -1 );
+}
+
+
+bool regex_matcher::line_ranges() const
+{
+  return true;
+}
+
+
+void regex_matcher::required_literals( std::vector< std::string >& literals_ ) const
+{
+  literals_.insert( literals_.end(), _literals.begin(), _literals.end() );
+}
@@ -0,0 +1,107 @@
+#ifndef REGEX_HPP_
+#define REGEX_HPP_
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "search.hpp"
+
+
+// basic regular expressions the way grep reads them (POSIX BRE plus the GNU
+// extensions \| \+ \? \{,n\} \w \W \s \S), matched on bytes like grep does in
+// the C locale. Every match is the leftmost and then longest one of a line,
+// empty matches don't count, just like "grep -o pattern | wc -l".
+// The patterns are compiled into an NFA once. The DFA is built lazily while
+// scanning: every state and transition is computed the first time a thread
+// needs it and then shared by all threads
+class regex_matcher : public matcher
+{
+  public:
+    // NULL if a pattern is invalid or uses something a DFA can't do (back
+    // references, word boundaries), grep has to count those.
+    // several patterns match like one pattern with all of them as alternatives
+    static regex_matcher* compile( const std::vector< std::string >& patterns_ );
+
+    ~regex_matcher();
+
+    // begin_ has to be the start of a line, ranges have to end at line starts
+    std::size_t count_range( const char* begin_, const char* limit_, const char* end_,
+			     const char*& resume_ ) const;
+    bool find( const char* begin_, const char* p_, const char* end_,
+	       const char*& match_begin_, const char*& match_end_ ) const;
+    void find_all( const char* begin_, const char* p_, const char* end_,
+		   const std::function< bool( const char*, const char* ) >& found_ ) const;
+
+    // matches never reach over a newline but have no other limit
+    std::size_t max_match_length() const;
+    bool line_ranges() const;
+    void required_literals( std::vector< std::string >& literals_ ) const;
+
+  private:
+    friend class nfa_builder;
+    class scanner;
+
+    enum node_type { node_set, node_split, node_bol, node_eol, node_match };
+
+    struct nfa_node
+    {
+      node_type type;
+      std::bitset< 256 > set;
+      int out1;
+      int out2;
+    };
+
+    struct dfa_state
+    {
+      std::atomic< int > next[ 256 ];
+      // nfa nodes of the state, only the ones which consume a byte or end a match
+      std::vector< int > nodes;
+      bool accept;
+      // accepts if the line ends right here
+      bool accept_eol;
+    };
+
+    regex_matcher();
+    regex_matcher( const regex_matcher& );
+    regex_matcher& operator=( const regex_matcher& );
+
+    void closure( std::vector< int >& nodes_, bool bol_, bool eol_ ) const;
+    bool accepts_at_eol( const std::vector< int >& nodes_ ) const;
+    int find_state( std::vector< int >& nodes_ ) const;
+    int transition( int state_, unsigned char c_ ) const;
+    const char* longest_match( const char* begin_, const char* line_end_, bool bol_, const char*& stop_ ) const;
+    const char* longest_match_uncached( const std::vector< int >& nodes_, const char* begin_, const char* p_,
+					const char* line_end_, const char* last_, const char*& stop_ ) const;
+    const char* next_candidate( const char* p_, const char* begin_, const char* limit_,
+				const char* end_ ) const;
+
+    std::vector< nfa_node > _nfa;
+    int _nfa_start;
+
+    // state 0 is the dead state, the states never move once created
+    mutable std::vector< dfa_state* > _states;
+    mutable std::size_t _n_states;
+    mutable std::map< std::vector< int >, int > _state_ids;
+    mutable std::mutex _mutex;
+    int _start_bol;
+    int _start;
+    // the reverse dfa at the end of a line, see scanner
+    int _start_reverse;
+
+    // bytes which can start a non-empty match at the start of a line / elsewhere
+    bool _first_bol[ 256 ];
+    bool _first[ 256 ];
+    bool _only_bol;
+    // every match starts with these bytes
+    std::string _prefix;
+    // every match contains one of these
+    std::vector< std::string > _literals;
+};
+
+
+#endif
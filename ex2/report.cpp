@@ -0,0 +1,121 @@
+#include "report.hpp"
+
+#include <cstdio>
+
+
+namespace
+{
+
+std::string json_string( const std::string& text_ )
+{
+  std::string quoted = "\"";
+  for( std::size_t i = 0; i < text_.size(); i++ )
+  {
+    unsigned char c = text_[ i ];
+    if( c == '"' || c == '\\' )
+    {
+      quoted += '\\';
+      quoted += c;
+    }
+    else if( c < 0x20 )
+    {
+      char escaped[ 8 ];
+      std::snprintf( escaped, sizeof( escaped ), "\\u%04x", c );
+      quoted += escaped;
+    }
+    else
+    {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+
+// quoted only where a field needs it
+std::string csv_field( const std::string& text_ )
+{
+  if( text_.find_first_of( ",\"\r\n" ) == std::string::npos )
+  {
+    return text_;
+  }
+  std::string quoted = "\"";
+  for( std::size_t i = 0; i < text_.size(); i++ )
+  {
+    if( text_[ i ] == '"' )
+    {
+      quoted += '"';
+    }
+    quoted += text_[ i ];
+  }
+  return quoted + "\"";
+}
+
+
+void add_up( const std::vector< file_stats >& stats_, std::uint64_t& bytes_, double& seconds_ )
+{
+  bytes_ = 0;
+  seconds_ = 0;
+  for( std::size_t i = 0; i < stats_.size(); i++ )
+  {
+    bytes_ += stats_[ i ].bytes_scanned;
+    seconds_ += stats_[ i ].seconds;
+  }
+}
+
+}
+
+
+void write_json( std::ostream& out_, const std::vector< file_stats >& stats_, std::size_t total_matches_,
+		 double wall_seconds_, bool positions_ )
+{
+  out_ << "{\"files\":[";
+  for( std::size_t i = 0; i < stats_.size(); i++ )
+  {
+    const file_stats& s = stats_[ i ];
+    out_ << ( i > 0 ? ",\n" : "\n" ) << "{\"file\":" << json_string( s.file ) << ",\"matches\":" << s.matches
+	 << ",\"bytes_scanned\":" << s.bytes_scanned << ",\"seconds\":" << s.seconds;
+    if( positions_ )
+    {
+      out_ << ",\"positions\":[";
+      for( std::size_t p = 0; p < s.positions.size(); p++ )
+      {
+	out_ << ( p > 0 ? "," : "" ) << "{\"offset\":" << s.positions[ p ].offset << ",\"line\":"
+	     << s.positions[ p ].line << "}";
+      }
+      out_ << "]";
+    }
+    out_ << "}";
+  }
+  std::uint64_t bytes;
+  double seconds;
+  add_up( stats_, bytes, seconds );
+  out_ << "\n],\n\"total\":{\"matches\":" << total_matches_ << ",\"bytes_scanned\":" << bytes << ",\"seconds\":"
+       << seconds << ",\"wall_seconds\":" << wall_seconds_ << "}}" << std::endl;
+}
+
+
+void write_csv( std::ostream& out_, const std::vector< file_stats >& stats_, std::size_t total_matches_,
+		bool positions_ )
+{
+  out_ << "record,file,matches,bytes_scanned,seconds" << ( positions_ ? ",positions" : "" ) << "\n";
+  for( std::size_t i = 0; i < stats_.size(); i++ )
+  {
+    const file_stats& s = stats_[ i ];
+    out_ << "file," << csv_field( s.file ) << "," << s.matches << "," << s.bytes_scanned << "," << s.seconds;
+    if( positions_ )
+    {
+      out_ << ",";
+      for( std::size_t p = 0; p < s.positions.size(); p++ )
+      {
+	out_ << ( p > 0 ? " " : "" ) << s.positions[ p ].offset << ":" << s.positions[ p ].line;
+      }
+    }
+    out_ << "\n";
+  }
+  std::uint64_t bytes;
+  double seconds;
+  add_up( stats_, bytes, seconds );
+  out_ << "total,," << total_matches_ << "," << bytes << "," << seconds << ( positions_ ? ",\n" : "\n" );
+  out_.flush();
+}
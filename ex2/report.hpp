@@ -0,0 +1,47 @@
+#ifndef REPORT_HPP_
+#define REPORT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// where a match starts: byte offset in the file (from 0) and line number (from 1)
+struct match_position
+{
+  std::uint64_t offset;
+  std::uint64_t line;
+};
+
+
+// what counting one file found and cost
+struct file_stats
+{
+  std::string file;
+  std::size_t matches;
+  // bytes actually scanned, less than the file if an index skipped blocks
+  std::uint64_t bytes_scanned;
+  // time spent on the file by all threads together
+  double seconds;
+  // only filled if the positions were asked for
+  std::vector< match_position > positions;
+};
+
+
+// one object per file and the totals, positions_ adds the match positions:
+// {"files":[{"file":..,"matches":..,"bytes_scanned":..,"seconds":..,"positions":[{"offset":..,"line":..}]}],
+//  "total":{"matches":..,"bytes_scanned":..,"seconds":..,"wall_seconds":..}}
+void write_json( std::ostream& out_, const std::vector< file_stats >& stats_, std::size_t total_matches_,
+		 double wall_seconds_, bool positions_ );
+
+// one row per file and a last row with the totals, told apart by the first
+// column: record,file,matches,bytes_scanned,seconds[,positions] where record
+// is "file" or "total" (whose file is empty). The positions column holds
+// "offset:line" pairs separated by spaces
+void write_csv( std::ostream& out_, const std::vector< file_stats >& stats_, std::size_t total_matches_,
+		bool positions_ );
+
+
+#endif
@@ -0,0 +1,570 @@
+#include "search.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define PPGREP_X86 1
+#endif
+
+
+bool is_literal_pattern( const std::string& pattern_ )
+{
+  return pattern_.find_first_of( ".[*^$\\\n" ) == std::string::npos;
+}
+
+
+// scalar search starting at p_, match_end_ is moved behind every match found
+static std::size_t count_scalar_from( const char* p_, const char* end_, const std::string& pattern_,
+				      const char*& match_end_ )
+{
+  std::size_t m = pattern_.size();
+  const char* first = pattern_.data();
+  std::size_t count = 0;
+  const char* p = p_;
+  // memchr jumps to the next candidate for the first byte, memcmp checks the rest
+  while( static_cast< std::size_t >( end_ - p ) >= m )
+  {
+    const char* hit = static_cast< const char* >( std::memchr( p, first[ 0 ], end_ - p - m + 1 ) );
+    if( hit == NULL )
+    {
+      break;
+    }
+    if( std::memcmp( hit + 1, first + 1, m - 1 ) == 0 )
+    {
+      count++;
+      p = hit + m;
+      match_end_ = p;
+    }
+    else
+    {
+      p = hit + 1;
+    }
+  }
+  return count;
+}
+
+
+std::size_t count_literal_scalar( const char* begin_, const char* end_, const std::string& pattern_,
+				  const char** match_end_ )
+{
+  const char* match_end = begin_;
+  std::size_t count = pattern_.empty() ? 0 : count_scalar_from( begin_, end_, pattern_, match_end );
+  if( match_end_ != NULL )
+  {
+    *match_end_ = match_end;
+  }
+  return count;
+}
+
+
+#ifdef PPGREP_X86
+
+// clears the bits of candidates starting before allowed_ (block starts at p_)
+static inline unsigned drop_before( unsigned mask_, const char* p_, const char* allowed_ )
+{
+  if( allowed_ <= p_ )
+  {
+    return mask_;
+  }
+  std::size_t skip = allowed_ - p_;
+  return skip >= 32 ? 0 : mask_ & ~( ( 1u << skip ) - 1 );
+}
+
+
+// checks the candidates of one block in ascending order and counts the
+// non-overlapping matches. allowed_ is the first position a match may start at
+static inline void verify_block( unsigned mask_, const char* p_, const std::string& pattern_,
+				 std::size_t& count_, const char*& allowed_ )
+{
+  std::size_t m = pattern_.size();
+  const char* pattern = pattern_.data();
+  mask_ = drop_before( mask_, p_, allowed_ );
+  while( mask_ != 0 )
+  {
+    const char* candidate = p_ + __builtin_ctz( mask_ );
+    // first and last byte are known to match already
+    if( m <= 2 || std::memcmp( candidate + 1, pattern + 1, m - 2 ) == 0 )
+    {
+      count_++;
+      allowed_ = candidate + m;
+      mask_ = drop_before( mask_, p_, allowed_ );
+    }
+    else
+    {
+      mask_ &= mask_ - 1;
+    }
+  }
+}
+
+
+__attribute__(( target( "sse4.2" ) ))
+std::size_t count_literal_sse42( const char* begin_, const char* end_, const std::string& pattern_,
+				 const char** match_end_ )
+{
+  std::size_t m = pattern_.size();
+  if( m == 0 )
+  {
+    return count_literal_scalar( begin_, end_, pattern_, match_end_ );
+  }
+  const __m128i first = _mm_set1_epi8( pattern_[ 0 ] );
+  const __m128i last = _mm_set1_epi8( pattern_[ m - 1 ] );
+  std::size_t count = 0;
+  const char* p = begin_;
+  const char* allowed = begin_;
+  // every block checks the 16 start positions p..p+15
+  while( static_cast< std::size_t >( end_ - p ) >= m - 1 + 16 )
+  {
+    __m128i block_first = _mm_loadu_si128( reinterpret_cast< const __m128i* >( p ) );
+    __m128i block_last = _mm_loadu_si128( reinterpret_cast< const __m128i* >( p + m - 1 ) );
+    unsigned mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( first, block_first ),
+						      _mm_cmpeq_epi8( last, block_last ) ) );
+    if( mask != 0 )
+    {
+      verify_block( mask, p, pattern_, count, allowed );
+    }
+    p = std::max( p + 16, allowed );
+  }
+  count += count_scalar_from( std::max( p, allowed ), end_, pattern_, allowed );
+  if( match_end_ != NULL )
+  {
+    *match_end_ = allowed;
+  }
+  return count;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+std::size_t count_literal_avx2( const char* begin_, const char* end_, const std::string& pattern_,
+				 const char** match_end_ )
+{
+  std::size_t m = pattern_.size();
+  if( m == 0 )
+  {
+    return count_literal_scalar( begin_, end_, pattern_, match_end_ );
+  }
+  const __m256i first = _mm256_set1_epi8( pattern_[ 0 ] );
+  const __m256i last = _mm256_set1_epi8( pattern_[ m - 1 ] );
+  std::size_t count = 0;
+  const char* p = begin_;
+  const char* allowed = begin_;
+  // every block checks the 32 start positions p..p+31
+  while( static_cast< std::size_t >( end_ - p ) >= m - 1 + 32 )
+  {
+    __m256i block_first = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( p ) );
+    __m256i block_last = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( p + m - 1 ) );
+    unsigned mask = _mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( first, block_first ),
+							    _mm256_cmpeq_epi8( last, block_last ) ) );
+    if( mask != 0 )
+    {
+      verify_block( mask, p, pattern_, count, allowed );
+    }
+    p = std::max( p + 32, allowed );
+  }
+  count += count_scalar_from( std::max( p, allowed ), end_, pattern_, allowed );
+  if( match_end_ != NULL )
+  {
+    *match_end_ = allowed;
+  }
+  return count;
+}
+
+
+bool has_sse42()
+{
+  return __builtin_cpu_supports( "sse4.2" );
+}
+
+
+bool has_avx2()
+{
+  return __builtin_cpu_supports( "avx2" );
+}
+
+#else
+
+std::size_t count_literal_sse42( const char* begin_, const char* end_, const std::string& pattern_,
+				 const char** match_end_ )
+{
+  return count_literal_scalar( begin_, end_, pattern_, match_end_ );
+}
+
+
+std::size_t count_literal_avx2( const char* begin_, const char* end_, const std::string& pattern_,
+				 const char** match_end_ )
+{
+  return count_literal_scalar( begin_, end_, pattern_, match_end_ );
+}
+
+
+bool has_sse42()
+{
+  return false;
+}
+
+
+bool has_avx2()
+{
+  return false;
+}
+
+#endif
+
+
+typedef std::size_t ( *literal_kernel )( const char*, const char*, const std::string&, const char** );
+
+
+// picks the kernel once, on the first call
+static literal_kernel select_kernel()
+{
+  static const literal_kernel kernel = has_avx2() ? count_literal_avx2
+				     : has_sse42() ? count_literal_sse42 : count_literal_scalar;
+  return kernel;
+}
+
+
+std::size_t count_literal( const char* begin_, const char* end_, const std::string& pattern_,
+			   const char** match_end_ )
+{
+  return select_kernel()( begin_, end_, pattern_, match_end_ );
+}
+
+
+const char* literal_kernel_name()
+{
+  literal_kernel kernel = select_kernel();
+  return kernel == count_literal_avx2 ? "avx2" : kernel == count_literal_sse42 ? "sse4.2" : "scalar";
+}
+
+
+// count of the range r_ if its scan starts at start_ instead of r_.begin. The
+// first part of the range is counted both ways on a growing window; once both
+// scans resume at the same position they stay in step, so the rest of the
+// range keeps the count it had
+static std::size_t rescan_range( const matcher& matcher_, const range_count& r_, const char* start_,
+				 const char* end_, const char*& resume_ )
+{
+  if( start_ >= r_.limit )
+  {
+    resume_ = start_;
+    return 0;
+  }
+  std::size_t window = std::max< std::size_t >( 4096, 4 * matcher_.max_match_length() );
+  while( true )
+  {
+    const char* window_end = static_cast< std::size_t >( r_.limit - start_ ) > window ? start_ + window : r_.limit;
+    const char* actual_resume;
+    std::size_t actual = matcher_.count_range( start_, window_end, end_, actual_resume );
+    const char* assumed_resume;
+    std::size_t assumed = matcher_.count_range( r_.begin, window_end, end_, assumed_resume );
+    if( actual_resume == assumed_resume )
+    {
+      resume_ = r_.resume;
+      return r_.count - assumed + actual;
+    }
+    if( window_end == r_.limit )
+    {
+      resume_ = actual_resume;
+      return actual;
+    }
+    window *= 4;
+  }
+}
+
+
+std::size_t stitch_ranges( const matcher& matcher_, const std::vector< range_count >& ranges_,
+			   const char* end_ )
+{
+  std::size_t total = 0;
+  const char* resume = ranges_.empty() ? end_ : ranges_[ 0 ].begin;
+  for( std::size_t i = 0; i < ranges_.size(); i++ )
+  {
+    const range_count& r = ranges_[ i ];
+    if( resume <= r.begin )
+    {
+      total += r.count;
+      resume = r.resume;
+    }
+    else
+    {
+      total += rescan_range( matcher_, r, resume, end_, resume );
+    }
+  }
+  return total;
+}
+
+
+literal_matcher::literal_matcher( const std::string& pattern_ )
+  : _pattern( pattern_ )
+{}
+
+
+std::size_t matcher::count( const char* begin_, const char* end_ ) const
+{
+  const char* resume;
+  return count_range( begin_, end_, end_, resume );
+}
+
+
+void matcher::find_all( const char* begin_, const char* p_, const char* end_,
+			const std::function< bool( const char*, const char* ) >& found_ ) const
+{
+  const char* match_begin;
+  const char* match_end;
+  for( const char* p = p_; find( begin_, p, end_, match_begin, match_end ); p = match_end )
+  {
+    if( !found_( match_begin, match_end ) )
+    {
+      return;
+    }
+  }
+}
+
+
+std::size_t literal_matcher::count_range( const char* begin_, const char* limit_, const char* end_,
+					  const char*& resume_ ) const
+{
+  // a match starting before limit_ ends at most pattern length - 1 bytes behind it
+  const char* scan_end = end_;
+  if( !_pattern.empty() && static_cast< std::size_t >( end_ - limit_ ) > _pattern.size() - 1 )
+  {
+    scan_end = limit_ + _pattern.size() - 1;
+  }
+  const char* match_end;
+  std::size_t count = count_literal( begin_, scan_end, _pattern, &match_end );
+  resume_ = std::max( limit_, match_end );
+  return count;
+}
+
+
+bool literal_matcher::find( const char* begin_, const char* p_, const char* end_,
+			    const char*& match_begin_, const char*& match_end_ ) const
+{
+  ( void ) begin_;
+  if( _pattern.empty() )
+  {
+    return false;
+  }
+  match_begin_ = static_cast< const char* >( memmem( p_, end_ - p_, _pattern.data(), _pattern.size() ) );
+  if( match_begin_ == NULL )
+  {
+    return false;
+  }
+  match_end_ = match_begin_ + _pattern.size();
+  return true;
+}
+
+
+std::size_t literal_matcher::max_match_length() const
+{
+  return _pattern.size();
+}
+
+
+void literal_matcher::required_literals( std::vector< std::string >& literals_ ) const
+{
+  if( !_pattern.empty() )
+  {
+    literals_.push_back( _pattern );
+  }
+}
+
+
+aho_corasick::aho_corasick( const std::vector< std::string >& patterns_ )
+  : _max_length( 0 ),
+    _patterns( patterns_ )
+{
+  // build the trie, state 0 is the root
+  std::vector< unsigned > trie( 256, 0 );
+  std::vector< bool > has_child( 256, false );
+  _longest.push_back( 0 );
+  for( std::size_t i = 0; i < patterns_.size(); i++ )
+  {
+    const std::string& pattern = patterns_[ i ];
+    if( pattern.empty() )
+    {
+      continue;
+    }
+    _max_length = std::max( _max_length, pattern.size() );
+    unsigned state = 0;
+    for( std::size_t j = 0; j < pattern.size(); j++ )
+    {
+      unsigned char c = pattern[ j ];
+      if( !has_child[ state * 256 + c ] )
+      {
+	unsigned created = _longest.size();
+	_longest.push_back( 0 );
+	trie.resize( trie.size() + 256, 0 );
+	has_child.resize( has_child.size() + 256, false );
+	trie[ state * 256 + c ] = created;
+	has_child[ state * 256 + c ] = true;
+      }
+      state = trie[ state * 256 + c ];
+    }
+    _longest[ state ] = pattern.size();
+  }
+
+  // breadth first: suffix links and the complete transition table
+  std::size_t n_states = _longest.size();
+  std::vector< unsigned > suffix( n_states, 0 );
+  _output_link.assign( n_states, 0 );
+  _next.assign( n_states * 256, 0 );
+  std::deque< unsigned > queue;
+  for( unsigned c = 0; c < 256; c++ )
+  {
+    if( has_child[ c ] )
+    {
+      _next[ c ] = trie[ c ];
+      queue.push_back( trie[ c ] );
+    }
+  }
+  while( !queue.empty() )
+  {
+    unsigned state = queue.front();
+    queue.pop_front();
+    // closest proper suffix which is a complete pattern
+    unsigned link = suffix[ state ];
+    _output_link[ state ] = _longest[ link ] > 0 ? link : _output_link[ link ];
+    for( unsigned c = 0; c < 256; c++ )
+    {
+      if( has_child[ state * 256 + c ] )
+      {
+	unsigned child = trie[ state * 256 + c ];
+	suffix[ child ] = _next[ link * 256 + c ];
+	_next[ state * 256 + c ] = child;
+	queue.push_back( child );
+      }
+      else
+      {
+	_next[ state * 256 + c ] = _next[ link * 256 + c ];
+      }
+    }
+  }
+}
+
+
+std::size_t aho_corasick::count_range( const char* begin_, const char* limit_, const char* end_,
+				       const char*& resume_ ) const
+{
+  resume_ = limit_;
+  if( _max_length == 0 )
+  {
+    return 0;
+  }
+  // longest match starting at each of the last _max_length positions, kept in
+  // a ring of power of two size. A position is final once no further match can
+  // start there, then it is counted if it is not covered by the previous match
+  std::size_t window = _max_length;
+  std::size_t ring = 1;
+  while( ring < window )
+  {
+    ring *= 2;
+  }
+  std::vector< unsigned > longest_at( ring, 0 );
+  std::size_t limit = limit_ - begin_;
+  // matches starting before limit_ end at most window - 1 bytes behind it
+  std::size_t n = std::min< std::size_t >( end_ - begin_, limit + window - 1 );
+  std::size_t count = 0;
+  std::size_t allowed = 0;
+  std::size_t next_final = 0;
+  // positions up to this one may hold a match which is not final yet
+  std::size_t pending_end = 0;
+  unsigned state = 0;
+  for( std::size_t i = 0; i < n; i++ )
+  {
+    state = _next[ state * 256 + static_cast< unsigned char >( begin_[ i ] ) ];
+    unsigned s = _longest[ state ] > 0 ? state : _output_link[ state ];
+    if( s == 0 && next_final >= pending_end )
+    {
+      // nothing to finalize, so skip the ring
+      continue;
+    }
+    for( ; s != 0; s = _output_link[ s ] )
+    {
+      std::size_t start = i + 1 - _longest[ s ];
+      if( start < limit )
+      {
+	unsigned& slot = longest_at[ start & ( ring - 1 ) ];
+	slot = std::max( slot, _longest[ s ] );
+	pending_end = std::max( pending_end, start + 1 );
+      }
+    }
+    // the positions skipped above are all empty. Every match starting at
+    // i + 1 - window has ended by now
+    if( next_final + window <= i )
+    {
+      next_final = i + 1 - window;
+    }
+    for( ; next_final + window <= i + 1; next_final++ )
+    {
+      unsigned& slot = longest_at[ next_final & ( ring - 1 ) ];
+      if( slot > 0 && next_final >= allowed )
+      {
+	count++;
+	allowed = next_final + slot;
+      }
+      slot = 0;
+    }
+  }
+  for( ; next_final < pending_end; next_final++ )
+  {
+    unsigned& slot = longest_at[ next_final & ( ring - 1 ) ];
+    if( slot > 0 && next_final >= allowed )
+    {
+      count++;
+      allowed = next_final + slot;
+    }
+    slot = 0;
+  }
+  resume_ = std::max( limit_, begin_ + allowed );
+  return count;
+}
+
+
+bool aho_corasick::find( const char* begin_, const char* p_, const char* end_,
+			 const char*& match_begin_, const char*& match_end_ ) const
+{
+  ( void ) begin_;
+  match_begin_ = NULL;
+  unsigned state = 0;
+  for( const char* p = p_; p < end_; p++ )
+  {
+    // no match starting at match_begin_ or before it can end behind here
+    if( match_begin_ != NULL && p >= match_begin_ + _max_length )
+    {
+      break;
+    }
+    state = _next[ state * 256 + static_cast< unsigned char >( *p ) ];
+    for( unsigned s = _longest[ state ] > 0 ? state : _output_link[ state ]; s != 0; s = _output_link[ s ] )
+    {
+      const char* start = p + 1 - _longest[ s ];
+      if( match_begin_ == NULL || start < match_begin_ || ( start == match_begin_ && p + 1 > match_end_ ) )
+      {
+	match_begin_ = start;
+	match_end_ = p + 1;
+      }
+    }
+  }
+  return match_begin_ != NULL;
+}
+
+
+std::size_t aho_corasick::max_match_length() const
+{
+  return _max_length;
+}
+
+
+void aho_corasick::required_literals( std::vector< std::string >& literals_ ) const
+{
+  // an empty pattern never counts, so it needs no literal
+  for( std::size_t i = 0; i < _patterns.size(); i++ )
+  {
+    if( !_patterns[ i ].empty() )
+    {
+      literals_.push_back( _patterns[ i ] );
+    }
+  }
+}
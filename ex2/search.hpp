@@ -0,0 +1,141 @@
+#ifndef SEARCH_HPP_
+#define SEARCH_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// true if pattern_ matches only itself as a basic regular expression (the way
+// grep reads it), i.e. it contains none of . [ * ^ $ and no backslash
+bool is_literal_pattern( const std::string& pattern_ );
+
+// counts the non-overlapping occurrences of pattern_ in [begin_, end_) the
+// way "grep -o pattern | wc -l" does: scanning from left to right, every
+// match continues the search behind its end. An empty pattern never counts.
+// uses the fastest kernel the cpu supports (AVX2, SSE4.2 or scalar). If
+// match_end_ is given it receives the end of the last match (begin_ if none)
+std::size_t count_literal( const char* begin_, const char* end_, const std::string& pattern_,
+			   const char** match_end_ = NULL );
+
+// the kernels behind count_literal. They look for the first and the last byte
+// of the pattern in 32 (AVX2) or 16 (SSE) positions at once and only compare
+// the rest of the pattern where both match. Only call the SIMD ones if the
+// corresponding has_* function returns true
+std::size_t count_literal_scalar( const char* begin_, const char* end_, const std::string& pattern_,
+                                       const char** match_end_ = NULL );
+std::size_t count_literal_sse42( const char* begin_, const char* end_, const std::string& pattern_,
+                                      const char** match_end_ = NULL );
+std::size_t count_literal_avx2( const char* begin_, const char* end_, const std::string& pattern_,
+                                     const char** match_end_ = NULL );
+bool has_sse42();
+bool has_avx2();
+
+// name of the kernel count_literal uses on this cpu
+const char* literal_kernel_name();
+
+
+// something that counts matches of one or more patterns in a buffer
+class matcher
+{
+  public:
+    virtual ~matcher() {}
+
+    // number of matches in [begin_, end_) as "grep -o | wc -l" counts them
+    std::size_t count( const char* begin_, const char* end_ ) const;
+
+    // counts the matches starting in [begin_, limit_) of a scan which starts at
+    // begin_ and may read up to end_. resume_ receives the position the scan of
+    // the following range has to start at: behind the last match if that
+    // reaches past limit_, limit_ otherwise
+    virtual std::size_t count_range( const char* begin_, const char* limit_, const char* end_,
+				     const char*& resume_ ) const = 0;
+
+    // the first match at or behind p_ which a scan starting at begin_ finds
+    // there, false if there is none before end_. begin_ has to be a line start
+    virtual bool find( const char* begin_, const char* p_, const char* end_,
+		       const char*& match_begin_, const char*& match_end_ ) const = 0;
+
+    // calls found_ with every match find() returns one after the other from
+    // p_ on, until found_ returns false. A matcher may carry what it learned
+    // about the text from one match to the next instead of calling find()
+    virtual void find_all( const char* begin_, const char* p_, const char* end_,
+			   const std::function< bool( const char*, const char* ) >& found_ ) const;
+
+    // longest possible match, ranges have to overlap by one byte less
+    virtual std::size_t max_match_length() const = 0;
+
+    // true if ranges have to be split at line starts instead, then a match
+    // never continues into the next range and nothing has to be stitched
+    virtual bool line_ranges() const { return false; }
+
+    // adds strings of which every match contains at least one, nothing if
+    // there are none (an index uses them to skip text)
+    virtual void required_literals( std::vector< std::string >& literals_ ) const { ( void ) literals_; }
+};
+
+
+// one range of a file, counted on its own as if no match of the previous
+// range reached into it
+struct range_count
+{
+  const char* begin;
+  const char* limit;
+  std::size_t count;
+  const char* resume;
+};
+
+
+// adds up the counts of consecutive ranges of one buffer ending at end_. Where
+// a match of a range reaches into the next one, that range is rescanned from
+// behind the match until both scans are in the same state again, which
+// usually happens after a few bytes
+std::size_t stitch_ranges( const matcher& matcher_, const std::vector< range_count >& ranges_,
+			   const char* end_ );
+
+
+class literal_matcher : public matcher
+{
+  public:
+    explicit literal_matcher( const std::string& pattern_ );
+
+    std::size_t count_range( const char* begin_, const char* limit_, const char* end_,
+			     const char*& resume_ ) const;
+    bool find( const char* begin_, const char* p_, const char* end_,
+	       const char*& match_begin_, const char*& match_end_ ) const;
+    std::size_t max_match_length() const;
+    void required_literals( std::vector< std::string >& literals_ ) const;
+
+  private:
+    std::string _pattern;
+};
+
+
+// finds many literal patterns in a single pass. Like grep, every match is the
+// leftmost one and of those the longest, and the search continues behind it
+class aho_corasick : public matcher
+{
+  public:
+    explicit aho_corasick( const std::vector< std::string >& patterns_ );
+
+    std::size_t count_range( const char* begin_, const char* limit_, const char* end_,
+			     const char*& resume_ ) const;
+    bool find( const char* begin_, const char* p_, const char* end_,
+	       const char*& match_begin_, const char*& match_end_ ) const;
+    std::size_t max_match_length() const;
+    void required_literals( std::vector< std::string >& literals_ ) const;
+
+  private:
+    // full transition table, _next[ state * 256 + byte ]
+    std::vector< unsigned > _next;
+    // length of the longest pattern ending in a state (0 if none)
+    std::vector< unsigned > _longest;
+    // next state on the suffix link chain which ends a pattern
+    std::vector< unsigned > _output_link;
+    std::size_t _max_length;
+    std::vector< std::string > _patterns;
+};
+
+
+#endif
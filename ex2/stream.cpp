@@ -0,0 +1,411 @@
+#include "stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+// file extensions which are read through a decompressor
+struct decompressor
+{
+  const char* extension;
+  const char* program;
+};
+
+const decompressor decompressors[] = {
+  { ".gz", "gzip" },
+  { ".bz2", "bzip2" },
+  { ".xz", "xz" },
+  { ".zst", "zstd" }
+};
+
+
+const decompressor* find_decompressor( const std::string& name_ )
+{
+  for( std::size_t i = 0; i < sizeof( decompressors ) / sizeof( decompressors[ 0 ] ); i++ )
+  {
+    std::size_t length = std::strlen( decompressors[ i ].extension );
+    if( name_.size() > length && name_.compare( name_.size() - length, length, decompressors[ i ].extension ) == 0 )
+    {
+      return &decompressors[ i ];
+    }
+  }
+  return NULL;
+}
+
+
+// writes the matches to a FILE in large pieces
+class match_writer
+{
+  public:
+    explicit match_writer( std::FILE* out_ )
+      : _out( out_ )
+    {}
+
+    ~match_writer()
+    {
+      flush();
+    }
+
+    void write( const char* begin_, const char* end_ )
+    {
+      _buffer.append( begin_, end_ );
+      _buffer.push_back( '\n' );
+      if( _buffer.size() >= 1024 * 1024 )
+      {
+	flush();
+      }
+    }
+
+    void flush()
+    {
+      std::fwrite( _buffer.data(), 1, _buffer.size(), _out );
+      _buffer.clear();
+    }
+
+  private:
+    std::FILE* _out;
+    std::string _buffer;
+};
+
+
+// matches in [begin_, end_), which starts at the start of a line and ends
+// behind a newline or at the end of the input
+std::size_t scan_lines( const matcher& matcher_, const char* begin_, const char* end_, match_writer* writer_ )
+{
+  if( writer_ == NULL )
+  {
+    return matcher_.count( begin_, end_ );
+  }
+  std::size_t count = 0;
+  matcher_.find_all( begin_, begin_, end_, [ writer_, &count ]( const char* match_begin_, const char* match_end_ )
+  {
+    writer_->write( match_begin_, match_end_ );
+    count++;
+    return true;
+  } );
+  return count;
+}
+
+
+// scans the front of a line which got longer than a buffer, so it does not
+// have to be kept. Only for matchers with a limited match length, the part
+// of line_ which a match may still continue into stays
+std::size_t scan_line_front( const matcher& matcher_, std::string& line_, match_writer* writer_ )
+{
+  std::size_t keep = matcher_.max_match_length() > 0 ? matcher_.max_match_length() - 1 : 0;
+  if( line_.size() <= keep )
+  {
+    return 0;
+  }
+  const char* begin = line_.data();
+  const char* limit = begin + line_.size() - keep;
+  const char* end = begin + line_.size();
+  std::size_t count = 0;
+  const char* resume = limit;
+  if( writer_ == NULL )
+  {
+    count = matcher_.count_range( begin, limit, end, resume );
+  }
+  else
+  {
+    matcher_.find_all( begin, begin, end, [ writer_, limit, &count, &resume ]( const char* match_begin_,
+									  const char* match_end_ )
+    {
+      if( match_begin_ >= limit )
+      {
+	resume = match_begin_;
+	return false;
+      }
+      writer_->write( match_begin_, match_end_ );
+      count++;
+      resume = std::max( limit, match_end_ );
+      return true;
+    } );
+  }
+  line_.erase( 0, resume - begin );
+  return count;
+}
+
+}
+
+
+stream_reader::stream_reader( int fd_, std::size_t buffer_size_, std::size_t n_buffers_ )
+  : _fd( fd_ ),
+    _buffers( n_buffers_, std::vector< char >( buffer_size_ ) ),
+    _sizes( n_buffers_, 0 ),
+    _current( -1 ),
+    _done( false ),
+    _failed( false ),
+    _stop( false )
+{
+  for( std::size_t i = 0; i < n_buffers_; i++ )
+  {
+    _free.push_back( i );
+  }
+  _thread = std::thread( &stream_reader::reader, this );
+}
+
+
+stream_reader::~stream_reader()
+{
+  {
+    std::unique_lock< std::mutex > lock( _mutex );
+    _stop = true;
+  }
+  _changed.notify_all();
+  _thread.join();
+}
+
+
+bool stream_reader::next( const char*& data_, std::size_t& size_ )
+{
+  std::unique_lock< std::mutex > lock( _mutex );
+  if( _current >= 0 )
+  {
+    _free.push_back( _current );
+    _current = -1;
+    _changed.notify_all();
+  }
+  _changed.wait( lock, [ this ]() { return !_filled.empty() || _done; } );
+  if( _filled.empty() )
+  {
+    return false;
+  }
+  _current = _filled.front();
+  _filled.pop_front();
+  data_ = _buffers[ _current ].data();
+  size_ = _sizes[ _current ];
+  return true;
+}
+
+
+bool stream_reader::ok() const
+{
+  return !_failed;
+}
+
+
+void stream_reader::reader()
+{
+  while( true )
+  {
+    std::size_t buffer;
+    {
+      std::unique_lock< std::mutex > lock( _mutex );
+      _changed.wait( lock, [ this ]() { return !_free.empty() || _stop; } );
+      if( _stop )
+      {
+	return;
+      }
+      buffer = _free.front();
+      _free.pop_front();
+    }
+    // a buffer is handed over full, or with whatever is left at the end
+    std::vector< char >& data = _buffers[ buffer ];
+    std::size_t size = 0;
+    bool end = false;
+    bool failed = false;
+    while( size < data.size() )
+    {
+      ssize_t n = read( _fd, data.data() + size, data.size() - size );
+      if( n < 0 && errno == EINTR )
+      {
+	continue;
+      }
+      if( n <= 0 )
+      {
+	end = true;
+	failed = n < 0;
+	break;
+      }
+      size += n;
+    }
+    std::unique_lock< std::mutex > lock( _mutex );
+    _sizes[ buffer ] = size;
+    if( size > 0 )
+    {
+      _filled.push_back( buffer );
+    }
+    else
+    {
+      _free.push_back( buffer );
+    }
+    _failed = _failed || failed;
+    _done = end;
+    _changed.notify_all();
+    if( end )
+    {
+      return;
+    }
+  }
+}
+
+
+input_stream::input_stream()
+  : _fd( -1 ),
+    _decompressor( -1 )
+{}
+
+
+input_stream::~input_stream()
+{
+  close();
+}
+
+
+bool input_stream::open( const std::string& name_ )
+{
+  close();
+  if( name_ == "-" )
+  {
+    _fd = 0;
+    return true;
+  }
+  const decompressor* program = find_decompressor( name_ );
+  if( program == NULL )
+  {
+    _fd = ::open( name_.c_str(), O_RDONLY );
+    return _fd >= 0;
+  }
+  // the decompressor gets the file name as its own argument, no shell involved
+  if( access( name_.c_str(), R_OK ) != 0 )
+  {
+    return false;
+  }
+  int pipe_fds[ 2 ];
+  if( pipe( pipe_fds ) != 0 )
+  {
+    return false;
+  }
+  _decompressor = fork();
+  if( _decompressor < 0 )
+  {
+    ::close( pipe_fds[ 0 ] );
+    ::close( pipe_fds[ 1 ] );
+    return false;
+  }
+  if( _decompressor == 0 )
+  {
+    dup2( pipe_fds[ 1 ], 1 );
+    ::close( pipe_fds[ 0 ] );
+    ::close( pipe_fds[ 1 ] );
+    execlp( program->program, program->program, "-dc", "--", name_.c_str(), (char*)0 );
+    _exit( 127 );
+  }
+  ::close( pipe_fds[ 1 ] );
+  _fd = pipe_fds[ 0 ];
+  return true;
+}
+
+
+bool input_stream::close()
+{
+  bool ok = true;
+  if( _fd > 0 )
+  {
+    ::close( _fd );
+  }
+  _fd = -1;
+  if( _decompressor > 0 )
+  {
+    int status;
+    while( waitpid( _decompressor, &status, 0 ) < 0 && errno == EINTR )
+    {
+    }
+    ok = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+  }
+  _decompressor = -1;
+  return ok;
+}
+
+
+int input_stream::fd() const
+{
+  return _fd;
+}
+
+
+bool is_stream_input( const std::string& name_ )
+{
+  if( name_ == "-" || find_decompressor( name_ ) != NULL )
+  {
+    return true;
+  }
+  struct stat st;
+  return stat( name_.c_str(), &st ) == 0 && !S_ISREG( st.st_mode ) && !S_ISDIR( st.st_mode );
+}
+
+
+std::size_t count_stream( const matcher& matcher_, int fd_, std::FILE* emit_, bool& ok_,
+			  std::uint64_t* bytes_read_, bool* line_too_long_ )
+{
+  std::unique_ptr< match_writer > writer( emit_ != NULL ? new match_writer( emit_ ) : NULL );
+  stream_reader reader( fd_ );
+  std::size_t count = 0;
+  // the start of the last line of the previous buffer
+  std::string line;
+  const char* data;
+  std::size_t size;
+  std::size_t buffer_size = 0;
+  std::uint64_t bytes_read = 0;
+  // the rest of a line which got too long is dropped up to its newline
+  bool skip_line = false;
+  bool line_too_long = false;
+  while( reader.next( data, size ) )
+  {
+    bytes_read += size;
+    buffer_size = std::max( buffer_size, size );
+    const char* end = data + size;
+    const char* first_newline = static_cast< const char* >( std::memchr( data, '\n', size ) );
+    if( first_newline == NULL )
+    {
+      if( skip_line )
+      {
+	continue;
+      }
+      line.append( data, size );
+      if( !matcher_.line_ranges() && line.size() > buffer_size )
+      {
+	count += scan_line_front( matcher_, line, writer.get() );
+      }
+      else if( line.size() > max_stream_line_length )
+      {
+	// a line matcher needs the whole line, give its memory back
+	std::string().swap( line );
+	skip_line = true;
+	line_too_long = true;
+      }
+      continue;
+    }
+    // the line which started in the previous buffer is complete now
+    if( !skip_line )
+    {
+      line.append( data, first_newline + 1 );
+      count += scan_lines( matcher_, line.data(), line.data() + line.size(), writer.get() );
+    }
+    skip_line = false;
+    const char* last_newline = static_cast< const char* >( memrchr( first_newline, '\n', end - first_newline ) );
+    count += scan_lines( matcher_, first_newline + 1, last_newline + 1, writer.get() );
+    line.assign( last_newline + 1, end );
+  }
+  count += scan_lines( matcher_, line.data(), line.data() + line.size(), writer.get() );
+  ok_ = reader.ok() && !line_too_long;
+  if( bytes_read_ != NULL )
+  {
+    *bytes_read_ = bytes_read;
+  }
+  if( line_too_long_ != NULL )
+  {
+    *line_too_long_ = line_too_long;
+  }
+  return count;
+}
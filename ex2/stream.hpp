@@ -0,0 +1,99 @@
+#ifndef STREAM_HPP_
+#define STREAM_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+#include "search.hpp"
+
+
+// reads a file descriptor on a thread of its own into a ring of reusable
+// buffers, so the next buffer is filled while the caller scans the last one.
+// The memory used does not depend on the size of the input
+class stream_reader
+{
+  public:
+    explicit stream_reader( int fd_, std::size_t buffer_size_ = 4 * 1024 * 1024, std::size_t n_buffers_ = 4 );
+    ~stream_reader();
+
+    // the next filled buffer, false at the end of the input. The buffer
+    // returned by the previous call goes back to the reader
+    bool next( const char*& data_, std::size_t& size_ );
+
+    // false if a read failed
+    bool ok() const;
+
+  private:
+    stream_reader( const stream_reader& );
+    stream_reader& operator=( const stream_reader& );
+
+    void reader();
+
+    int _fd;
+    std::vector< std::vector< char > > _buffers;
+    std::vector< std::size_t > _sizes;
+    std::deque< std::size_t > _free;
+    std::deque< std::size_t > _filled;
+    // buffer handed out by next(), -1 if none
+    long _current;
+    bool _done;
+    bool _failed;
+    bool _stop;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::thread _thread;
+};
+
+
+// an input given on the command line which is read as a stream: "-" is
+// stdin, compressed files are read through their decompressor, everything
+// else is opened as it is (FIFOs, devices)
+class input_stream
+{
+  public:
+    input_stream();
+    ~input_stream();
+
+    bool open( const std::string& name_ );
+
+    // closes the input, false if the decompressor failed
+    bool close();
+
+    int fd() const;
+
+  private:
+    input_stream( const input_stream& );
+    input_stream& operator=( const input_stream& );
+
+    int _fd;
+    pid_t _decompressor;
+};
+
+
+// true if name_ has to be read as a stream instead of being mapped
+bool is_stream_input( const std::string& name_ );
+
+
+// longest line a stream may have for matchers which scan whole lines (regex
+// patterns), longer lines would have to be kept in memory completely
+const std::size_t max_stream_line_length = 64 * 1024 * 1024;
+
+
+// counts the matches of matcher_ in everything read from fd_. If emit_ is
+// given every match is written to it on a line of its own, like grep -o does.
+// bytes_read_ receives the size of the input if given. Lines longer than
+// max_stream_line_length are skipped for matchers with line_ranges(), then
+// ok_ is false and line_too_long_ (if given) true
+std::size_t count_stream( const matcher& matcher_, int fd_, std::FILE* emit_, bool& ok_,
+			  std::uint64_t* bytes_read_ = NULL, bool* line_too_long_ = NULL );
+
+
+#endif
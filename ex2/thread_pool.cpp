@@ -0,0 +1,78 @@
+#include "thread_pool.hpp"
+
+
+thread_pool::thread_pool( unsigned n_threads_ )
+  : _running( 0 ),
+    _stop( false )
+{
+  if( n_threads_ == 0 )
+  {
+    n_threads_ = 1;
+  }
+  for( unsigned i = 0; i < n_threads_; i++ )
+  {
+    _threads.push_back( std::thread( &thread_pool::worker, this ) );
+  }
+}
+
+
+thread_pool::~thread_pool()
+{
+  {
+    std::unique_lock< std::mutex > lock( _mutex );
+    _stop = true;
+  }
+  _job_available.notify_all();
+  for( std::size_t i = 0; i < _threads.size(); i++ )
+  {
+    _threads[ i ].join();
+  }
+}
+
+
+void thread_pool::submit( const std::function< void() >& job_ )
+{
+  {
+    std::unique_lock< std::mutex > lock( _mutex );
+    _jobs.push_back( job_ );
+  }
+  _job_available.notify_one();
+}
+
+
+void thread_pool::wait()
+{
+  std::unique_lock< std::mutex > lock( _mutex );
+  _all_done.wait( lock, [ this ]() { return _jobs.empty() && _running == 0; } );
+}
+
+
+unsigned thread_pool::size() const
+{
+  return _threads.size();
+}
+
+
+void thread_pool::worker()
+{
+  std::unique_lock< std::mutex > lock( _mutex );
+  while( true )
+  {
+    _job_available.wait( lock, [ this ]() { return _stop || !_jobs.empty(); } );
+    if( _jobs.empty() )
+    {
+      return;
+    }
+    std::function< void() > job = _jobs.front();
+    _jobs.pop_front();
+    _running++;
+    lock.unlock();
+    job();
+    lock.lock();
+    _running--;
+    if( _jobs.empty() && _running == 0 )
+    {
+      _all_done.notify_all();
+    }
+  }
+}
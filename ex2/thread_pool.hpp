@@ -0,0 +1,44 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// fixed set of worker threads which execute submitted jobs in FIFO order.
+// the threads are created once and live as long as the pool
+class thread_pool
+{
+  public:
+    explicit thread_pool( unsigned n_threads_ );
+    ~thread_pool();
+
+    void submit( const std::function< void() >& job_ );
+
+    // blocks until every submitted job has finished
+    void wait();
+
+    unsigned size() const;
+
+  private:
+    thread_pool( const thread_pool& );
+    thread_pool& operator=( const thread_pool& );
+
+    void worker();
+
+    std::vector< std::thread > _threads;
+    std::deque< std::function< void() > > _jobs;
+    std::mutex _mutex;
+    std::condition_variable _job_available;
+    std::condition_variable _all_done;
+    std::size_t _running;
+    bool _stop;
+};
+
+
+#endif
@@ -0,0 +1,537 @@
+#include "trigram_index.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sys/stat.h>
+
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+
+namespace
+{
+
+const char index_magic[ 8 ] = { 'P', 'P', 'G', 'R', 'E', 'P', 'I', 'X' };
+const std::uint32_t index_version = 1;
+const std::size_t block_size = 64 * 1024;
+
+struct index_header
+{
+  char magic[ 8 ];
+  std::uint32_t version;
+  std::uint32_t n_files;
+  std::uint32_t n_blocks;
+  std::uint32_t n_trigrams;
+  std::uint64_t postings_size;
+};
+
+
+// the index refers to files by their absolute path, so it works from any directory
+std::string canonical_path( const std::string& filename_ )
+{
+  char* resolved = realpath( filename_.c_str(), NULL );
+  if( resolved == NULL )
+  {
+    return filename_;
+  }
+  std::string path( resolved );
+  free( resolved );
+  return path;
+}
+
+
+template< typename T >
+void put( std::string& out_, const T& value_ )
+{
+  out_.append( reinterpret_cast< const char* >( &value_ ), sizeof( T ) );
+}
+
+
+template< typename T >
+bool get( const char*& p_, const char* end_, T& value_ )
+{
+  if( static_cast< std::size_t >( end_ - p_ ) < sizeof( T ) )
+  {
+    return false;
+  }
+  std::memcpy( &value_, p_, sizeof( T ) );
+  p_ += sizeof( T );
+  return true;
+}
+
+
+void put_varint( std::string& out_, std::uint32_t value_ )
+{
+  while( value_ >= 0x80 )
+  {
+    out_.push_back( static_cast< char >( value_ | 0x80 ) );
+    value_ >>= 7;
+  }
+  out_.push_back( static_cast< char >( value_ ) );
+}
+
+
+std::uint32_t get_varint( const char*& p_ )
+{
+  std::uint32_t value = 0;
+  for( int shift = 0; ; shift += 7 )
+  {
+    unsigned char byte = *p_++;
+    value |= std::uint32_t( byte & 0x7f ) << shift;
+    if( byte < 0x80 )
+    {
+      return value;
+    }
+  }
+}
+
+
+// the trigrams of [begin_, end_) without the ones containing a newline (no
+// pattern can match those), sorted and without duplicates
+std::vector< std::uint32_t > trigrams_of( const char* begin_, const char* end_ )
+{
+  // one bit per possible trigram, every thread clears the bits it set again
+  static thread_local std::vector< std::uint64_t > seen( ( 1 << 24 ) / 64, 0 );
+  std::vector< std::uint32_t > trigrams;
+  const unsigned char* p = reinterpret_cast< const unsigned char* >( begin_ );
+  const unsigned char* end = reinterpret_cast< const unsigned char* >( end_ );
+  for( ; end - p >= 3; p++ )
+  {
+    std::uint32_t trigram = std::uint32_t( p[ 0 ] ) << 16 | std::uint32_t( p[ 1 ] ) << 8 | p[ 2 ];
+    std::uint64_t bit = std::uint64_t( 1 ) << ( trigram & 63 );
+    if( ( seen[ trigram >> 6 ] & bit ) == 0 && p[ 0 ] != '\n' && p[ 1 ] != '\n' && p[ 2 ] != '\n' )
+    {
+      seen[ trigram >> 6 ] |= bit;
+      trigrams.push_back( trigram );
+    }
+  }
+  for( std::size_t i = 0; i < trigrams.size(); i++ )
+  {
+    seen[ trigrams[ i ] >> 6 ] = 0;
+  }
+  std::sort( trigrams.begin(), trigrams.end() );
+  return trigrams;
+}
+
+}
+
+
+trigram_index::trigram_index()
+  : _n_blocks( 0 )
+{}
+
+
+bool trigram_index::load( const std::string& path_ )
+{
+  _files.clear();
+  _file_ids.clear();
+  _trigrams.clear();
+  _postings.clear();
+  _n_blocks = 0;
+
+  mapped_file file;
+  if( !file.open( path_ ) )
+  {
+    return false;
+  }
+  const char* p = file.begin();
+  const char* end = file.end();
+  index_header header;
+  if( !get( p, end, header ) || std::memcmp( header.magic, index_magic, sizeof( index_magic ) ) != 0
+      || header.version != index_version )
+  {
+    return false;
+  }
+  bool ok = true;
+  std::uint32_t next_block = 0;
+  for( std::uint32_t f = 0; ok && f < header.n_files; f++ )
+  {
+    file_entry entry;
+    std::uint32_t path_length;
+    std::uint32_t n_blocks;
+    ok = get( p, end, path_length ) && static_cast< std::size_t >( end - p ) >= path_length;
+    if( ok )
+    {
+      entry.path.assign( p, path_length );
+      p += path_length;
+      ok = get( p, end, entry.size ) && get( p, end, entry.mtime_sec ) && get( p, end, entry.mtime_nsec )
+	&& get( p, end, n_blocks );
+    }
+    for( std::uint32_t b = 0; ok && b < n_blocks; b++ )
+    {
+      std::uint64_t start;
+      ok = get( p, end, start );
+      entry.block_starts.push_back( start );
+    }
+    entry.first_block = next_block;
+    next_block += entry.block_starts.size();
+    _files.push_back( entry );
+  }
+  ok = ok && next_block == header.n_blocks;
+  for( std::uint32_t t = 0; ok && t < header.n_trigrams; t++ )
+  {
+    trigram_entry entry;
+    ok = get( p, end, entry ) && entry.offset <= header.postings_size;
+    _trigrams.push_back( entry );
+  }
+  ok = ok && static_cast< std::size_t >( end - p ) == header.postings_size;
+  if( !ok )
+  {
+    _files.clear();
+    _trigrams.clear();
+    return false;
+  }
+  _postings.assign( p, end );
+  _n_blocks = header.n_blocks;
+  number_files();
+  return true;
+}
+
+
+bool trigram_index::save( const std::string& path_ ) const
+{
+  std::string out;
+  index_header header;
+  std::memcpy( header.magic, index_magic, sizeof( index_magic ) );
+  header.version = index_version;
+  header.n_files = _files.size();
+  header.n_blocks = _n_blocks;
+  header.n_trigrams = _trigrams.size();
+  header.postings_size = _postings.size();
+  put( out, header );
+  for( std::size_t f = 0; f < _files.size(); f++ )
+  {
+    const file_entry& entry = _files[ f ];
+    put( out, static_cast< std::uint32_t >( entry.path.size() ) );
+    out += entry.path;
+    put( out, entry.size );
+    put( out, entry.mtime_sec );
+    put( out, entry.mtime_nsec );
+    put( out, static_cast< std::uint32_t >( entry.block_starts.size() ) );
+    for( std::size_t b = 0; b < entry.block_starts.size(); b++ )
+    {
+      put( out, entry.block_starts[ b ] );
+    }
+  }
+  for( std::size_t t = 0; t < _trigrams.size(); t++ )
+  {
+    put( out, _trigrams[ t ] );
+  }
+
+  // a query running meanwhile still sees the old index
+  std::string tmp = path_ + ".tmp";
+  std::ofstream file( tmp.c_str(), std::ios::binary | std::ios::trunc );
+  file.write( out.data(), out.size() );
+  file.write( _postings.data(), _postings.size() );
+  file.close();
+  if( !file || std::rename( tmp.c_str(), path_.c_str() ) != 0 )
+  {
+    std::remove( tmp.c_str() );
+    return false;
+  }
+  return true;
+}
+
+
+int trigram_index::find_file( const std::string& path_ ) const
+{
+  std::map< std::string, std::size_t >::const_iterator found = _file_ids.find( path_ );
+  return found == _file_ids.end() ? -1 : static_cast< int >( found->second );
+}
+
+
+void trigram_index::number_files()
+{
+  _file_ids.clear();
+  for( std::size_t f = 0; f < _files.size(); f++ )
+  {
+    _file_ids[ _files[ f ].path ] = f;
+  }
+}
+
+
+bool trigram_index::is_current( const file_entry& entry_ ) const
+{
+  struct stat st;
+  return stat( entry_.path.c_str(), &st ) == 0 && static_cast< std::uint64_t >( st.st_size ) == entry_.size
+    && st.st_mtim.tv_sec == entry_.mtime_sec && st.st_mtim.tv_nsec == entry_.mtime_nsec;
+}
+
+
+std::vector< std::uint32_t > trigram_index::postings( std::uint32_t trigram_ ) const
+{
+  std::vector< std::uint32_t > blocks;
+  std::size_t low = 0;
+  std::size_t high = _trigrams.size();
+  while( low < high )
+  {
+    std::size_t middle = ( low + high ) / 2;
+    if( _trigrams[ middle ].trigram < trigram_ )
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  if( low == _trigrams.size() || _trigrams[ low ].trigram != trigram_ )
+  {
+    return blocks;
+  }
+  const char* p = _postings.data() + _trigrams[ low ].offset;
+  std::uint32_t block = 0;
+  for( std::uint32_t i = 0; i < _trigrams[ low ].n_postings; i++ )
+  {
+    block += get_varint( p );
+    blocks.push_back( block );
+  }
+  return blocks;
+}
+
+
+std::size_t trigram_index::update( const std::vector< std::string >& filenames_, unsigned n_threads_ )
+{
+  std::vector< std::string > stale;
+  for( std::size_t i = 0; i < filenames_.size(); i++ )
+  {
+    std::string path = canonical_path( filenames_[ i ] );
+    int f = find_file( path );
+    if( ( f < 0 || !is_current( _files[ f ] ) ) && std::find( stale.begin(), stale.end(), path ) == stale.end() )
+    {
+      stale.push_back( path );
+    }
+  }
+  if( stale.empty() )
+  {
+    return 0;
+  }
+
+  // changed files lose their old entries, the blocks of the other files move
+  // down over theirs. moved holds the new number of every old block
+  const std::uint32_t dropped = 0xffffffff;
+  std::vector< std::uint32_t > moved( _n_blocks, dropped );
+  std::vector< file_entry > files;
+  std::uint32_t next_block = 0;
+  for( std::size_t f = 0; f < _files.size(); f++ )
+  {
+    if( std::find( stale.begin(), stale.end(), _files[ f ].path ) == stale.end() )
+    {
+      for( std::size_t b = 0; b < _files[ f ].block_starts.size(); b++ )
+      {
+	moved[ _files[ f ].first_block + b ] = next_block + b;
+      }
+      files.push_back( _files[ f ] );
+      files.back().first_block = next_block;
+      next_block += files.back().block_starts.size();
+    }
+  }
+
+  // the trigrams of all blocks of all new files are collected in parallel
+  std::vector< std::unique_ptr< mapped_file > > mapped;
+  std::vector< std::vector< std::vector< std::uint32_t > > > block_trigrams;
+  std::size_t first_new = files.size();
+  {
+    thread_pool pool( n_threads_ );
+    for( std::size_t s = 0; s < stale.size(); s++ )
+    {
+      std::unique_ptr< mapped_file > file( new mapped_file );
+      struct stat st;
+      // the time stamp is taken before reading, so a file changing meanwhile
+      // is indexed again next time. Files which can't be read stay out
+      if( stat( stale[ s ].c_str(), &st ) != 0 || !file->open( stale[ s ] ) )
+      {
+	continue;
+      }
+      file_entry entry;
+      entry.path = stale[ s ];
+      entry.size = file->size();
+      entry.mtime_sec = st.st_mtim.tv_sec;
+      entry.mtime_nsec = st.st_mtim.tv_nsec;
+      // blocks end behind the first newline after block_size bytes
+      for( std::uint64_t start = 0; start < entry.size; )
+      {
+	entry.block_starts.push_back( start );
+	std::uint64_t next = start + block_size;
+	if( next < entry.size )
+	{
+	  const char* newline = static_cast< const char* >( std::memchr( file->begin() + next, '\n', entry.size - next ) );
+	  next = newline == NULL ? entry.size : newline - file->begin() + 1;
+	}
+	start = std::min< std::uint64_t >( next, entry.size );
+      }
+      entry.first_block = next_block;
+      next_block += entry.block_starts.size();
+      files.push_back( entry );
+      mapped.push_back( std::move( file ) );
+      block_trigrams.push_back( std::vector< std::vector< std::uint32_t > >( entry.block_starts.size() ) );
+    }
+    for( std::size_t n = 0; n < mapped.size(); n++ )
+    {
+      const file_entry& entry = files[ first_new + n ];
+      for( std::size_t b = 0; b < entry.block_starts.size(); b++ )
+      {
+	const char* begin = mapped[ n ]->begin() + entry.block_starts[ b ];
+	const char* end = b + 1 < entry.block_starts.size() ? mapped[ n ]->begin() + entry.block_starts[ b + 1 ]
+							    : mapped[ n ]->end();
+	std::vector< std::uint32_t >& trigrams = block_trigrams[ n ][ b ];
+	pool.submit( [ begin, end, &trigrams ]() { trigrams = trigrams_of( begin, end ); } );
+      }
+    }
+    pool.wait();
+  }
+  // the new files come behind all others, so their postings as trigram << 32 |
+  // block number go behind the old ones of the same trigram
+  std::vector< std::uint64_t > added;
+  for( std::size_t n = 0; n < block_trigrams.size(); n++ )
+  {
+    std::uint32_t first_block = files[ first_new + n ].first_block;
+    for( std::size_t b = 0; b < block_trigrams[ n ].size(); b++ )
+    {
+      for( std::size_t t = 0; t < block_trigrams[ n ][ b ].size(); t++ )
+      {
+	added.push_back( std::uint64_t( block_trigrams[ n ][ b ][ t ] ) << 32 | ( first_block + b ) );
+      }
+    }
+  }
+  std::sort( added.begin(), added.end() );
+
+  // one pass over the old posting lists, merged with the new ones by trigram
+  std::vector< trigram_entry > trigrams;
+  std::string postings;
+  std::size_t t = 0;
+  std::size_t a = 0;
+  while( t < _trigrams.size() || a < added.size() )
+  {
+    trigram_entry entry;
+    entry.trigram = t < _trigrams.size() ? _trigrams[ t ].trigram : 0xffffffff;
+    if( a < added.size() )
+    {
+      entry.trigram = std::min( entry.trigram, std::uint32_t( added[ a ] >> 32 ) );
+    }
+    entry.n_postings = 0;
+    entry.offset = postings.size();
+    std::uint32_t previous = 0;
+    if( t < _trigrams.size() && _trigrams[ t ].trigram == entry.trigram )
+    {
+      const char* p = _postings.data() + _trigrams[ t ].offset;
+      std::uint32_t block = 0;
+      for( std::uint32_t i = 0; i < _trigrams[ t ].n_postings; i++ )
+      {
+	block += get_varint( p );
+	if( moved[ block ] != dropped )
+	{
+	  put_varint( postings, moved[ block ] - previous );
+	  previous = moved[ block ];
+	  entry.n_postings++;
+	}
+      }
+      t++;
+    }
+    for( ; a < added.size() && ( added[ a ] >> 32 ) == entry.trigram; a++ )
+    {
+      std::uint32_t block = added[ a ] & 0xffffffff;
+      put_varint( postings, block - previous );
+      previous = block;
+      entry.n_postings++;
+    }
+    // trigrams only the changed files had are gone
+    if( entry.n_postings > 0 )
+    {
+      trigrams.push_back( entry );
+    }
+  }
+  _files.swap( files );
+  number_files();
+  _n_blocks = next_block;
+  _trigrams.swap( trigrams );
+  _postings.swap( postings );
+  return mapped.size();
+}
+
+
+std::vector< scan_plan > trigram_index::plan( const std::vector< std::string >& filenames_,
+					      const std::vector< std::string >& literals_ ) const
+{
+  std::vector< scan_plan > plans( filenames_.size() );
+  for( std::size_t i = 0; i < plans.size(); i++ )
+  {
+    plans[ i ].whole_file = true;
+  }
+  bool usable = !literals_.empty();
+  for( std::size_t l = 0; l < literals_.size(); l++ )
+  {
+    usable = usable && literals_[ l ].size() >= 3;
+  }
+  if( !usable )
+  {
+    return plans;
+  }
+
+  // a block is a candidate if it has all trigrams of one of the literals
+  std::vector< bool > candidate( _n_blocks, false );
+  for( std::size_t l = 0; l < literals_.size(); l++ )
+  {
+    std::vector< std::uint32_t > trigrams = trigrams_of( literals_[ l ].data(), literals_[ l ].data() + literals_[ l ].size() );
+    std::vector< std::uint32_t > blocks = postings( trigrams[ 0 ] );
+    for( std::size_t t = 1; t < trigrams.size() && !blocks.empty(); t++ )
+    {
+      std::vector< std::uint32_t > other = postings( trigrams[ t ] );
+      std::vector< std::uint32_t > both;
+      std::set_intersection( blocks.begin(), blocks.end(), other.begin(), other.end(), std::back_inserter( both ) );
+      blocks.swap( both );
+    }
+    for( std::size_t b = 0; b < blocks.size(); b++ )
+    {
+      candidate[ blocks[ b ] ] = true;
+    }
+  }
+
+  for( std::size_t i = 0; i < filenames_.size(); i++ )
+  {
+    int f = find_file( canonical_path( filenames_[ i ] ) );
+    if( f < 0 || !is_current( _files[ f ] ) )
+    {
+      continue;
+    }
+    const file_entry& entry = _files[ f ];
+    scan_plan& plan = plans[ i ];
+    plan.whole_file = false;
+    for( std::size_t b = 0; b < entry.block_starts.size(); b++ )
+    {
+      if( !candidate[ entry.first_block + b ] )
+      {
+	continue;
+      }
+      std::uint64_t begin = entry.block_starts[ b ];
+      std::uint64_t end = b + 1 < entry.block_starts.size() ? entry.block_starts[ b + 1 ] : entry.size;
+      // neighbouring blocks are scanned in one go
+      if( !plan.blocks.empty() && plan.blocks.back().second == begin )
+      {
+	plan.blocks.back().second = end;
+      }
+      else
+      {
+	plan.blocks.push_back( std::make_pair( begin, end ) );
+      }
+    }
+  }
+  return plans;
+}
+
+
+std::size_t trigram_index::files() const
+{
+  return _files.size();
+}
+
+
+std::size_t trigram_index::blocks() const
+{
+  return _n_blocks;
+}
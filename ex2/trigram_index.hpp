@@ -0,0 +1,88 @@
+#ifndef TRIGRAM_INDEX_HPP_
+#define TRIGRAM_INDEX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// the parts of one file a query has to scan
+struct scan_plan
+{
+  // true if the file is not indexed, then all of it is scanned
+  bool whole_file;
+  // byte ranges [first, second) of the file in ascending order, each one made of whole lines
+  std::vector< std::pair< std::uint64_t, std::uint64_t > > blocks;
+};
+
+
+// on-disk index from trigrams (three consecutive bytes) to the blocks of the
+// indexed files which contain them. The files are cut into blocks of about
+// 64 KB which end behind a newline, so no match ever spans two blocks.
+// Every file is recorded with its size and modification time, a file where
+// either differs counts as not indexed until update() indexes it again
+class trigram_index
+{
+  public:
+    trigram_index();
+
+    // reads the index at path_, false (and an empty index) if it is missing or broken
+    bool load( const std::string& path_ );
+
+    // writes the index to path_, replacing an old one only when it is complete
+    bool save( const std::string& path_ ) const;
+
+    // indexes the files of filenames_ which are new or changed, using n_threads_
+    // threads. Returns how many files that were (files which can't be read are
+    // skipped), the entries of all other files stay
+    std::size_t update( const std::vector< std::string >& filenames_, unsigned n_threads_ );
+
+    // one plan per file: every match contains one of literals_, so only the
+    // blocks containing all trigrams of one of them have to be scanned. Files
+    // which are not indexed, and all files if a literal is shorter than three
+    // bytes or literals_ is empty, are scanned completely
+    std::vector< scan_plan > plan( const std::vector< std::string >& filenames_,
+				   const std::vector< std::string >& literals_ ) const;
+
+    std::size_t files() const;
+    std::size_t blocks() const;
+
+  private:
+    struct file_entry
+    {
+      std::string path;
+      std::uint64_t size;
+      std::int64_t mtime_sec;
+      std::int64_t mtime_nsec;
+      // start of every block, a block ends where the next one starts
+      std::vector< std::uint64_t > block_starts;
+      // global number of the first block, the blocks of all files are numbered in a row
+      std::uint32_t first_block;
+    };
+
+    struct trigram_entry
+    {
+      std::uint32_t trigram;
+      std::uint32_t n_postings;
+      std::uint64_t offset;
+    };
+
+    int find_file( const std::string& path_ ) const;
+    void number_files();
+    bool is_current( const file_entry& entry_ ) const;
+    std::vector< std::uint32_t > postings( std::uint32_t trigram_ ) const;
+
+    std::vector< file_entry > _files;
+    std::map< std::string, std::size_t > _file_ids;
+    std::uint32_t _n_blocks;
+    // sorted by trigram, the posting lists are the global block numbers in
+    // ascending order, delta and varint encoded
+    std::vector< trigram_entry > _trigrams;
+    std::string _postings;
+};
+
+
+#endif
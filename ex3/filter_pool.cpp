@@ -0,0 +1,107 @@
+#include "filter_pool.hpp"
+
+#include <algorithm>
+
+#include <sched.h>
+#include <unistd.h>
+
+
+filter_pool::filter_pool( int n_threads_, bool pin_ )
+  : _threads( std::max( 1, n_threads_ ) ),
+    _filter_rows( NULL ),
+    _n_rows( 0 ),
+    _block_rows( 1 ),
+    _next_row( 0 )
+{
+  int n_threads = _threads.size();
+  int n_started = 0;
+  // the threads wait for the gate until the barriers are sized for the
+  // threads which could actually be started
+  pthread_mutex_init( &_gate, NULL );
+  pthread_mutex_lock( &_gate );
+  long n_cores = std::max( 1L, sysconf( _SC_NPROCESSORS_ONLN ) );
+  for( int i = 0; i < n_threads; i++ )
+  {
+    pthread_attr_t attributes;
+    pthread_attr_init( &attributes );
+    if( pin_ )
+    {
+      // a thread which stays on its core keeps its caches and its window buffers there
+      cpu_set_t cores;
+      CPU_ZERO( &cores );
+      CPU_SET( i % n_cores, &cores );
+      pthread_attr_setaffinity_np( &attributes, sizeof( cores ), &cores );
+    }
+    // without the pinning then, the affinity may not be allowed
+    if( pthread_create( &_threads[ n_started ], &attributes, worker, this ) == 0
+	|| pthread_create( &_threads[ n_started ], NULL, worker, this ) == 0 )
+    {
+      n_started++;
+    }
+    pthread_attr_destroy( &attributes );
+  }
+  _threads.resize( n_started );
+  pthread_barrier_init( &_start, NULL, n_started + 1 );
+  pthread_barrier_init( &_done, NULL, n_started + 1 );
+  pthread_mutex_unlock( &_gate );
+}
+
+
+filter_pool::~filter_pool()
+{
+  _filter_rows = NULL;
+  pthread_barrier_wait( &_start );
+  for( std::size_t i = 0; i < _threads.size(); i++ )
+  {
+    pthread_join( _threads[ i ], NULL );
+  }
+  pthread_barrier_destroy( &_start );
+  pthread_barrier_destroy( &_done );
+  pthread_mutex_destroy( &_gate );
+}
+
+
+void filter_pool::run_rows( const std::function< void( int, int ) >& filter_rows_, int n_rows_, int block_rows_ )
+{
+  if( _threads.empty() )
+  {
+    // no thread could be started, the caller does the work
+    filter_rows_( 0, n_rows_ );
+    return;
+  }
+  _filter_rows = &filter_rows_;
+  _n_rows = n_rows_;
+  _block_rows = std::max( 1, block_rows_ );
+  _next_row = 0;
+  // the barriers also make the job visible to the threads and their rows to the caller
+  pthread_barrier_wait( &_start );
+  pthread_barrier_wait( &_done );
+}
+
+
+int filter_pool::get_n_threads() const
+{
+  return _threads.size();
+}
+
+
+void* filter_pool::worker( void* pool_ )
+{
+  filter_pool* pool = static_cast< filter_pool* >( pool_ );
+  pthread_mutex_lock( &pool->_gate );
+  pthread_mutex_unlock( &pool->_gate );
+  while( true )
+  {
+    pthread_barrier_wait( &pool->_start );
+    if( pool->_filter_rows == NULL )
+    {
+      return NULL;
+    }
+    for( int first = pool->_next_row.fetch_add( pool->_block_rows ); first < pool->_n_rows;
+	 first = pool->_next_row.fetch_add( pool->_block_rows ) )
+    {
+      ( *pool->_filter_rows )( first, std::min( pool->_n_rows, first + pool->_block_rows ) );
+    }
+    pthread_barrier_wait( &pool->_done );
+  }
+}
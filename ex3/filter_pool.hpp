@@ -0,0 +1,76 @@
+#ifndef FILTER_POOL_HPP_
+#define FILTER_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <pthread.h>
+
+#include "image_matrix.hpp"
+#include "median_filter.hpp"
+
+
+// threads which are started once and then filter any number of images one
+// after the other. The threads claim blocks of rows from a shared counter,
+// so a thread which is done early takes over more rows, and a barrier tells
+// the caller that an image is complete
+class filter_pool
+{
+  public:
+    // starts n_threads_ threads, with pin_ thread i runs on core i (modulo
+    // the number of cores). get_n_threads() tells how many could be started,
+    // without any thread run() filters on the calling thread
+    explicit filter_pool( int n_threads_, bool pin_ = true );
+
+    // stops and joins the threads
+    ~filter_pool();
+
+    // filters all rows of the image of filter_ into filtered_image_, in
+    // blocks of block_rows_ rows (0 picks about 8 blocks per thread, at
+    // least a window high). Returns when the image is done
+    template< typename T >
+    void run( const basic_median_filter< T >& filter_, basic_image_matrix< T >& filtered_image_,
+	      int block_rows_ = 0 )
+    {
+      int n_rows = filtered_image_.get_n_rows();
+      if( block_rows_ <= 0 )
+      {
+	block_rows_ = std::max( filter_.window_size(), n_rows / ( 8 * std::max( 1, get_n_threads() ) ) );
+      }
+      run_rows( [ &filter_, &filtered_image_ ]( int first_row_, int last_row_ )
+		{
+		  filter_.filter_rows( filtered_image_, first_row_, last_row_ );
+		}, n_rows, block_rows_ );
+    }
+
+    // calls filter_rows_( first, last ) for blocks of block_rows_ rows until
+    // all n_rows_ are done
+    void run_rows( const std::function< void( int, int ) >& filter_rows_, int n_rows_, int block_rows_ );
+
+    int get_n_threads() const;
+
+  private:
+    filter_pool( const filter_pool& );
+    filter_pool& operator=( const filter_pool& );
+
+    static void* worker( void* pool_ );
+
+    // the threads which were started
+    std::vector< pthread_t > _threads;
+    // held by the constructor until the barriers are initialised
+    pthread_mutex_t _gate;
+    // all threads and the caller wait here before and after every image
+    pthread_barrier_t _start;
+    pthread_barrier_t _done;
+    // filters a block of rows of the current image, NULL when the threads shall stop
+    const std::function< void( int, int ) >* _filter_rows;
+    int _n_rows;
+    int _block_rows;
+    // the first row no thread has claimed yet
+    std::atomic< int > _next_row;
+};
+
+
+#endif
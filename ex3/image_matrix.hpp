@@ -1,20 +1,89 @@
 #ifndef IMAGE_MATRIX_HPP_
 #define IMAGE_MATRIX_HPP_
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 
-class image_matrix
+// how the pixel types store an intensity. Text images hold intensities in
+// [0, 1], integer pixels scale them to their whole range. type is the pixel
+// type in the header of binary images
+template< typename T >
+struct pixel_traits;
+
+template<>
+struct pixel_traits< float >
+{
+  static const std::uint32_t type = 1;
+
+  static float from_float( float value_ )
+  {
+    return value_;
+  }
+
+  static float to_float( float value_ )
+  {
+    return value_;
+  }
+};
+
+template<>
+struct pixel_traits< std::uint8_t >
+{
+  static const std::uint32_t type = 2;
+
+  static std::uint8_t from_float( float value_ )
+  {
+    return value_ > 0.0f ? ( value_ < 1.0f ? std::lrint( value_ * 255.0f ) : 255 ) : 0;
+  }
+
+  static float to_float( std::uint8_t value_ )
+  {
+    return value_ / 255.0f;
+  }
+};
+
+template<>
+struct pixel_traits< std::uint16_t >
+{
+  static const std::uint32_t type = 3;
+
+  static std::uint16_t from_float( float value_ )
+  {
+    return value_ > 0.0f ? ( value_ < 1.0f ? std::lrint( value_ * 65535.0f ) : 65535 ) : 0;
+  }
+
+  static float to_float( std::uint16_t value_ )
+  {
+    return value_ / 65535.0f;
+  }
+};
+
+
+// an image of pixels of type T (float, std::uint8_t or std::uint16_t)
+template< typename T >
+class basic_image_matrix
 {
   public:
-    image_matrix();
-    image_matrix( int n_rows_, int n_cols_ );
-    ~image_matrix();
+    basic_image_matrix();
+    basic_image_matrix( int n_rows_, int n_cols_ );
+    basic_image_matrix( const basic_image_matrix& other_ );
+    basic_image_matrix& operator=( const basic_image_matrix& other_ );
+    ~basic_image_matrix();
 
   private:
-    std::vector< float > _data;
+    std::vector< T > _data;
     int _n_rows;
     int _n_cols;
+    // the pixels, either _data or the pixels of a mapped binary file
+    T* _pixels;
+    void* _mapping;
+    std::size_t _mapping_size;
+
+    void unmap();
 
   public:
     int get_n_rows() const;
@@ -23,11 +92,40 @@ class image_matrix
 
     void resize( int n_rows_, int n_cols_ );
 
-    float get_pixel( int r_, int c_ ) const;
+    T get_pixel( int r_, int c_ ) const;
+
+    void set_pixel( int r_, int c_, T value_ );
+
+    // the pixels row by row, get_n_cols() per row
+    const T* data() const;
+
+    T* data();
 
-    void set_pixel( int r_, int c_, float value_ );
+    // reads a binary image or the text format "n_rows n_cols pixels...".
+    // Binary images of this pixel type are mapped instead of read, their
+    // pages are only copied when a pixel is changed. Other pixel types are
+    // converted
+    bool load( const std::string& filename_ );
+
+    // writes the text format, the intensities formatted like ostream << does
+    bool save_text( const std::string& filename_ ) const;
+
+    // writes a binary image: the header "FIMG", n_rows, n_cols and the pixel
+    // type (pixel_traits< T >::type) as 32 bit integers, then the pixels row
+    // by row. All in the byte order of the machine, load() refuses the other one
+    bool save_binary( const std::string& filename_ ) const;
 
 };
 
 
+typedef basic_image_matrix< float > image_matrix;
+// 8 and 16 bit sources, a quarter and half of the memory of float pixels
+typedef basic_image_matrix< std::uint8_t > image_matrix_u8;
+typedef basic_image_matrix< std::uint16_t > image_matrix_u16;
+
+
+// true if filename_ ends in ".bin", the name images are saved binary under
+bool is_binary_image_name( const std::string& filename_ );
+
+
 #endif
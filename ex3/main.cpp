@@ -2,154 +2,39 @@
 #include <vector>
 #include <fstream>
 
-#include <pthread.h>
-
+#include "filter_pool.hpp"
 #include "image_matrix.hpp"
+#include "median_filter.hpp"
 
 
-// function that performs the median filtering on pixel p(r_,c_) of input_image_,
-// using a window of size window_size_
-// the function returns the new filtered value p'(r_,c_)
-float median_filter_pixel( const image_matrix& input_image_,
-						   int r_,
-						   int c_,
-						   int window_size_ )
-{
-	int n_rows = input_image_.get_n_rows();
-	int n_cols = input_image_.get_n_cols();
-	
-	float filtered_value;
-	std::vector<float> window_vector;
-	
-	//for every p(r,c), we begin at r - window_size/2 and stop at r + window_size/2
-	//since there is a possibility to start at a location which is out of bound (i.e. p(r,c) is at the left edge)
-	//we only allow starting points which are greater than or equal to 0
-	for (int i = std::max(0, r_ - window_size_/2); i <= r_ + window_size_/2; i++) {
-		//if we are to overstep the right corner, we stop and go to the next row
-		if (i >= n_rows) { break; }
-		//the same logic as above applies here, only now for columns instead of rows
-		for (int j = std::max(0, c_ - window_size_/2); j <= c_ + window_size_/2; j++) {
-			if (j >= n_cols) { break; }
-			window_vector.push_back(input_image_.get_pixel(i, j));    
-		}
-	}
-
-	//we need to sort the vector to calculate the median
-	std::sort(window_vector.begin(), window_vector.end());
-	if (window_vector.size() % 2 != 0) {
-		filtered_value = window_vector[window_vector.size() / 2];
-	} else {
-		filtered_value = (window_vector[window_vector.size() / 2 - 1] + window_vector[window_vector.size() / 2])/2;
-	}
-	
-	return filtered_value;
-}
-
-// struct passed to each thread, containing the information necessary
-// to process its assigned range
-struct task
-{
-	const image_matrix& input_image;
-	image_matrix& filtered_image;
-	int firstRow, lastRow, window_size;
-};
-
-// function run by each thread
-void* func( void* arg ) 
+// read input image from file filename_ into image_in_, text or binary
+template< typename T >
+bool read_input_image( const std::string& filename_, basic_image_matrix< T >& image_in_ )
 {
-  	task* t_arg = ( task* )arg;
-  	
-  	int n_cols = t_arg->input_image.get_n_cols();
-  	//iterate through the bounds which are provided by the t_arg struct and calculate each pixel inside the bound
-  	for( int r = t_arg->firstRow; r < t_arg->lastRow; r++ ) {
-	  	for( int c = 0; c < n_cols; c++ ) {
-			float p_rc_filt = median_filter_pixel( t_arg->input_image, r, c, t_arg->window_size );
-			t_arg->filtered_image.set_pixel( r, c, p_rc_filt );
-	  	}
-	}
-  	pthread_exit( NULL );
+  return image_in_.load( filename_ );
 }
 
 
-// read input image from file filename_ into image_in_
-bool read_input_image( const std::string& filename_, image_matrix& image_in_ )
+// write filtered image_out_ to file filename_, binary if the name ends in .bin
+template< typename T >
+bool write_filtered_image( const std::string& filename_, const basic_image_matrix< T >& image_out_ )
 {
-  bool ret = false;
-  std::ifstream is( filename_.c_str() );
-  if( is.is_open() )
+  if( is_binary_image_name( filename_ ) )
   {
-	int n_rows;
-	int n_cols;
-
-	is >> n_rows;
-	is >> n_cols;
-
-	image_in_.resize( n_rows, n_cols );
-
-	for( int r = 0; r < n_rows; r++ )
-	{
-	  for( int c = 0; c < n_cols; c++ )
-	  {
-		float value;
-		is >> value;
-		image_in_.set_pixel( r, c, value );
-	  }
-	}
-	is.close();
-	ret = true;
+	return image_out_.save_binary( filename_ );
   }
-  return ret;
+  return image_out_.save_text( filename_ );
 }
 
 
-// write filtered image_out_ to file filename_
-bool write_filtered_image( const image_matrix& image_out_ )
+// reads, filters and writes the image with pixels of type T
+template< typename T >
+int filter_image( const std::string& input_filename, int window_size, int n_threads, int mode,
+		  median_method method )
 {
-  bool ret = false;
-  std::ofstream os( "filtered.txt" );
-  if( os.is_open() )
-  {
-	int n_rows = image_out_.get_n_rows();
-	int n_cols = image_out_.get_n_cols();
-
-	os << n_rows << std::endl;
-	os << n_cols << std::endl;
-
-	for( int r = 0; r < n_rows; r++ )
-	{
-	  for( int c = 0; c < n_cols; c++ )
-	  {
-		os << image_out_.get_pixel( r, c ) << " ";
-	  }
-	  os << std::endl;
-	}
-	os.close();
-	ret = true;
-  }
-  return ret;
-}
-
-
-
-int main( int argc, char* argv[] )
-{
-  if( argc < 5 )
-  {
-	std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
-	return 1;
-  }
-
-  // get input arguments
-  std::string input_filename( argv[ 1 ] );
-  int window_size = std::stoi( argv[ 2 ] );
-  int n_threads = std::stoi( argv[ 3 ] );
-  int mode = std::stoi( argv[ 4 ] );
-
-  std::cout << argv[ 0 ] << " called with parameters " << input_filename << " " << window_size << " " << n_threads << " " << mode << std::endl;
-
   // input and the filtered image matrices
-  image_matrix input_image;
-  image_matrix filtered_image;
+  basic_image_matrix< T > input_image;
+  basic_image_matrix< T > filtered_image;
    
   // read input matrix
   read_input_image( input_filename, input_image );
@@ -160,56 +45,29 @@ int main( int argc, char* argv[] )
 
   filtered_image.resize( n_rows, n_cols );
 
+  // prepares the image for the median method once, all threads share it
+  basic_median_filter< T > filter( input_image, window_size, method );
+
   // start with the actual processing
   if( mode == 0 )
   {
 	// ******    SERIAL VERSION     ******
 
-	for( int r = 0; r < n_rows; r++ )
-	{
-	  for( int c = 0; c < n_cols; c++ )
-	  {
-		float p_rc_filt = median_filter_pixel( input_image, r, c, window_size );
-		filtered_image.set_pixel( r, c, p_rc_filt );
-	  }
-	}
+	filter.filter_rows( filtered_image, 0, n_rows );
 	// ***********************************
   }
   else if( mode == 1 )
   {
 	// ******   PARALLEL VERSION    ******
 
-	// declaration of pthread_t variables for the threads
-  	pthread_t threads [n_threads];
-	// declaration of the struct variables to be passed to the threads
-	// we need to save the struct variables inside a vector, since the 
-	// struct contains references to images and references cannot be automatically
-	// initialized. Therefore we do it by hand 
-  	std::vector<task> tasks;
-  	for (int i = 0; i < n_threads; i++) {
-  		task newTask = {input_image, filtered_image};
-  		tasks.push_back(newTask);
-  	}
-
-	// create threads
-	for(int i = 0; i < n_threads; i++) {
-		//calculate the bounds for each thread. We split the rows so that
-		//each thread has approximately the same amount of work to do
-		if (i != n_threads - 1) {
-			tasks[i].firstRow = n_rows / n_threads * i;
-			tasks[i].lastRow = tasks[i].firstRow + n_rows / n_threads;
-		} else {
-			tasks[i].firstRow = n_rows / n_threads * i;
-			tasks[i].lastRow = n_rows;
-		}
-		tasks[i].window_size = window_size;
-		pthread_create(&threads[i], NULL, func, (void *)(&tasks[i]));
-	}
-
-	// wait for termination of threads
-	for (int i = 0; i < n_threads; ++i) {
-		pthread_join(threads[i], NULL);
+	// the threads of the pool claim blocks of rows until the image is done,
+	// the same pool could filter any number of images without new threads
+	filter_pool pool( n_threads );
+	if( pool.get_n_threads() < n_threads )
+	{
+	  std::cerr << "Could only start " << pool.get_n_threads() << " of " << n_threads << " threads." << std::endl;
 	}
+	pool.run( filter, filtered_image );
 
 	// ***********************************
   }
@@ -219,8 +77,57 @@ int main( int argc, char* argv[] )
 	return 1;
   }
 
-  // write filtered matrix to file
-  write_filtered_image( filtered_image );
+  // write filtered matrix to file, in the format of the input
+  write_filtered_image( is_binary_image_name( input_filename ) ? "filtered.bin" : "filtered.txt", filtered_image );
 
   return 0;
-}
\ No newline at end of file
+}
+
+
+
+int main( int argc, char* argv[] )
+{
+  // the optional --pixels=TYPE comes first
+  std::string pixels = "float";
+  int first_arg = 1;
+  if( argc > 1 && std::string( argv[ 1 ] ).compare( 0, 9, "--pixels=" ) == 0 )
+  {
+	pixels = argv[ 1 ] + 9;
+	if( pixels != "float" && pixels != "u8" && pixels != "u16" )
+	{
+	  std::cerr << "Unknown pixel type " << pixels << ". Terminating." << std::endl;
+	  return 1;
+	}
+	first_arg++;
+  }
+  if( argc - first_arg < 4 )
+  {
+	std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
+	return 1;
+  }
+
+  // get input arguments
+  std::string input_filename( argv[ first_arg ] );
+  int window_size = std::stoi( argv[ first_arg + 1 ] );
+  int n_threads = std::stoi( argv[ first_arg + 2 ] );
+  int mode = std::stoi( argv[ first_arg + 3 ] );
+  median_method method = median_auto;
+  if( argc > first_arg + 4 && !median_method_from_name( argv[ first_arg + 4 ], method ) )
+  {
+	std::cerr << "Unknown median method " << argv[ first_arg + 4 ] << ". Terminating." << std::endl;
+	return 1;
+  }
+
+  std::cout << argv[ 0 ] << " called with parameters " << input_filename << " " << window_size << " " << n_threads << " " << mode << std::endl;
+
+  // 8 and 16 bit pixels need a quarter and half of the memory bandwidth
+  if( pixels == "u8" )
+  {
+	return filter_image< std::uint8_t >( input_filename, window_size, n_threads, mode, method );
+  }
+  if( pixels == "u16" )
+  {
+	return filter_image< std::uint16_t >( input_filename, window_size, n_threads, mode, method );
+  }
+  return filter_image< float >( input_filename, window_size, n_threads, mode, method );
+}
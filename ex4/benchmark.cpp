@@ -0,0 +1,350 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+
+namespace
+{
+
+// the comma separated values of list_, false if one is not an integer of at least minimum_
+bool parse_ints( const std::string& list_, std::vector< int >& values_, int minimum_ = 1 )
+{
+  values_.clear();
+  std::size_t start = 0;
+  while( start <= list_.size() )
+  {
+    std::size_t end = list_.find( ',', start );
+    end = end == std::string::npos ? list_.size() : end;
+    char* stop;
+    long value = std::strtol( list_.c_str() + start, &stop, 10 );
+    if( end == start || stop != list_.c_str() + end || value < minimum_ )
+    {
+      return false;
+    }
+    values_.push_back( value );
+    start = end + 1;
+  }
+  return true;
+}
+
+
+bool parse_methods( const std::string& list_, std::vector< median_method >& methods_ )
+{
+  methods_.clear();
+  std::size_t start = 0;
+  while( start <= list_.size() )
+  {
+    std::size_t end = list_.find( ',', start );
+    end = end == std::string::npos ? list_.size() : end;
+    median_method method;
+    if( !median_method_from_name( list_.substr( start, end - start ), method ) )
+    {
+      return false;
+    }
+    methods_.push_back( method );
+    start = end + 1;
+  }
+  return true;
+}
+
+
+bool parse_sizes( const std::string& list_, std::vector< std::pair< int, int > >& sizes_ )
+{
+  sizes_.clear();
+  std::size_t start = 0;
+  while( start <= list_.size() )
+  {
+    std::size_t end = list_.find( ',', start );
+    end = end == std::string::npos ? list_.size() : end;
+    int n_rows;
+    int n_cols;
+    char tail;
+    std::string size = list_.substr( start, end - start );
+    if( std::sscanf( size.c_str(), "%dx%d%c", &n_rows, &n_cols, &tail ) != 2 || n_rows <= 0 || n_cols <= 0 )
+    {
+      return false;
+    }
+    sizes_.push_back( std::make_pair( n_rows, n_cols ) );
+    start = end + 1;
+  }
+  return true;
+}
+
+
+// the value of option_ if it starts with name_
+bool option_value( const std::string& option_, const std::string& name_, std::string& value_ )
+{
+  if( option_.compare( 0, name_.size(), name_ ) != 0 )
+  {
+    return false;
+  }
+  value_ = option_.substr( name_.size() );
+  return true;
+}
+
+
+std::string json_string( const std::string& text_ )
+{
+  std::string quoted = "\"";
+  for( std::size_t i = 0; i < text_.size(); i++ )
+  {
+    if( text_[ i ] == '"' || text_[ i ] == '\\' )
+    {
+      quoted += '\\';
+    }
+    quoted += text_[ i ];
+  }
+  return quoted + "\"";
+}
+
+
+// the figures every format writes
+struct summary
+{
+  double median;
+  double p95;
+  double min;
+  double pixels_per_second;
+  double bytes_per_second;
+};
+
+
+summary summarize( const benchmark_result& result_ )
+{
+  summary s;
+  s.median = percentile( result_.seconds, 0.5 );
+  s.p95 = percentile( result_.seconds, 0.95 );
+  s.min = result_.seconds.empty() ? 0 : *std::min_element( result_.seconds.begin(), result_.seconds.end() );
+  s.pixels_per_second = s.median > 0 ? result_.n_pixels / s.median : 0;
+  s.bytes_per_second = s.pixels_per_second * result_.bytes_per_pixel;
+  return s;
+}
+
+
+void write_text( std::ostream& out_, const std::vector< benchmark_result >& results_ )
+{
+  char line[ 256 ];
+  std::snprintf( line, sizeof( line ), "%-6s %-9s %-9s %-9s %7s %6s %-14s %10s %10s %10s %9s %s\n", "pixels",
+		 "strategy", "method", "used", "threads", "window", "images", "median_ms", "p95_ms", "Mpixel/s",
+		 "GB/s", "output" );
+  out_ << line;
+  for( std::size_t i = 0; i < results_.size(); i++ )
+  {
+    const benchmark_result& r = results_[ i ];
+    summary s = summarize( r );
+    std::string images = std::to_string( r.n_images ) + ( r.images == "files" ? " files" : "x" + r.images );
+    std::snprintf( line, sizeof( line ), "%-6s %-9s %-9s %-9s %7d %6d %-14s %10.3f %10.3f %10.2f %9.3f %s\n",
+		   r.pixels.c_str(), r.strategy.c_str(), r.method.c_str(), r.used_method.c_str(), r.n_threads,
+		   r.window_size, images.c_str(), s.median * 1e3, s.p95 * 1e3, s.pixels_per_second / 1e6,
+		   s.bytes_per_second / 1e9, r.identical ? "identical" : "DIFFERENT" );
+    out_ << line;
+  }
+}
+
+
+void write_csv( std::ostream& out_, const std::vector< benchmark_result >& results_ )
+{
+  out_ << "pixels,strategy,method,used_method,threads,window,images,n_images,n_pixels,repetitions,"
+       << "median_seconds,p95_seconds,min_seconds,pixels_per_second,bytes_per_second,identical\n";
+  for( std::size_t i = 0; i < results_.size(); i++ )
+  {
+    const benchmark_result& r = results_[ i ];
+    summary s = summarize( r );
+    out_ << r.pixels << "," << r.strategy << "," << r.method << "," << r.used_method << "," << r.n_threads << ","
+	 << r.window_size << "," << r.images << "," << r.n_images << "," << r.n_pixels << "," << r.seconds.size()
+	 << "," << s.median << "," << s.p95 << "," << s.min << "," << s.pixels_per_second << ","
+	 << s.bytes_per_second << "," << ( r.identical ? "true" : "false" ) << "\n";
+  }
+}
+
+
+void write_json( std::ostream& out_, const std::vector< benchmark_result >& results_ )
+{
+  out_ << "{\"results\":[";
+  for( std::size_t i = 0; i < results_.size(); i++ )
+  {
+    const benchmark_result& r = results_[ i ];
+    summary s = summarize( r );
+    out_ << ( i > 0 ? ",\n" : "\n" ) << "{\"pixels\":" << json_string( r.pixels ) << ",\"strategy\":"
+	 << json_string( r.strategy ) << ",\"method\":" << json_string( r.method ) << ",\"used_method\":"
+	 << json_string( r.used_method ) << ",\"threads\":" << r.n_threads << ",\"window\":" << r.window_size
+	 << ",\"images\":" << json_string( r.images ) << ",\"n_images\":" << r.n_images << ",\"n_pixels\":"
+	 << r.n_pixels << ",\"seconds\":[";
+    for( std::size_t j = 0; j < r.seconds.size(); j++ )
+    {
+      out_ << ( j > 0 ? "," : "" ) << r.seconds[ j ];
+    }
+    out_ << "],\"median_seconds\":" << s.median << ",\"p95_seconds\":" << s.p95 << ",\"min_seconds\":" << s.min
+	 << ",\"pixels_per_second\":" << s.pixels_per_second << ",\"bytes_per_second\":" << s.bytes_per_second
+	 << ",\"identical\":" << ( r.identical ? "true" : "false" ) << "}";
+  }
+  out_ << "\n]}\n";
+}
+
+}
+
+
+benchmark_config::benchmark_config()
+  : n_images( 3 ),
+    noise( 0.05 ),
+    warmup( 1 ),
+    repetitions( 5 ),
+    reference( false ),
+    format( "text" )
+{
+  modes.push_back( 0 );
+  modes.push_back( 1 );
+  modes.push_back( 2 );
+  modes.push_back( 4 );
+}
+
+
+bool parse_benchmark_option( const std::string& option_, benchmark_config& config_ )
+{
+  std::string value;
+  std::vector< int > numbers;
+  if( option_value( option_, "--bench-threads=", value ) )
+  {
+    return parse_ints( value, config_.threads );
+  }
+  if( option_value( option_, "--bench-windows=", value ) )
+  {
+    return parse_ints( value, config_.windows );
+  }
+  if( option_value( option_, "--bench-modes=", value ) )
+  {
+    // mode 3 is the benchmark itself and mode 5 includes reading and writing
+    if( !parse_ints( value, numbers, 0 ) )
+    {
+      return false;
+    }
+    for( std::size_t i = 0; i < numbers.size(); i++ )
+    {
+      if( numbers[ i ] == 3 || numbers[ i ] > 4 )
+      {
+	return false;
+      }
+    }
+    config_.modes = numbers;
+    return true;
+  }
+  if( option_value( option_, "--bench-methods=", value ) )
+  {
+    return parse_methods( value, config_.methods );
+  }
+  if( option_value( option_, "--bench-sizes=", value ) )
+  {
+    return parse_sizes( value, config_.sizes );
+  }
+  if( option_value( option_, "--bench-images=", value ) && parse_ints( value, numbers ) && numbers.size() == 1 )
+  {
+    config_.n_images = numbers[ 0 ];
+    return true;
+  }
+  if( option_value( option_, "--bench-noise=", value ) )
+  {
+    char* stop;
+    config_.noise = std::strtod( value.c_str(), &stop );
+    return *stop == '\0' && !value.empty() && config_.noise >= 0 && config_.noise <= 1;
+  }
+  if( option_value( option_, "--bench-warmup=", value ) )
+  {
+    config_.warmup = std::atoi( value.c_str() );
+    return value.find_first_not_of( "0123456789" ) == std::string::npos && !value.empty();
+  }
+  if( option_value( option_, "--bench-reps=", value ) && parse_ints( value, numbers ) && numbers.size() == 1 )
+  {
+    config_.repetitions = numbers[ 0 ];
+    return true;
+  }
+  if( option_ == "--bench-reference" )
+  {
+    config_.reference = true;
+    return true;
+  }
+  if( option_value( option_, "--bench-format=", value ) )
+  {
+    config_.format = value;
+    return value == "text" || value == "csv" || value == "json";
+  }
+  if( option_value( option_, "--bench-out=", value ) )
+  {
+    config_.output = value;
+    return !value.empty();
+  }
+  return false;
+}
+
+
+double percentile( std::vector< double > seconds_, double fraction_ )
+{
+  if( seconds_.empty() )
+  {
+    return 0;
+  }
+  std::sort( seconds_.begin(), seconds_.end() );
+  std::size_t rank = std::ceil( fraction_ * seconds_.size() );
+  return seconds_[ std::min( seconds_.size(), std::max< std::size_t >( rank, 1 ) ) - 1 ];
+}
+
+
+bool write_benchmark( const benchmark_config& config_, const std::vector< benchmark_result >& results_ )
+{
+  std::ofstream file;
+  if( !config_.output.empty() )
+  {
+    file.open( config_.output.c_str() );
+    if( !file.is_open() )
+    {
+      return false;
+    }
+  }
+  std::ostream& out = config_.output.empty() ? std::cout : file;
+  if( config_.format == "csv" )
+  {
+    write_csv( out, results_ );
+  }
+  else if( config_.format == "json" )
+  {
+    write_json( out, results_ );
+  }
+  else
+  {
+    write_text( out, results_ );
+  }
+  out.flush();
+  return !out.fail();
+}
+
+
+template< typename T >
+void make_synthetic_image( int n_rows_, int n_cols_, double noise_, unsigned seed_, basic_image_matrix< T >& image_ )
+{
+  std::mt19937 random( seed_ );
+  std::uniform_real_distribution< float > unit( 0.0f, 1.0f );
+  image_.resize( n_rows_, n_cols_ );
+  for( int r = 0; r < n_rows_; r++ )
+  {
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      float value = 0.5f + 0.3f * std::sin( r / 23.0f + seed_ ) * std::cos( c / 17.0f ) + 0.1f * ( unit( random ) - 0.5f );
+      if( unit( random ) < noise_ )
+      {
+	value = unit( random ) < 0.5f ? 0.0f : 1.0f;
+      }
+      value = std::lrint( std::min( 1.0f, std::max( 0.0f, value ) ) * 255.0f ) / 255.0f;
+      image_.set_pixel( r, c, pixel_traits< T >::from_float( value ) );
+    }
+  }
+}
+
+
+template void make_synthetic_image( int, int, double, unsigned, image_matrix& );
+template void make_synthetic_image( int, int, double, unsigned, image_matrix_u8& );
+template void make_synthetic_image( int, int, double, unsigned, image_matrix_u16& );
@@ -0,0 +1,90 @@
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image_matrix.hpp"
+#include "median_filter.hpp"
+
+
+// what the benchmark (mode 3) sweeps and how it measures. Every list which
+// is left empty falls back to the command line: the window size, the number
+// of threads, the --median method and the input files
+struct benchmark_config
+{
+  benchmark_config();
+
+  std::vector< int > threads;
+  std::vector< int > windows;
+  // the modes compared, 0, 1, 2 and 4 by default
+  std::vector< int > modes;
+  std::vector< median_method > methods;
+  // rows x cols of synthetic images, used instead of the input files. Without
+  // either the images are 512x512
+  std::vector< std::pair< int, int > > sizes;
+  // synthetic images per size, and the fraction of their pixels set to 0 or 1
+  int n_images;
+  double noise;
+  // untimed runs before the timed repetitions of every case
+  int warmup;
+  int repetitions;
+  // also times median_filter_pixel, which is slow for large windows
+  bool reference;
+  // text, csv or json, written to output or stdout if it is empty
+  std::string format;
+  std::string output;
+};
+
+// takes over option_ if it is one of --bench-threads=LIST, --bench-windows=LIST,
+// --bench-modes=LIST, --bench-methods=LIST, --bench-sizes=RxC,...,
+// --bench-images=N, --bench-noise=F, --bench-warmup=N, --bench-reps=N,
+// --bench-reference, --bench-format=text|csv|json or --bench-out=FILE.
+// false if it is none of them or its value is invalid
+bool parse_benchmark_option( const std::string& option_, benchmark_config& config_ );
+
+
+// the timings of one case of the sweep
+struct benchmark_result
+{
+  // float, u8 or u16
+  std::string pixels;
+  // serial, images, rows, tiles (modes 0, 1, 2, 4) or reference
+  std::string strategy;
+  // the method asked for and the one median_filter used
+  std::string method;
+  std::string used_method;
+  int n_threads;
+  int window_size;
+  // "files" or the size of the synthetic images
+  std::string images;
+  int n_images;
+  // pixels of all images together, and the bytes every pixel needs to be
+  // read and written at least once
+  double n_pixels;
+  int bytes_per_pixel;
+  // every timed repetition
+  std::vector< double > seconds;
+  // the output equals that of the serial selection filter
+  bool identical;
+};
+
+// the value below which fraction_ of seconds_ lie (nearest rank)
+double percentile( std::vector< double > seconds_, double fraction_ );
+
+// one line per case with the median and p95 times, pixels per second and
+// the memory bandwidth, in the format of config_, to config_.output or
+// stdout. false if the output can't be written
+bool write_benchmark( const benchmark_config& config_, const std::vector< benchmark_result >& results_ );
+
+
+// a synthetic image: smooth gradients with some texture, a noise_ fraction
+// of the pixels replaced by 0 or 1 (salt and pepper). The intensities are
+// multiples of 1/255, so all pixel types and the histogram methods apply
+template< typename T >
+void make_synthetic_image( int n_rows_, int n_cols_, double noise_, unsigned seed_, basic_image_matrix< T >& image_ );
+
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef BOUNDED_QUEUE_HPP_
+#define BOUNDED_QUEUE_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+// a queue between threads which holds at most capacity_ values: push()
+// waits while it is full and pop() while it is empty. Once closed, pushes
+// fail and pop() returns what is left and then false
+template< typename T >
+class bounded_queue
+{
+  public:
+    explicit bounded_queue( std::size_t capacity_ )
+      : _capacity( capacity_ > 0 ? capacity_ : 1 ),
+	_closed( false )
+    {}
+
+    // false if the queue was closed
+    bool push( T value_ )
+    {
+      std::unique_lock< std::mutex > lock( _mutex );
+      _not_full.wait( lock, [ this ]() { return _values.size() < _capacity || _closed; } );
+      if( _closed )
+      {
+	return false;
+      }
+      _values.push_back( std::move( value_ ) );
+      _not_empty.notify_one();
+      return true;
+    }
+
+    // false once the queue is closed and empty
+    bool pop( T& value_ )
+    {
+      std::unique_lock< std::mutex > lock( _mutex );
+      _not_empty.wait( lock, [ this ]() { return !_values.empty() || _closed; } );
+      return take( value_ );
+    }
+
+    // like pop(), but false instead of waiting
+    bool try_pop( T& value_ )
+    {
+      std::unique_lock< std::mutex > lock( _mutex );
+      return take( value_ );
+    }
+
+    void close()
+    {
+      std::unique_lock< std::mutex > lock( _mutex );
+      _closed = true;
+      _not_empty.notify_all();
+      _not_full.notify_all();
+    }
+
+  private:
+    bounded_queue( const bounded_queue& );
+    bounded_queue& operator=( const bounded_queue& );
+
+    bool take( T& value_ )
+    {
+      if( _values.empty() )
+      {
+	return false;
+      }
+      value_ = std::move( _values.front() );
+      _values.pop_front();
+      _not_full.notify_one();
+      return true;
+    }
+
+    std::size_t _capacity;
+    bool _closed;
+    std::deque< T > _values;
+    std::mutex _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+};
+
+
+#endif
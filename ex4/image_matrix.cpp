@@ -1,51 +1,552 @@
 #include "image_matrix.hpp"
 
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-image_matrix::image_matrix()
+
+namespace
+{
+
+// header of a binary image, followed by the pixels
+struct binary_header
+{
+  char magic[ 4 ];
+  std::int32_t n_rows;
+  std::int32_t n_cols;
+  std::uint32_t type;
+};
+
+const char binary_magic[ 4 ] = { 'F', 'I', 'M', 'G' };
+
+
+// bytes per pixel of a pixel type of a binary image, 0 if unknown
+std::size_t binary_pixel_size( std::uint32_t type_ )
+{
+  switch( type_ )
+  {
+    case pixel_traits< float >::type: return sizeof( float );
+    case pixel_traits< std::uint8_t >::type: return sizeof( std::uint8_t );
+    case pixel_traits< std::uint16_t >::type: return sizeof( std::uint16_t );
+  }
+  return 0;
+}
+
+
+// converts n_ pixels of the binary pixel type type_ at from_ into to_
+template< typename T >
+void convert_pixels( const void* from_, std::uint32_t type_, std::size_t n_, T* to_ )
+{
+  for( std::size_t i = 0; i < n_; i++ )
+  {
+    float value;
+    switch( type_ )
+    {
+      case pixel_traits< std::uint8_t >::type:
+	value = pixel_traits< std::uint8_t >::to_float( static_cast< const std::uint8_t* >( from_ )[ i ] );
+	break;
+      case pixel_traits< std::uint16_t >::type:
+	value = pixel_traits< std::uint16_t >::to_float( static_cast< const std::uint16_t* >( from_ )[ i ] );
+	break;
+      default:
+	value = static_cast< const float* >( from_ )[ i ];
+	break;
+    }
+    to_[ i ] = pixel_traits< T >::from_float( value );
+  }
+}
+
+
+// the powers of ten which are exact in a double
+const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+bool is_space( char c_ )
+{
+  return c_ == ' ' || c_ == '\n' || c_ == '\r' || c_ == '\t' || c_ == '\v' || c_ == '\f';
+}
+
+
+// parses the float at p_ the way strtof (and so istream >>) does, and moves
+// p_ behind it. Decimals with up to 15 digits and a small exponent are exact
+// in a double, one multiplication or division rounds them correctly and only
+// rounding that double to a float can go wrong, when it lies exactly between
+// two floats. Everything else is left to strtof, so the text has to end with a 0
+bool parse_float( const char*& p_, float& value_ )
+{
+  const char* start = p_;
+  const char* p = p_;
+  bool negative = *p == '-';
+  if( *p == '-' || *p == '+' )
+  {
+    p++;
+  }
+  std::uint64_t mantissa = 0;
+  int n_digits = 0;
+  int exponent = 0;
+  bool any_digit = false;
+  bool fast = true;
+  for( ; *p >= '0' && *p <= '9'; p++ )
+  {
+    any_digit = true;
+    if( n_digits < 15 )
+    {
+      mantissa = mantissa * 10 + ( *p - '0' );
+      n_digits += mantissa != 0;
+    }
+    else
+    {
+      fast = false;
+    }
+  }
+  if( *p == '.' )
+  {
+    for( p++; *p >= '0' && *p <= '9'; p++ )
+    {
+      any_digit = true;
+      if( n_digits < 15 )
+      {
+	mantissa = mantissa * 10 + ( *p - '0' );
+	n_digits += mantissa != 0;
+	exponent--;
+      }
+      else
+      {
+	fast = false;
+      }
+    }
+  }
+  if( any_digit && ( *p == 'e' || *p == 'E' ) )
+  {
+    const char* e = p + 1;
+    bool negative_exponent = *e == '-';
+    if( *e == '-' || *e == '+' )
+    {
+      e++;
+    }
+    if( *e >= '0' && *e <= '9' )
+    {
+      int n = 0;
+      for( ; *e >= '0' && *e <= '9'; e++ )
+      {
+	n = n < 1000 ? n * 10 + ( *e - '0' ) : n;
+      }
+      exponent += negative_exponent ? -n : n;
+      p = e;
+    }
+  }
+  if( any_digit && fast && exponent >= -22 && exponent <= 22 )
+  {
+    double value = static_cast< double >( mantissa );
+    value = exponent < 0 ? value / powers_of_ten[ -exponent ] : value * powers_of_ten[ exponent ];
+    std::uint64_t bits;
+    std::memcpy( &bits, &value, sizeof( bits ) );
+    // the 29 bits a float drops, and normal floats only
+    bool halfway = ( bits & 0x1fffffff ) == 0x10000000;
+    if( value == 0.0 || ( !halfway && value >= 1.1754944e-38 && value <= 3.4028234e38 ) )
+    {
+      value_ = static_cast< float >( negative ? -value : value );
+      p_ = p;
+      return true;
+    }
+  }
+  char* stop;
+  value_ = std::strtof( start, &stop );
+  p_ = stop;
+  return stop != start;
+}
+
+
+// writes value_ like printf( "%g" ) (and so ostream <<) does and returns the
+// end. A float times a power of ten up to 10^9 is exact in a double, so for
+// the values printed without an exponent the 6 digits are found by rounding
+// that product once. The others go through snprintf
+char* format_float( float value_, char* out_ )
+{
+  double value = std::fabs( static_cast< double >( value_ ) );
+  if( value == 0.0 )
+  {
+    if( std::signbit( value_ ) )
+    {
+      *out_++ = '-';
+    }
+    *out_++ = '0';
+    return out_;
+  }
+  if( value >= 1e-5 && value < 1e6 )
+  {
+    // scale to [1e5, 1e6)
+    int n = 0;
+    double scaled = value;
+    while( scaled < 1e5 && n < 9 )
+    {
+      n++;
+      scaled = value * powers_of_ten[ n ];
+    }
+    double rounded = std::nearbyint( scaled );
+    int exponent = 5 - n;
+    if( rounded >= 1e6 )
+    {
+      rounded = 1e5;
+      exponent++;
+    }
+    if( rounded >= 1e5 && exponent >= -4 && exponent < 6 )
+    {
+      char digits[ 6 ];
+      long d = static_cast< long >( rounded );
+      for( int i = 5; i >= 0; i-- )
+      {
+	digits[ i ] = '0' + d % 10;
+	d /= 10;
+      }
+      int n_digits = 6;
+      while( digits[ n_digits - 1 ] == '0' )
+      {
+	n_digits--;
+      }
+      if( value_ < 0 )
+      {
+	*out_++ = '-';
+      }
+      if( exponent >= 0 )
+      {
+	for( int i = 0; i <= exponent; i++ )
+	{
+	  *out_++ = digits[ i ];
+	}
+	if( n_digits > exponent + 1 )
+	{
+	  *out_++ = '.';
+	  for( int i = exponent + 1; i < n_digits; i++ )
+	  {
+	    *out_++ = digits[ i ];
+	  }
+	}
+      }
+      else
+      {
+	*out_++ = '0';
+	*out_++ = '.';
+	for( int i = -1; i > exponent; i-- )
+	{
+	  *out_++ = '0';
+	}
+	for( int i = 0; i < n_digits; i++ )
+	{
+	  *out_++ = digits[ i ];
+	}
+      }
+      return out_;
+    }
+  }
+  return out_ + std::snprintf( out_, 16, "%g", static_cast< double >( value_ ) );
+}
+
+
+bool read_file( const std::string& filename_, std::vector< char >& text_ )
+{
+  std::FILE* file = std::fopen( filename_.c_str(), "rb" );
+  if( file == NULL )
+  {
+    return false;
+  }
+  text_.clear();
+  char buffer[ 65536 ];
+  std::size_t n;
+  while( ( n = std::fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+  {
+    text_.insert( text_.end(), buffer, buffer + n );
+  }
+  bool ok = !std::ferror( file );
+  std::fclose( file );
+  return ok;
+}
+
+}
+
+
+template< typename T >
+basic_image_matrix< T >::basic_image_matrix()
+  : _n_rows( 0 ),
+    _n_cols( 0 ),
+    _pixels( NULL ),
+    _mapping( NULL ),
+    _mapping_size( 0 )
 {}
 
 
-image_matrix::image_matrix( int n_rows_, int n_cols_ )
+template< typename T >
+basic_image_matrix< T >::basic_image_matrix( int n_rows_, int n_cols_ )
   : _n_rows( n_rows_ ),
-    _n_cols( n_cols_ )
+    _n_cols( n_cols_ ),
+    _mapping( NULL ),
+    _mapping_size( 0 )
+{
+  _data.resize( _n_rows * _n_cols, T() );
+  _pixels = _data.data();
+}
+
+
+template< typename T >
+basic_image_matrix< T >::basic_image_matrix( const basic_image_matrix& other_ )
+  : _data( other_.data(), other_.data() + other_._n_rows * other_._n_cols ),
+    _n_rows( other_._n_rows ),
+    _n_cols( other_._n_cols ),
+    _mapping( NULL ),
+    _mapping_size( 0 )
+{
+  _pixels = _data.data();
+}
+
+
+template< typename T >
+basic_image_matrix< T >& basic_image_matrix< T >::operator=( const basic_image_matrix& other_ )
 {
-  _data.resize( _n_rows * _n_cols, 0.0f );
+  if( this != &other_ )
+  {
+    std::vector< T > data( other_.data(), other_.data() + other_._n_rows * other_._n_cols );
+    unmap();
+    _data.swap( data );
+    _n_rows = other_._n_rows;
+    _n_cols = other_._n_cols;
+    _pixels = _data.data();
+  }
+  return *this;
 }
 
 
-image_matrix::~image_matrix()
+template< typename T >
+basic_image_matrix< T >::~basic_image_matrix()
 {
+  unmap();
   _data.clear();
 }
 
 
-int image_matrix::get_n_rows() const
+template< typename T >
+void basic_image_matrix< T >::unmap()
+{
+  if( _mapping != NULL )
+  {
+    munmap( _mapping, _mapping_size );
+  }
+  _mapping = NULL;
+  _mapping_size = 0;
+}
+
+
+template< typename T >
+int basic_image_matrix< T >::get_n_rows() const
 {
   return _n_rows;
 }
 
 
-int image_matrix::get_n_cols() const
+template< typename T >
+int basic_image_matrix< T >::get_n_cols() const
 {
   return _n_cols;
 }
 
 
-void image_matrix::resize( int n_rows_, int n_cols_ )
+template< typename T >
+void basic_image_matrix< T >::resize( int n_rows_, int n_cols_ )
 {
+  if( _mapping != NULL )
+  {
+    _data.assign( _pixels, _pixels + _n_rows * _n_cols );
+    unmap();
+  }
   _n_rows = n_rows_;
   _n_cols = n_cols_;
-  _data.resize( _n_rows * _n_cols, 0.0f );
+  _data.resize( _n_rows * _n_cols, T() );
+  _pixels = _data.data();
 }
 
 
-float image_matrix::get_pixel( int r_, int c_ ) const
+template< typename T >
+T basic_image_matrix< T >::get_pixel( int r_, int c_ ) const
 {
-  return _data[ r_ * _n_cols + c_ ];
+  return _pixels[ r_ * _n_cols + c_ ];
 }
 
 
-void image_matrix::set_pixel( int r_, int c_, float value_ )
+template< typename T >
+void basic_image_matrix< T >::set_pixel( int r_, int c_, T value_ )
+{
+  _pixels[ r_ * _n_cols + c_ ] = value_;
+}
+
+
+template< typename T >
+const T* basic_image_matrix< T >::data() const
+{
+  return _pixels;
+}
+
+
+template< typename T >
+T* basic_image_matrix< T >::data()
+{
+  return _pixels;
+}
+
+
+template< typename T >
+bool basic_image_matrix< T >::load( const std::string& filename_ )
+{
+  int fd = open( filename_.c_str(), O_RDONLY );
+  if( fd < 0 )
+  {
+    return false;
+  }
+  struct stat st;
+  binary_header header;
+  bool binary = fstat( fd, &st ) == 0 && st.st_size >= static_cast< off_t >( sizeof( header ) )
+    && pread( fd, &header, sizeof( header ), 0 ) == static_cast< ssize_t >( sizeof( header ) )
+    && std::memcmp( header.magic, binary_magic, sizeof( binary_magic ) ) == 0;
+  if( binary )
+  {
+    std::size_t n_pixels = static_cast< std::size_t >( header.n_rows ) * header.n_cols;
+    std::size_t pixel_size = binary_pixel_size( header.type );
+    if( pixel_size == 0 || header.n_rows < 0 || header.n_cols < 0
+	|| static_cast< std::size_t >( st.st_size ) < sizeof( header ) + n_pixels * pixel_size )
+    {
+      close( fd );
+      return false;
+    }
+    // a private mapping, so set_pixel() does not write to the file
+    void* mapping = NULL;
+    if( n_pixels > 0 )
+    {
+      mapping = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+      if( mapping == MAP_FAILED )
+      {
+	close( fd );
+	return false;
+      }
+    }
+    close( fd );
+    if( header.type != pixel_traits< T >::type )
+    {
+      resize( header.n_rows, header.n_cols );
+      convert_pixels( static_cast< char* >( mapping ) + sizeof( header ), header.type, n_pixels, _pixels );
+      if( mapping != NULL )
+      {
+	munmap( mapping, st.st_size );
+      }
+      return true;
+    }
+    unmap();
+    std::vector< T >().swap( _data );
+    _mapping = mapping;
+    _mapping_size = st.st_size;
+    _n_rows = header.n_rows;
+    _n_cols = header.n_cols;
+    _pixels = mapping != NULL ? reinterpret_cast< T* >( static_cast< char* >( mapping ) + sizeof( header ) ) : NULL;
+    return true;
+  }
+  close( fd );
+
+  std::vector< char > text;
+  if( !read_file( filename_, text ) )
+  {
+    return false;
+  }
+  text.push_back( '\0' );
+  const char* p = text.data();
+  char* end;
+  long n_rows = std::strtol( p, &end, 10 );
+  long n_cols = std::strtol( end, &end, 10 );
+  if( end == p || n_rows < 0 || n_cols < 0 )
+  {
+    return false;
+  }
+  p = end;
+  resize( n_rows, n_cols );
+  T* pixel = _pixels;
+  T* last = _pixels + n_rows * n_cols;
+  for( ; pixel != last; pixel++ )
+  {
+    while( is_space( *p ) )
+    {
+      p++;
+    }
+    float value;
+    if( !parse_float( p, value ) )
+    {
+      return false;
+    }
+    *pixel = pixel_traits< T >::from_float( value );
+  }
+  return true;
+}
+
+
+template< typename T >
+bool basic_image_matrix< T >::save_text( const std::string& filename_ ) const
+{
+  std::FILE* file = std::fopen( filename_.c_str(), "w" );
+  if( file == NULL )
+  {
+    return false;
+  }
+  // a row at a time, no pixel takes more than 16 characters
+  std::vector< char > line( _n_cols * 17 + 32 );
+  int length = std::sprintf( line.data(), "%d\n%d\n", _n_rows, _n_cols );
+  std::fwrite( line.data(), 1, length, file );
+  for( int r = 0; r < _n_rows; r++ )
+  {
+    char* p = line.data();
+    const T* row = _pixels + r * _n_cols;
+    for( int c = 0; c < _n_cols; c++ )
+    {
+      p = format_float( pixel_traits< T >::to_float( row[ c ] ), p );
+      *p++ = ' ';
+    }
+    *p++ = '\n';
+    std::fwrite( line.data(), 1, p - line.data(), file );
+  }
+  bool ok = !std::ferror( file );
+  return std::fclose( file ) == 0 && ok;
+}
+
+
+template< typename T >
+bool basic_image_matrix< T >::save_binary( const std::string& filename_ ) const
+{
+  std::FILE* file = std::fopen( filename_.c_str(), "wb" );
+  if( file == NULL )
+  {
+    return false;
+  }
+  binary_header header;
+  std::memcpy( header.magic, binary_magic, sizeof( binary_magic ) );
+  header.n_rows = _n_rows;
+  header.n_cols = _n_cols;
+  header.type = pixel_traits< T >::type;
+  std::size_t n_pixels = static_cast< std::size_t >( _n_rows ) * _n_cols;
+  bool ok = std::fwrite( &header, sizeof( header ), 1, file ) == 1
+    && std::fwrite( _pixels, sizeof( T ), n_pixels, file ) == n_pixels;
+  return std::fclose( file ) == 0 && ok;
+}
+
+
+template class basic_image_matrix< float >;
+template class basic_image_matrix< std::uint8_t >;
+template class basic_image_matrix< std::uint16_t >;
+
+
+bool is_binary_image_name( const std::string& filename_ )
 {
-  _data[ r_ * _n_cols + c_ ] = value_;
+  return filename_.size() >= 4 && filename_.compare( filename_.size() - 4, 4, ".bin" ) == 0;
 }
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+
+#include "image_matrix.hpp"
+
+
+// converts an image between the text and the binary format, the format
+// written is given by the name of the output (binary if it ends in .bin)
+int main( int argc, char* argv[] )
+{
+  if( argc != 3 )
+  {
+    std::cerr << "Usage: " << argv[ 0 ] << " INPUT OUTPUT. Terminating." << std::endl;
+    return 1;
+  }
+  image_matrix image;
+  if( !image.load( argv[ 1 ] ) )
+  {
+    std::cerr << "Could not read " << argv[ 1 ] << ". Terminating." << std::endl;
+    return 1;
+  }
+  std::string output( argv[ 2 ] );
+  bool ok = is_binary_image_name( output ) ? image.save_binary( output ) : image.save_text( output );
+  if( !ok )
+  {
+    std::cerr << "Could not write " << output << ". Terminating." << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -3,6 +3,10 @@
 #include <fstream>
 #include <algorithm>
 #include <cstdlib>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
 
 #include <string>
 #include <sstream>
@@ -10,186 +14,445 @@
 #include <omp.h>
 
 #include "image_matrix.hpp"
+#include "benchmark.hpp"
+#include "bounded_queue.hpp"
+#include "median_filter.hpp"
+#include "work_stealing.hpp"
 
-bool write_filtered_image( const std::string& filename_, const image_matrix& image_out_ );
+template< typename T >
+bool read_input_image( const std::string& filename_, basic_image_matrix< T >& image_in_ );
 
-float median_filter_pixel( const image_matrix& input_image_,
-						   int r_,
-						   int c_,
-						   int window_size_ )
-{
-	int n_rows = input_image_.get_n_rows();
-	int n_cols = input_image_.get_n_cols();
-	
-	float filtered_value;
-	std::vector<float> window_vector;
-	
-	//for every p(r,c), we begin at r - window_size/2 and stop at r + window_size/2
-	//since there is a possibility to start at a location which is out of bound (i.e. p(r,c) is at the left edge)
-	//we only allow starting points which are greater than or equal to 0
-	for (int i = std::max(0, r_ - window_size_/2); i <= r_ + window_size_/2; i++) {
-		//if we are to overstep the right corner, we stop and go to the next row
-		if (i >= n_rows) { break; }
-		//the same logic as above applies here, only now for columns instead of rows
-		for (int j = std::max(0, c_ - window_size_/2); j <= c_ + window_size_/2; j++) {
-			if (j >= n_cols) { break; }
-			window_vector.push_back(input_image_.get_pixel(i, j));    
-		}
-	}
+template< typename T >
+bool write_filtered_image( const std::string& filename_, const basic_image_matrix< T >& image_out_ );
 
-	//we need to sort the vector to calculate the median
-	std::sort(window_vector.begin(), window_vector.end());
-	if (window_vector.size() % 2 != 0) {
-		filtered_value = window_vector[window_vector.size() / 2];
-	} else {
-		filtered_value = (window_vector[window_vector.size() / 2 - 1] + window_vector[window_vector.size() / 2])/2;
-	}
-	
-	return filtered_value;
-}
-
-void serialExecution(const std::vector<image_matrix>& input_images_,
-			   std::vector<image_matrix>& output_images_, int window_size_, int n_threads_, int mode_) {
+template< typename T >
+void serialExecution(const std::vector< basic_image_matrix< T > >& input_images_,
+			   std::vector< basic_image_matrix< T > >& output_images_, int window_size_, int n_threads_, int mode_,
+			   median_method method_) {
   //if mode == 1, we use the parallel approach at an image level to fix the wrong pixels
   //we use chunksize 1 such that every thread does not more than one iteration at a time
   //we don't need to define any scope for the variables since each thread accesses its own image from
   //input_images_, which has scoped "shared" by default. Local variables are by default private so we're save
 	#pragma omp parallel for num_threads(n_threads_) if(mode_ == 1) schedule(static, 1)
 	for (int i = 0; i < input_images_.size(); i++) {
-		int n_rows = input_images_[i].get_n_rows();
-		int n_cols = input_images_[i].get_n_cols();
-
-		for( int r = 0; r < n_rows; r++ ) {
-	  		for( int c = 0; c < n_cols; c++ ) {
-			float p_rc_filt = median_filter_pixel( input_images_[i], r, c, window_size_);
-			output_images_[i].set_pixel( r, c, p_rc_filt );		  	
-			}
-		}
+		basic_median_filter< T > filter( input_images_[i], window_size_, method_ );
+		filter.filter_rows( output_images_[i], 0, input_images_[i].get_n_rows() );
 	}
 }
 
-void parallelExecution(const std::vector<image_matrix>& input_images_,
-			   std::vector<image_matrix>& output_images_, int window_size_, int n_threads_) {
+template< typename T >
+void parallelExecution(const std::vector< basic_image_matrix< T > >& input_images_,
+			   std::vector< basic_image_matrix< T > >& output_images_, int window_size_, int n_threads_,
+			   median_method method_) {
   //parallel at pixel level
   //therefore, we loop through every image from input_images_
   //and do the fixing stuff with multiple threads
 	for (int i = 0; i < input_images_.size(); i++) {
 		int n_rows = input_images_[i].get_n_rows();
-		int n_cols = input_images_[i].get_n_cols();
+		basic_median_filter< T > filter( input_images_[i], window_size_, method_ );
 
-		int chunkSize = n_rows / n_threads_;
+		//every thread gets one chunk of rows, at least one row even if there are more threads than rows,
+		//and filters it in one go so the histogram methods slide over the whole chunk
+		int chunkSize = std::max( 1, ( n_rows + n_threads_ - 1 ) / n_threads_ );
 
     //again: local variables are by default private and output_images_ is by default shared so no 
     //need to define any scope for the variables
-		#pragma omp parallel for num_threads(n_threads_) schedule(static, chunkSize)
-		for( int r = 0; r < n_rows; r++ ) {
-	  		for( int c = 0; c < n_cols; c++ ) {
-			      float p_rc_filt = median_filter_pixel( input_images_[i], r, c, window_size_);
-			      output_images_[i].set_pixel( r, c, p_rc_filt );		  	
-			  }
+		#pragma omp parallel for num_threads(n_threads_) schedule(static, 1)
+		for( int first = 0; first < n_rows; first += chunkSize ) {
+			filter.filter_rows( output_images_[i], first, std::min( n_rows, first + chunkSize ) );
+		}
+	}
+}
+
+// rows of the images are cut into tiles of about this many pixels, but at
+// least a window high so the histogram methods don't spend their time
+// building the first window of each tile
+const int tile_pixels = 32768;
+
+template< typename T >
+void filterTiles(const std::vector< const basic_image_matrix< T >* >& input_images_,
+			   const std::vector< basic_image_matrix< T >* >& output_images_, int window_size_, int n_threads_,
+			   median_method method_) {
+  //all images of the batch are cut into tiles of whole rows and all tiles go into one work stealing
+  //pool, so small and large images, few or many images and any number of threads keep all threads busy
+	int n_images = input_images_.size();
+
+	//the filters are prepared first, one image per thread
+	std::vector< std::unique_ptr< basic_median_filter< T > > > filters( n_images );
+	#pragma omp parallel for num_threads(n_threads_) schedule(dynamic, 1)
+	for (int i = 0; i < n_images; i++) {
+		filters[i].reset( new basic_median_filter< T >( *input_images_[i], window_size_, method_ ) );
+	}
+
+	struct tile {
+		int image, firstRow, lastRow;
+	};
+	std::vector< tile > tiles;
+	for (int i = 0; i < n_images; i++) {
+		int n_rows = input_images_[i]->get_n_rows();
+		int n_cols = std::max( 1, input_images_[i]->get_n_cols() );
+		int tileRows = std::max( std::max( 1, window_size_ ), tile_pixels / n_cols );
+		for (int first = 0; first < n_rows; first += tileRows) {
+			tile newTile = { i, first, std::min( n_rows, first + tileRows ) };
+			tiles.push_back( newTile );
+		}
+	}
+
+	run_work_stealing( tiles.size(), n_threads_, [&]( int t_ ) {
+		const tile& t = tiles[t_];
+		filters[t.image]->filter_rows( *output_images_[t.image], t.firstRow, t.lastRow );
+	} );
+}
+
+template< typename T >
+void tiledExecution(const std::vector< basic_image_matrix< T > >& input_images_,
+			   std::vector< basic_image_matrix< T > >& output_images_, int window_size_, int n_threads_,
+			   median_method method_) {
+	std::vector< const basic_image_matrix< T >* > inputs;
+	std::vector< basic_image_matrix< T >* > outputs;
+	for (std::size_t i = 0; i < input_images_.size(); i++) {
+		inputs.push_back( &input_images_[i] );
+		outputs.push_back( &output_images_[i] );
+	}
+	filterTiles( inputs, outputs, window_size_, n_threads_, method_ );
+}
+
+// threads of the pipeline which read and write images, the filtering uses n_threads
+const int n_reader_threads = 2;
+const int n_writer_threads = 1;
+
+template< typename T >
+bool pipelinedExecution(const std::vector< std::string >& filenames_, int window_size_, int n_threads_,
+			   median_method method_, int max_in_flight_) {
+  //reading, filtering and writing overlap: readers load the images into a bounded queue, the filter
+  //stage takes every image which is ready and filters them together in tiles, writers store the results.
+  //At most max_in_flight_ images (with their outputs) are in memory at a time, a reader waits for a
+  //writer to give back a slot before it loads the next image. An image which can't be read is skipped,
+  //false if any image could not be read or written
+	struct job {
+		int index;
+		basic_image_matrix< T > input;
+		basic_image_matrix< T > output;
+	};
+	typedef std::unique_ptr< job > job_ptr;
+
+	int max_in_flight = std::max( 1, max_in_flight_ );
+	bounded_queue< int > slots( max_in_flight );
+	for (int i = 0; i < max_in_flight; i++) {
+		slots.push( i );
+	}
+	bounded_queue< job_ptr > loaded( max_in_flight );
+	bounded_queue< job_ptr > filtered( max_in_flight );
+
+	std::atomic< int > next_file( 0 );
+	std::atomic< int > readers_left( n_reader_threads );
+	std::atomic< bool > failed( false );
+	std::vector< std::thread > readers;
+	for (int i = 0; i < n_reader_threads; i++) {
+		readers.push_back( std::thread( [&]() {
+			int slot;
+			for (std::size_t f = next_file++; f < filenames_.size() && slots.pop( slot ); f = next_file++) {
+				job_ptr newJob( new job );
+				newJob->index = f;
+				if (!read_input_image( filenames_[f], newJob->input )) {
+					std::cerr << "Could not read " << filenames_[f] << ". Skipping it." << std::endl;
+					failed = true;
+					slots.push( slot );
+					continue;
+				}
+				newJob->output.resize( newJob->input.get_n_rows(), newJob->input.get_n_cols() );
+				loaded.push( std::move( newJob ) );
+			}
+			//the last reader tells the filter stage that no more images come
+			if (--readers_left == 0) {
+				loaded.close();
+			}
+		} ) );
+	}
+	std::vector< std::thread > writers;
+	for (int i = 0; i < n_writer_threads; i++) {
+		writers.push_back( std::thread( [&]() {
+			job_ptr done;
+			while (filtered.pop( done )) {
+				if (!write_filtered_image( "OUT_" + filenames_[done->index], done->output )) {
+					std::cerr << "Could not write OUT_" << filenames_[done->index] << "." << std::endl;
+					failed = true;
+				}
+				done.reset();
+				slots.push( 0 );
+			}
+		} ) );
+	}
+
+	job_ptr first;
+	while (loaded.pop( first )) {
+		std::vector< job_ptr > batch;
+		batch.push_back( std::move( first ) );
+		job_ptr more;
+		while (loaded.try_pop( more )) {
+			batch.push_back( std::move( more ) );
+		}
+		std::vector< const basic_image_matrix< T >* > inputs;
+		std::vector< basic_image_matrix< T >* > outputs;
+		for (std::size_t i = 0; i < batch.size(); i++) {
+			inputs.push_back( &batch[i]->input );
+			outputs.push_back( &batch[i]->output );
 		}
+		filterTiles( inputs, outputs, window_size_, n_threads_, method_ );
+		for (std::size_t i = 0; i < batch.size(); i++) {
+			//the input is not needed anymore while the output waits for a writer
+			batch[i]->input = basic_image_matrix< T >();
+			filtered.push( std::move( batch[i] ) );
+		}
+	}
+	filtered.close();
+	for (std::size_t i = 0; i < readers.size(); i++) {
+		readers[i].join();
 	}
+	for (std::size_t i = 0; i < writers.size(); i++) {
+		writers[i].join();
+	}
+	return !failed;
 }
 
-void median_filter_images( const std::vector<image_matrix>& input_images_,
-			   std::vector<image_matrix>& output_images_,
+template< typename T >
+void median_filter_images( const std::vector< basic_image_matrix< T > >& input_images_,
+			   std::vector< basic_image_matrix< T > >& output_images_,
 			   const int window_size_,
 			   const int n_threads_,
-			   const int mode_ )
+			   const int mode_,
+			   const median_method method_ )
 {
   // perform filtering of input_images_, selecting the appropriate algorithm based on mode_
 	switch (mode_) {
     //mode 1 and 2 are basically the same, except that mode 2 is a parallel approach of mode 1 so 
     //we fall through case 0 and check inside the pragma statement if we should use the parallel approach or not
 		case 0: 
-		case 1: serialExecution(input_images_, output_images_, window_size_, n_threads_, mode_);
+		case 1: serialExecution(input_images_, output_images_, window_size_, n_threads_, mode_, method_);
+				break;
+		case 2: parallelExecution(input_images_, output_images_, window_size_, n_threads_, method_);
 				break;
-		case 2: parallelExecution(input_images_, output_images_, window_size_, n_threads_);
+		case 4: tiledExecution(input_images_, output_images_, window_size_, n_threads_, method_);
 				break;
 	}
 }
 
-bool read_input_image( const std::string& filename_, image_matrix& image_in_ )
+// read a text or binary image from filename_ into image_in_
+template< typename T >
+bool read_input_image( const std::string& filename_, basic_image_matrix< T >& image_in_ )
 {
-  bool ret = false;
-  std::ifstream is( filename_.c_str() );
-  if( is.is_open() )
-  {
-    int n_rows;
-    int n_cols;
+  return image_in_.load( filename_ );
+}
 
-    is >> n_rows;
-    is >> n_cols;
 
-    image_in_.resize( n_rows, n_cols );
 
-    for( int r = 0; r < n_rows; r++ )
-    {
-      for( int c = 0; c < n_cols; c++ )
-      {
-        float value;
-        is >> value;
-        image_in_.set_pixel( r, c, value );
-      }
-    }
-    is.close();
-    ret = true;
+// write image_out_ to filename_, binary if the name ends in .bin
+template< typename T >
+bool write_filtered_image( const std::string& filename_, const basic_image_matrix< T >& image_out_ )
+{
+  if( is_binary_image_name( filename_ ) )
+  {
+    return image_out_.save_binary( filename_ );
   }
-  return ret;
+  return image_out_.save_text( filename_ );
 }
 
 
 
-bool write_filtered_image( const std::string& filename_, const image_matrix& image_out_ )
+// the benchmark of mode 3: every combination of image set, window size, method, mode and number of
+// threads is run config.warmup times untimed and config.repetitions times timed, and its output is
+// checked against the serial selection filter
+template< typename T >
+bool benchmark_images( const std::vector< std::string >& filenames, int window_size, int n_threads,
+                       median_method method, const std::string& pixels, benchmark_config config )
 {
-  bool ret = false;
-  std::ofstream os( filename_.c_str() );
-  if( os.is_open() )
+  if( config.threads.empty() )
+  {
+    config.threads.push_back( n_threads );
+  }
+  if( config.windows.empty() )
   {
-    int n_rows = image_out_.get_n_rows();
-    int n_cols = image_out_.get_n_cols();
+    config.windows.push_back( window_size );
+  }
+  if( config.methods.empty() )
+  {
+    config.methods.push_back( method );
+  }
+  if( config.sizes.empty() && filenames.empty() )
+  {
+    config.sizes.push_back( std::make_pair( 512, 512 ) );
+  }
 
-    os << n_rows << std::endl;
-    os << n_cols << std::endl;
+  // the image sets: the input files, or synthetic images of every size
+  std::vector< std::vector< basic_image_matrix< T > > > sets;
+  std::vector< std::string > set_names;
+  if( config.sizes.empty() )
+  {
+    sets.push_back( std::vector< basic_image_matrix< T > >( filenames.size() ) );
+    set_names.push_back( "files" );
+    for( std::size_t i = 0; i < filenames.size(); i++ )
+    {
+      read_input_image( filenames[ i ], sets.back()[ i ] );
+    }
+  }
+  for( std::size_t s = 0; s < config.sizes.size(); s++ )
+  {
+    sets.push_back( std::vector< basic_image_matrix< T > >( config.n_images ) );
+    set_names.push_back( std::to_string( config.sizes[ s ].first ) + "x" + std::to_string( config.sizes[ s ].second ) );
+    for( int i = 0; i < config.n_images; i++ )
+    {
+      make_synthetic_image( config.sizes[ s ].first, config.sizes[ s ].second, config.noise, i, sets.back()[ i ] );
+    }
+  }
+
+  const char* strategy_names[] = { "serial", "images", "rows", "", "tiles" };
+  std::vector< benchmark_result > results;
+  for( std::size_t s = 0; s < sets.size(); s++ )
+  {
+    const std::vector< basic_image_matrix< T > >& input_images = sets[ s ];
+    int n_images = input_images.size();
+    double n_pixels = 0;
+    for( int i = 0; i < n_images; i++ )
+    {
+      n_pixels += double( input_images[ i ].get_n_rows() ) * input_images[ i ].get_n_cols();
+    }
+    std::vector< basic_image_matrix< T > > expected_images( n_images );
+    std::vector< basic_image_matrix< T > > filtered_images( n_images );
 
-    for( int r = 0; r < n_rows; r++ )
+    for( std::size_t w = 0; w < config.windows.size(); w++ )
     {
-      for( int c = 0; c < n_cols; c++ )
+      int window = config.windows[ w ];
+      for( int i = 0; i < n_images; i++ )
       {
-        os << image_out_.get_pixel( r, c ) << " ";
+        expected_images[ i ].resize( input_images[ i ].get_n_rows(), input_images[ i ].get_n_cols() );
+        basic_median_filter< T >( input_images[ i ], window, median_selection )
+          .filter_rows( expected_images[ i ], 0, input_images[ i ].get_n_rows() );
+      }
+
+      benchmark_result result;
+      result.pixels = pixels;
+      result.window_size = window;
+      result.images = set_names[ s ];
+      result.n_images = n_images;
+      result.n_pixels = n_pixels;
+      result.bytes_per_pixel = 2 * sizeof( T );
+
+      for( std::size_t m = 0; m < config.methods.size(); m++ )
+      {
+        result.method = median_method_name( config.methods[ m ] );
+        result.used_method = n_images > 0 ? median_method_name(
+          basic_median_filter< T >( input_images[ 0 ], window, config.methods[ m ] ).method() ) : "";
+        for( std::size_t mode = 0; mode < config.modes.size(); mode++ )
+        {
+          result.strategy = strategy_names[ config.modes[ mode ] ];
+          // the serial mode does not depend on the number of threads
+          int n_sweeps = config.modes[ mode ] == 0 ? 1 : config.threads.size();
+          for( int t = 0; t < n_sweeps; t++ )
+          {
+            result.n_threads = config.modes[ mode ] == 0 ? 1 : config.threads[ t ];
+            result.seconds.clear();
+            for( int run = 0; run < config.warmup + config.repetitions; run++ )
+            {
+              //the output is cleared first, so the check sees what this run wrote
+              for( int i = 0; i < n_images; i++ )
+              {
+                filtered_images[ i ].resize( 0, 0 );
+                filtered_images[ i ].resize( input_images[ i ].get_n_rows(), input_images[ i ].get_n_cols() );
+              }
+              double start = omp_get_wtime();
+              median_filter_images( input_images, filtered_images, window, result.n_threads, config.modes[ mode ],
+                                    config.methods[ m ] );
+              double end = omp_get_wtime();
+              if( run >= config.warmup )
+              {
+                result.seconds.push_back( end - start );
+              }
+            }
+            result.identical = true;
+            for( int i = 0; i < n_images; i++ )
+            {
+              int n = input_images[ i ].get_n_rows() * input_images[ i ].get_n_cols();
+              result.identical = result.identical
+                && std::equal( filtered_images[ i ].data(), filtered_images[ i ].data() + n, expected_images[ i ].data() );
+            }
+            results.push_back( result );
+          }
+        }
+      }
+
+      // the original filter, which builds and sorts the window of every pixel
+      if( config.reference )
+      {
+        result.strategy = "reference";
+        result.method = "";
+        result.used_method = "";
+        result.n_threads = 1;
+        result.seconds.clear();
+        for( int run = 0; run < config.warmup + config.repetitions; run++ )
+        {
+          double start = omp_get_wtime();
+          for( int i = 0; i < n_images; i++ )
+          {
+            int n_rows = input_images[ i ].get_n_rows();
+            int n_cols = input_images[ i ].get_n_cols();
+            filtered_images[ i ].resize( n_rows, n_cols );
+            for( int r = 0; r < n_rows; r++ )
+            {
+              for( int c = 0; c < n_cols; c++ )
+              {
+                filtered_images[ i ].set_pixel( r, c, median_filter_pixel( input_images[ i ], r, c, window ) );
+              }
+            }
+          }
+          double end = omp_get_wtime();
+          if( run >= config.warmup )
+          {
+            result.seconds.push_back( end - start );
+          }
+        }
+        result.identical = true;
+        for( int i = 0; i < n_images; i++ )
+        {
+          int n = input_images[ i ].get_n_rows() * input_images[ i ].get_n_cols();
+          result.identical = result.identical
+            && std::equal( filtered_images[ i ].data(), filtered_images[ i ].data() + n, expected_images[ i ].data() );
+        }
+        results.push_back( result );
       }
-      os << std::endl;
     }
-    os.close();
-    ret = true;
   }
-  return ret;
+  return write_benchmark( config, results );
 }
 
 
-
-int main( int argc, char* argv[] )
+// reads, filters and writes the images with pixels of type T
+template< typename T >
+int process_images( const std::vector< std::string >& filenames, int window_size, int n_threads, int mode,
+                   median_method method, int max_in_flight, const std::string& pixels,
+                   const benchmark_config& bench )
 {
-  if( argc < 5 )
+  // the benchmark makes or reads its own images
+  if( mode == 3 )
   {
-    std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
-    return 1;
+    if( !benchmark_images< T >( filenames, window_size, n_threads, method, pixels, bench ) )
+    {
+      std::cerr << "Could not write the benchmark results. Terminating." << std::endl;
+      return 1;
+    }
+    return 0;
   }
-  // get input arguments
-  int window_size = atoi( argv[ 1 ] );
-  int n_threads = atoi( argv[ 2 ] );
-  int mode = atoi( argv[ 3 ] );
 
-  int input_images_count = argc - 4;
-  std::vector< std::string > filenames;
-  for( std::size_t f = 0; f < input_images_count; f++ )
+  // the pipeline reads, filters and writes at the same time, the other modes one after the other
+  if( mode == 5 )
   {
-    filenames.push_back( argv[ 4 + f ] );
+    return pipelinedExecution< T >( filenames, window_size, n_threads, method, max_in_flight ) ? 0 : 1;
   }
 
+  int input_images_count = filenames.size();
+
   // input and filtered image matrices
-  std::vector< image_matrix > input_images;
-  std::vector< image_matrix > filtered_images;
+  std::vector< basic_image_matrix< T > > input_images;
+  std::vector< basic_image_matrix< T > > filtered_images;
   input_images.resize( input_images_count );
   filtered_images.resize( input_images_count );
 
@@ -207,36 +470,17 @@ int main( int argc, char* argv[] )
 
   // ***   start actual filtering   ***
   
-  if( mode < 3 )             // serial, parallel at image level or parallel at pixel level   
+  if( mode < 3 || mode == 4 ) // serial, parallel at image level, parallel at pixel level or tiles
   {
     // invoke appropriate filtering routine based on selected mode
     // ...
-    median_filter_images(input_images, filtered_images, window_size, n_threads, mode);
+    median_filter_images(input_images, filtered_images, window_size, n_threads, mode, method);
     // write filtered matrices to text files
     // ...
     for (int i = 0; i < filtered_images.size(); i++) {
       write_filtered_image("OUT_" + filenames[i], filtered_images[i]);
     }
   }
-  else if( mode == 3 )       // benchmark mode
-  {
-    double start;
-    double end;
-    double time[ 3 ];
-    // run filtering in each mode and time each execution
-    // ...
-    for (int i = 0; i < 3; i++) {
-      //since we can't stop the timer, we calculate the starting time from the current time (after the 
-      //execution of the method) to get the benchmark
-  		start = omp_get_wtime();
-    	median_filter_images(input_images, filtered_images, window_size, n_threads, i);
-    	end = omp_get_wtime();
-    	time[i] = end - start;
-          // print timing summary
-          // we use Mode 1 - 4 instead of the input modes 0 - 3
-    	std::cout << "Mode" << i + 1  << ": " << time[i] << std::endl;
-    }
-  }
   else
   {
     std::cerr << "Invalid mode. Terminating" << std::endl;
@@ -245,3 +489,92 @@ int main( int argc, char* argv[] )
 
   return 0;
 }
+
+
+
+int main( int argc, char* argv[] )
+{
+  if( argc < 4 )
+  {
+    std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
+    return 1;
+  }
+  // the optional --median=METHOD, --pixels=TYPE, --in-flight=N and --bench-* options come first
+  median_method method = median_auto;
+  std::string pixels = "float";
+  int max_in_flight = 4;
+  benchmark_config bench;
+  int first_arg = 1;
+  for( ; first_arg < argc && std::string( argv[ first_arg ] ).compare( 0, 2, "--" ) == 0; first_arg++ )
+  {
+    std::string option( argv[ first_arg ] );
+    if( option.compare( 0, 9, "--median=" ) == 0 )
+    {
+      if( !median_method_from_name( option.substr( 9 ), method ) )
+      {
+        std::cerr << "Unknown median method " << option.substr( 9 ) << ". Terminating." << std::endl;
+        return 1;
+      }
+    }
+    else if( option.compare( 0, 9, "--pixels=" ) == 0 && ( option.substr( 9 ) == "float"
+             || option.substr( 9 ) == "u8" || option.substr( 9 ) == "u16" ) )
+    {
+      pixels = option.substr( 9 );
+    }
+    else if( option.compare( 0, 12, "--in-flight=" ) == 0 && atoi( option.c_str() + 12 ) > 0 )
+    {
+      max_in_flight = atoi( option.c_str() + 12 );
+    }
+    else if( option.compare( 0, 8, "--bench-" ) == 0 )
+    {
+      if( !parse_benchmark_option( option, bench ) )
+      {
+        std::cerr << "Invalid benchmark option " << option << ". Terminating." << std::endl;
+        return 1;
+      }
+    }
+    else
+    {
+      std::cerr << "Unknown option " << option << ". Terminating." << std::endl;
+      return 1;
+    }
+  }
+  if( argc - first_arg < 3 )
+  {
+    std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
+    return 1;
+  }
+
+  // get input arguments
+  int window_size = atoi( argv[ first_arg ] );
+  int n_threads = atoi( argv[ first_arg + 1 ] );
+  int mode = atoi( argv[ first_arg + 2 ] );
+
+  std::size_t input_images_count = argc - first_arg - 3;
+  std::vector< std::string > filenames;
+  for( std::size_t f = 0; f < input_images_count; f++ )
+  {
+    filenames.push_back( argv[ first_arg + 3 + f ] );
+  }
+
+  // only the benchmark can do without input files, it makes up images
+  if( input_images_count == 0 && mode != 3 )
+  {
+    std::cerr << "Not enough arguments provided to " << argv[ 0 ] << ". Terminating." << std::endl;
+    return 1;
+  }
+
+  // 8 and 16 bit pixels need a quarter and half of the memory
+  if( pixels == "u8" )
+  {
+    return process_images< std::uint8_t >( filenames, window_size, n_threads, mode, method, max_in_flight, pixels,
+                                          bench );
+  }
+  if( pixels == "u16" )
+  {
+    return process_images< std::uint16_t >( filenames, window_size, n_threads, mode, method, max_in_flight, pixels,
+                                          bench );
+  }
+  return process_images< float >( filenames, window_size, n_threads, mode, method, max_in_flight, pixels,
+                                          bench );
+}
@@ -0,0 +1,1006 @@
+#include "median_filter.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define MEDIAN_X86 1
+#endif
+
+
+namespace
+{
+
+// pixels of one tile. The input a tile needs (the tile grown by the window)
+// fits into L2 for all windows up to 64, the rows of a window into L1
+const int tile_rows = 32;
+const int tile_cols = 128;
+
+
+// the average of the two middle values of a window with an even number of
+// them. Integer pixels round it half up
+inline float middle_average( float a_, float b_ )
+{
+  return ( a_ + b_ ) / 2;
+}
+
+template< typename T >
+inline T middle_average( T a_, T b_ )
+{
+  return ( unsigned( a_ ) + b_ + 1 ) / 2;
+}
+
+
+// orders a_ and b_ so that a_ <= b_
+inline void sort_pair( float& a_, float& b_ )
+{
+  float low = std::min( a_, b_ );
+  b_ = std::max( a_, b_ );
+  a_ = low;
+}
+
+
+// compare-exchange networks after which the middle element holds the median
+// of 9 and 25 values (3x3 and 5x5 windows). Both were checked with all inputs
+// of zeros and ones, which by the 0-1 principle covers all inputs. STEP_( a, b )
+// has to order the elements a and b, the scalar and the SIMD kernels expand
+// the networks into straight code
+#define MEDIAN_9_NETWORK( STEP_ ) \
+  STEP_( 1, 2 ) STEP_( 4, 5 ) STEP_( 7, 8 ) STEP_( 0, 1 ) STEP_( 3, 4 ) STEP_( 6, 7 ) STEP_( 1, 2 ) STEP_( 4, 5 ) \
+  STEP_( 7, 8 ) STEP_( 0, 3 ) STEP_( 5, 8 ) STEP_( 4, 7 ) STEP_( 3, 6 ) STEP_( 1, 4 ) STEP_( 2, 5 ) STEP_( 4, 7 ) \
+  STEP_( 4, 2 ) STEP_( 6, 4 ) STEP_( 4, 2 )
+
+#define MEDIAN_25_NETWORK( STEP_ ) \
+  STEP_( 0, 1 ) STEP_( 3, 4 ) STEP_( 2, 4 ) STEP_( 2, 3 ) STEP_( 6, 7 ) STEP_( 5, 7 ) STEP_( 5, 6 ) STEP_( 9, 10 ) \
+  STEP_( 8, 10 ) STEP_( 8, 9 ) STEP_( 12, 13 ) STEP_( 11, 13 ) STEP_( 11, 12 ) STEP_( 15, 16 ) STEP_( 14, 16 ) STEP_( 14, 15 ) \
+  STEP_( 18, 19 ) STEP_( 17, 19 ) STEP_( 17, 18 ) STEP_( 21, 22 ) STEP_( 20, 22 ) STEP_( 20, 21 ) STEP_( 23, 24 ) STEP_( 2, 5 ) \
+  STEP_( 3, 6 ) STEP_( 0, 6 ) STEP_( 0, 3 ) STEP_( 4, 7 ) STEP_( 1, 7 ) STEP_( 1, 4 ) STEP_( 11, 14 ) STEP_( 8, 14 ) \
+  STEP_( 8, 11 ) STEP_( 12, 15 ) STEP_( 9, 15 ) STEP_( 9, 12 ) STEP_( 13, 16 ) STEP_( 10, 16 ) STEP_( 10, 13 ) STEP_( 20, 23 ) \
+  STEP_( 17, 23 ) STEP_( 17, 20 ) STEP_( 21, 24 ) STEP_( 18, 24 ) STEP_( 18, 21 ) STEP_( 19, 22 ) STEP_( 8, 17 ) STEP_( 9, 18 ) \
+  STEP_( 0, 18 ) STEP_( 0, 9 ) STEP_( 10, 19 ) STEP_( 1, 19 ) STEP_( 1, 10 ) STEP_( 11, 20 ) STEP_( 2, 20 ) STEP_( 2, 11 ) \
+  STEP_( 12, 21 ) STEP_( 3, 21 ) STEP_( 3, 12 ) STEP_( 13, 22 ) STEP_( 4, 22 ) STEP_( 4, 13 ) STEP_( 14, 23 ) STEP_( 5, 23 ) \
+  STEP_( 5, 14 ) STEP_( 15, 24 ) STEP_( 6, 24 ) STEP_( 6, 15 ) STEP_( 7, 16 ) STEP_( 7, 19 ) STEP_( 13, 21 ) STEP_( 15, 23 ) \
+  STEP_( 7, 13 ) STEP_( 7, 15 ) STEP_( 1, 9 ) STEP_( 3, 11 ) STEP_( 5, 17 ) STEP_( 11, 17 ) STEP_( 9, 17 ) STEP_( 4, 10 ) \
+  STEP_( 6, 12 ) STEP_( 7, 14 ) STEP_( 4, 6 ) STEP_( 4, 7 ) STEP_( 12, 14 ) STEP_( 10, 14 ) STEP_( 6, 7 ) STEP_( 10, 12 ) \
+  STEP_( 6, 10 ) STEP_( 6, 17 ) STEP_( 12, 17 ) STEP_( 7, 17 ) STEP_( 7, 10 ) STEP_( 12, 18 ) STEP_( 7, 12 ) STEP_( 10, 18 ) \
+  STEP_( 12, 20 ) STEP_( 10, 20 ) STEP_( 10, 12 )
+
+#define SCALAR_STEP( a_, b_ ) sort_pair( values_[ a_ ], values_[ b_ ] );
+
+
+// median of the n_ values_ (which get reordered) the way median_filter_pixel
+// computes it from the sorted window
+float window_median( float* values_, int n_ )
+{
+  if( n_ == 9 )
+  {
+    MEDIAN_9_NETWORK( SCALAR_STEP )
+    return values_[ 4 ];
+  }
+  if( n_ == 25 )
+  {
+    MEDIAN_25_NETWORK( SCALAR_STEP )
+    return values_[ 12 ];
+  }
+  float* middle = values_ + n_ / 2;
+  std::nth_element( values_, middle, values_ + n_ );
+  if( n_ % 2 != 0 )
+  {
+    return *middle;
+  }
+  // the lower middle value is the largest one in front of the upper one
+  return ( *std::max_element( values_, middle ) + *middle ) / 2;
+}
+
+
+// median of the window around pixel (r_, c_), truncated at the borders,
+// gathered in window_
+inline float gather_median( const float* input_, int n_rows_, int n_cols_, int half_, int r_, int c_,
+			    float* window_ )
+{
+  int first_i = std::max( 0, r_ - half_ );
+  int last_i = std::min( n_rows_ - 1, r_ + half_ );
+  int first_j = std::max( 0, c_ - half_ );
+  int width = std::min( n_cols_ - 1, c_ + half_ ) - first_j + 1;
+  float* end = window_;
+  for( int i = first_i; i <= last_i; i++ )
+  {
+    end = std::copy( input_ + i * n_cols_ + first_j, input_ + i * n_cols_ + first_j + width, end );
+  }
+  return window_median( window_, end - window_ );
+}
+
+
+// filters the pixels from first_c_ on of row r_ up to last_c_, whose W x W
+// windows all lie inside the image, several adjacent pixels at once: element
+// k of all their windows is one unaligned load and the network runs on whole
+// vectors. Returns the first pixel it left to the scalar code
+typedef int ( *interior_kernel )( const float* input_, int n_cols_, float* output_, int r_, int first_c_,
+				  int last_c_ );
+
+#ifdef MEDIAN_X86
+
+#define AVX2_STEP( a_, b_ ) \
+  { __m256 low = _mm256_min_ps( v[ a_ ], v[ b_ ] ); v[ b_ ] = _mm256_max_ps( v[ a_ ], v[ b_ ] ); v[ a_ ] = low; }
+
+#define SSE_STEP( a_, b_ ) \
+  { __m128 low = _mm_min_ps( v[ a_ ], v[ b_ ] ); v[ b_ ] = _mm_max_ps( v[ a_ ], v[ b_ ] ); v[ a_ ] = low; }
+
+
+// 8 pixels at a time
+template< int W >
+__attribute__(( target( "avx2" ) ))
+int filter_interior_avx2( const float* input_, int n_cols_, float* output_, int r_, int first_c_, int last_c_ )
+{
+  int c = first_c_;
+  for( ; c + 8 <= last_c_; c += 8 )
+  {
+    const float* window = input_ + ( r_ - W / 2 ) * n_cols_ + c - W / 2;
+    __m256 v[ 25 ];
+    for( int i = 0; i < W; i++ )
+    {
+      for( int j = 0; j < W; j++ )
+      {
+	v[ i * W + j ] = _mm256_loadu_ps( window + i * n_cols_ + j );
+      }
+    }
+    if( W == 3 )
+    {
+      MEDIAN_9_NETWORK( AVX2_STEP )
+    }
+    else
+    {
+      MEDIAN_25_NETWORK( AVX2_STEP )
+    }
+    _mm256_storeu_ps( output_ + r_ * n_cols_ + c, v[ W * W / 2 ] );
+  }
+  return c;
+}
+
+
+// 4 pixels at a time, for cpus without AVX2
+template< int W >
+__attribute__(( target( "sse2" ) ))
+int filter_interior_sse( const float* input_, int n_cols_, float* output_, int r_, int first_c_, int last_c_ )
+{
+  int c = first_c_;
+  for( ; c + 4 <= last_c_; c += 4 )
+  {
+    const float* window = input_ + ( r_ - W / 2 ) * n_cols_ + c - W / 2;
+    __m128 v[ 25 ];
+    for( int i = 0; i < W; i++ )
+    {
+      for( int j = 0; j < W; j++ )
+      {
+	v[ i * W + j ] = _mm_loadu_ps( window + i * n_cols_ + j );
+      }
+    }
+    if( W == 3 )
+    {
+      MEDIAN_9_NETWORK( SSE_STEP )
+    }
+    else
+    {
+      MEDIAN_25_NETWORK( SSE_STEP )
+    }
+    _mm_storeu_ps( output_ + r_ * n_cols_ + c, v[ W * W / 2 ] );
+  }
+  return c;
+}
+
+#endif
+
+
+// the SIMD kernel for windows reaching half_ pixels from their center, NULL
+// if there is none for this size or cpu or kernel_ asks for the scalar code
+interior_kernel select_interior_kernel( int half_, median_kernel kernel_ )
+{
+#ifdef MEDIAN_X86
+  bool avx2 = kernel_ == kernel_avx2 || ( kernel_ == kernel_auto && median_kernel_supported( kernel_avx2 ) );
+  bool sse = kernel_ == kernel_sse || ( kernel_ == kernel_auto && median_kernel_supported( kernel_sse ) );
+  if( half_ == 1 && ( avx2 || sse ) )
+  {
+    return avx2 ? filter_interior_avx2< 3 > : filter_interior_sse< 3 >;
+  }
+  if( half_ == 2 && ( avx2 || sse ) )
+  {
+    return avx2 ? filter_interior_avx2< 5 > : filter_interior_sse< 5 >;
+  }
+#endif
+  ( void ) half_;
+  ( void ) kernel_;
+  return NULL;
+}
+
+}
+
+
+bool median_kernel_supported( median_kernel kernel_ )
+{
+#ifdef MEDIAN_X86
+  static const bool avx2 = __builtin_cpu_supports( "avx2" );
+  static const bool sse = __builtin_cpu_supports( "sse2" );
+  if( kernel_ == kernel_avx2 )
+  {
+    return avx2;
+  }
+  if( kernel_ == kernel_sse )
+  {
+    return sse;
+  }
+#else
+  if( kernel_ == kernel_avx2 || kernel_ == kernel_sse )
+  {
+    return false;
+  }
+#endif
+  return true;
+}
+
+
+template< typename T >
+T median_filter_pixel( const basic_image_matrix< T >& input_image_,
+						   int r_,
+						   int c_,
+						   int window_size_ )
+{
+	int n_rows = input_image_.get_n_rows();
+	int n_cols = input_image_.get_n_cols();
+	
+	T filtered_value;
+	std::vector<T> window_vector;
+	
+	//for every p(r,c), we begin at r - window_size/2 and stop at r + window_size/2
+	//since there is a possibility to start at a location which is out of bound (i.e. p(r,c) is at the left edge)
+	//we only allow starting points which are greater than or equal to 0
+	for (int i = std::max(0, r_ - window_size_/2); i <= r_ + window_size_/2; i++) {
+		//if we are to overstep the right corner, we stop and go to the next row
+		if (i >= n_rows) { break; }
+		//the same logic as above applies here, only now for columns instead of rows
+		for (int j = std::max(0, c_ - window_size_/2); j <= c_ + window_size_/2; j++) {
+			if (j >= n_cols) { break; }
+			window_vector.push_back(input_image_.get_pixel(i, j));    
+		}
+	}
+
+	//we need to sort the vector to calculate the median
+	std::sort(window_vector.begin(), window_vector.end());
+	if (window_vector.size() % 2 != 0) {
+		filtered_value = window_vector[window_vector.size() / 2];
+	} else {
+		filtered_value = middle_average(window_vector[window_vector.size() / 2 - 1], window_vector[window_vector.size() / 2]);
+	}
+	
+	return filtered_value;
+}
+
+template float median_filter_pixel( const image_matrix&, int, int, int );
+template std::uint8_t median_filter_pixel( const image_matrix_u8&, int, int, int );
+template std::uint16_t median_filter_pixel( const image_matrix_u16&, int, int, int );
+
+
+void median_filter_rows( const image_matrix& input_image_,
+			 image_matrix& filtered_image_,
+			 int first_row_,
+			 int last_row_,
+			 int window_size_,
+			 median_kernel kernel_ )
+{
+  int n_rows = input_image_.get_n_rows();
+  int n_cols = input_image_.get_n_cols();
+  int half = window_size_ / 2;
+  const float* input = input_image_.data();
+  float* output = filtered_image_.data();
+
+  // allocated once per thread, grows to the largest window
+  static thread_local std::vector< float > window;
+  window.resize( std::max< std::size_t >( window.size(), std::size_t( 2 * half + 1 ) * ( 2 * half + 1 ) ) );
+  interior_kernel kernel = select_interior_kernel( half, kernel_ );
+
+  for( int tile_r = first_row_; tile_r < last_row_; tile_r += tile_rows )
+  {
+    int tile_r_end = std::min( last_row_, tile_r + tile_rows );
+    for( int tile_c = 0; tile_c < n_cols; tile_c += tile_cols )
+    {
+      int tile_c_end = std::min( n_cols, tile_c + tile_cols );
+      for( int r = tile_r; r < tile_r_end; r++ )
+      {
+	int c = tile_c;
+	if( kernel != NULL && r >= half && r + half < n_rows )
+	{
+	  // the pixels whose window lies inside the image go through the SIMD kernel
+	  for( ; c < std::min( tile_c_end, half ); c++ )
+	  {
+	    output[ r * n_cols + c ] = gather_median( input, n_rows, n_cols, half, r, c, window.data() );
+	  }
+	  c = kernel( input, n_cols, output, r, c, std::min( tile_c_end, n_cols - half ) );
+	}
+	for( ; c < tile_c_end; c++ )
+	{
+	  output[ r * n_cols + c ] = gather_median( input, n_rows, n_cols, half, r, c, window.data() );
+	}
+      }
+    }
+  }
+}
+
+
+namespace
+{
+
+// the histogram methods count ranks of at most this many distinct values,
+// split into coarse bins of 16 fine ones
+const int histogram_levels = 256;
+const int fine_levels = 16;
+const int coarse_levels = histogram_levels / fine_levels;
+
+
+// the median from the levels of the lower and the upper middle value
+template< typename T >
+inline T level_median( const T* levels_, int lower_, int upper_, int n_ )
+{
+  return n_ % 2 != 0 ? levels_[ lower_ ] : middle_average( levels_[ lower_ ], levels_[ upper_ ] );
+}
+
+
+template< typename T >
+void filter_rows_huang( const unsigned char* ranks_, const T* levels_, int n_rows_, int n_cols_, int half_,
+			T* output_, int first_row_, int last_row_ )
+{
+  unsigned histogram[ histogram_levels ];
+  for( int r = first_row_; r < last_row_; r++ )
+  {
+    int first_i = std::max( 0, r - half_ );
+    int last_i = std::min( n_rows_ - 1, r + half_ );
+    int height = last_i - first_i + 1;
+    std::fill( histogram, histogram + histogram_levels, 0u );
+    // columns [first_j, last_j] are in the histogram, median is the level of
+    // the lower middle value and below the number of values under it
+    int first_j = 0;
+    int last_j = -1;
+    int n = 0;
+    int median = 0;
+    int below = 0;
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      for( ; last_j < std::min( n_cols_ - 1, c + half_ ); n += height )
+      {
+	last_j++;
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  unsigned char rank = ranks_[ i * n_cols_ + last_j ];
+	  histogram[ rank ]++;
+	  below += rank < median;
+	}
+      }
+      for( ; first_j < c - half_; n -= height )
+      {
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  unsigned char rank = ranks_[ i * n_cols_ + first_j ];
+	  histogram[ rank ]--;
+	  below -= rank < median;
+	}
+	first_j++;
+      }
+      // the median moves only a few levels from one pixel to the next
+      int k = ( n - 1 ) / 2;
+      while( below > k )
+      {
+	median--;
+	below -= histogram[ median ];
+      }
+      while( below + int( histogram[ median ] ) <= k )
+      {
+	below += histogram[ median ];
+	median++;
+      }
+      int upper = median;
+      if( n % 2 == 0 && below + int( histogram[ median ] ) <= k + 1 )
+      {
+	for( upper++; histogram[ upper ] == 0; upper++ )
+	{
+	}
+      }
+      output_[ r * n_cols_ + c ] = level_median( levels_, median, upper, n );
+    }
+  }
+}
+
+
+// the window histogram of the constant time filter: coarse bins are kept up
+// to date for every pixel, the fine bins of a coarse bin only when the median
+// is searched in it
+class window_histogram
+{
+  public:
+    window_histogram( const std::uint16_t* column_fine_, const std::uint16_t* column_coarse_ )
+      : _column_fine( column_fine_ ),
+	_column_coarse( column_coarse_ ),
+	_first_j( 0 ),
+	_last_j( -1 )
+    {
+      std::fill( _coarse, _coarse + coarse_levels, 0 );
+      std::fill( _fine_first_j, _fine_first_j + coarse_levels, 0 );
+      std::fill( _fine_last_j, _fine_last_j + coarse_levels, -1 );
+    }
+
+    // moves the window to the columns [first_j_, last_j_], it only moves right
+    void move( int first_j_, int last_j_ )
+    {
+      for( ; _last_j < last_j_; _last_j++ )
+      {
+	add( _coarse, _column_coarse + ( _last_j + 1 ) * coarse_levels, coarse_levels );
+      }
+      for( ; _first_j < first_j_; _first_j++ )
+      {
+	subtract( _coarse, _column_coarse + _first_j * coarse_levels, coarse_levels );
+      }
+    }
+
+    // level of the value with index k_ in the sorted window
+    int find( int k_ )
+    {
+      int coarse = 0;
+      for( ; k_ >= _coarse[ coarse ]; coarse++ )
+      {
+	k_ -= _coarse[ coarse ];
+      }
+      const std::uint16_t* fine = update_fine( coarse );
+      int level = 0;
+      for( ; k_ >= fine[ level ]; level++ )
+      {
+	k_ -= fine[ level ];
+      }
+      return coarse * fine_levels + level;
+    }
+
+  private:
+    static void add( std::uint16_t* to_, const std::uint16_t* from_, int n_ )
+    {
+      for( int i = 0; i < n_; i++ )
+      {
+	to_[ i ] += from_[ i ];
+      }
+    }
+
+    static void subtract( std::uint16_t* to_, const std::uint16_t* from_, int n_ )
+    {
+      for( int i = 0; i < n_; i++ )
+      {
+	to_[ i ] -= from_[ i ];
+      }
+    }
+
+    // brings the fine bins of coarse_ from the columns they were last used
+    // for to the current ones, from scratch if the two don't overlap
+    const std::uint16_t* update_fine( int coarse_ )
+    {
+      std::uint16_t* fine = _fine[ coarse_ ];
+      int& first_j = _fine_first_j[ coarse_ ];
+      int& last_j = _fine_last_j[ coarse_ ];
+      if( last_j < _first_j )
+      {
+	std::fill( fine, fine + fine_levels, 0 );
+	first_j = _first_j;
+	last_j = _first_j - 1;
+      }
+      for( ; last_j < _last_j; last_j++ )
+      {
+	add( fine, _column_fine + ( last_j + 1 ) * histogram_levels + coarse_ * fine_levels, fine_levels );
+      }
+      for( ; first_j < _first_j; first_j++ )
+      {
+	subtract( fine, _column_fine + first_j * histogram_levels + coarse_ * fine_levels, fine_levels );
+      }
+      return fine;
+    }
+
+    const std::uint16_t* _column_fine;
+    const std::uint16_t* _column_coarse;
+    int _first_j;
+    int _last_j;
+    std::uint16_t _coarse[ coarse_levels ];
+    std::uint16_t _fine[ coarse_levels ][ fine_levels ];
+    // the columns the fine bins of every coarse bin hold
+    int _fine_first_j[ coarse_levels ];
+    int _fine_last_j[ coarse_levels ];
+};
+
+
+template< typename T >
+void filter_rows_constant_time( const unsigned char* ranks_, const T* levels_, int n_rows_, int n_cols_,
+				int half_, T* output_, int first_row_, int last_row_ )
+{
+  // histograms of the rows [first_i, last_i] of every column, allocated once per thread
+  static thread_local std::vector< std::uint16_t > column_fine;
+  static thread_local std::vector< std::uint16_t > column_coarse;
+  column_fine.assign( std::size_t( n_cols_ ) * histogram_levels, 0 );
+  column_coarse.assign( std::size_t( n_cols_ ) * coarse_levels, 0 );
+  int first_i = std::max( 0, first_row_ - half_ );
+  int last_i = first_i - 1;
+  for( int r = first_row_; r < last_row_; r++ )
+  {
+    for( ; last_i < std::min( n_rows_ - 1, r + half_ ); last_i++ )
+    {
+      const unsigned char* row = ranks_ + ( last_i + 1 ) * n_cols_;
+      for( int j = 0; j < n_cols_; j++ )
+      {
+	column_fine[ j * histogram_levels + row[ j ] ]++;
+	column_coarse[ j * coarse_levels + row[ j ] / fine_levels ]++;
+      }
+    }
+    for( ; first_i < r - half_; first_i++ )
+    {
+      const unsigned char* row = ranks_ + first_i * n_cols_;
+      for( int j = 0; j < n_cols_; j++ )
+      {
+	column_fine[ j * histogram_levels + row[ j ] ]--;
+	column_coarse[ j * coarse_levels + row[ j ] / fine_levels ]--;
+      }
+    }
+    int height = last_i - first_i + 1;
+    window_histogram window( column_fine.data(), column_coarse.data() );
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      int first_j = std::max( 0, c - half_ );
+      int last_j = std::min( n_cols_ - 1, c + half_ );
+      window.move( first_j, last_j );
+      int n = height * ( last_j - first_j + 1 );
+      int lower = window.find( ( n - 1 ) / 2 );
+      int upper = n % 2 == 0 ? window.find( n / 2 ) : lower;
+      output_[ r * n_cols_ + c ] = level_median( levels_, lower, upper, n );
+    }
+  }
+}
+
+
+void filter_rows_sorted_window( const float* input_, int n_rows_, int n_cols_, int half_,
+				float* output_, int first_row_, int last_row_ )
+{
+  static thread_local std::vector< float > window;
+  for( int r = first_row_; r < last_row_; r++ )
+  {
+    int first_i = std::max( 0, r - half_ );
+    int last_i = std::min( n_rows_ - 1, r + half_ );
+    window.clear();
+    int first_j = 0;
+    int last_j = -1;
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      for( ; last_j < std::min( n_cols_ - 1, c + half_ ); last_j++ )
+      {
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  float value = input_[ i * n_cols_ + last_j + 1 ];
+	  window.insert( std::upper_bound( window.begin(), window.end(), value ), value );
+	}
+      }
+      for( ; first_j < c - half_; first_j++ )
+      {
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  window.erase( std::lower_bound( window.begin(), window.end(), input_[ i * n_cols_ + first_j ] ) );
+	}
+      }
+      std::size_t n = window.size();
+      output_[ r * n_cols_ + c ] = n % 2 != 0 ? window[ n / 2 ] : ( window[ n / 2 - 1 ] + window[ n / 2 ] ) / 2;
+    }
+  }
+}
+
+// the window histogram of 16 bit pixels: a count for every value, and two
+// levels of bits which tell which values and which words of 64 values occur,
+// so the median skips the values which don't occur at once
+class sparse_histogram
+{
+  public:
+    sparse_histogram()
+      : _counts( n_levels, 0 )
+    {
+      std::fill( _occupied, _occupied + n_levels / 64, 0 );
+      std::fill( _occupied_words, _occupied_words + n_levels / 64 / 64, 0 );
+    }
+
+    unsigned count( int level_ ) const
+    {
+      return _counts[ level_ ];
+    }
+
+    void add( int level_ )
+    {
+      if( _counts[ level_ ]++ == 0 )
+      {
+	_occupied[ level_ / 64 ] |= bit( level_ );
+	_occupied_words[ level_ / 64 / 64 ] |= bit( level_ / 64 );
+      }
+    }
+
+    void remove( int level_ )
+    {
+      if( --_counts[ level_ ] == 0 )
+      {
+	_occupied[ level_ / 64 ] &= ~bit( level_ );
+	if( _occupied[ level_ / 64 ] == 0 )
+	{
+	  _occupied_words[ level_ / 64 / 64 ] &= ~bit( level_ / 64 );
+	}
+      }
+    }
+
+    // the lowest level from level_ on which occurs, there has to be one
+    int next( int level_ ) const
+    {
+      int word = level_ / 64;
+      std::uint64_t bits = _occupied[ word ] & ( ~std::uint64_t( 0 ) << ( level_ % 64 ) );
+      if( bits != 0 )
+      {
+	return word * 64 + __builtin_ctzll( bits );
+      }
+      for( word++; ; word = ( word / 64 + 1 ) * 64 )
+      {
+	std::uint64_t words = _occupied_words[ word / 64 ] & ( ~std::uint64_t( 0 ) << ( word % 64 ) );
+	if( words != 0 )
+	{
+	  word = word / 64 * 64 + __builtin_ctzll( words );
+	  return word * 64 + __builtin_ctzll( _occupied[ word ] );
+	}
+      }
+    }
+
+    // the highest level below level_ which occurs, there has to be one
+    int previous( int level_ ) const
+    {
+      int word = ( level_ - 1 ) / 64;
+      std::uint64_t bits = _occupied[ word ] & ( ~std::uint64_t( 0 ) >> ( 63 - ( level_ - 1 ) % 64 ) );
+      if( bits != 0 )
+      {
+	return word * 64 + 63 - __builtin_clzll( bits );
+      }
+      for( word--; ; word = word / 64 * 64 - 1 )
+      {
+	std::uint64_t words = _occupied_words[ word / 64 ] & ( ~std::uint64_t( 0 ) >> ( 63 - word % 64 ) );
+	if( words != 0 )
+	{
+	  word = word / 64 * 64 + 63 - __builtin_clzll( words );
+	  return word * 64 + 63 - __builtin_clzll( _occupied[ word ] );
+	}
+      }
+    }
+
+  private:
+    static const int n_levels = 65536;
+
+    static std::uint64_t bit( int i_ )
+    {
+      return std::uint64_t( 1 ) << ( i_ % 64 );
+    }
+
+    std::vector< unsigned > _counts;
+    std::uint64_t _occupied[ n_levels / 64 ];
+    std::uint64_t _occupied_words[ n_levels / 64 / 64 ];
+};
+
+
+// Huang for 16 bit pixels, on a sparse_histogram
+void filter_rows_two_level( const std::uint16_t* input_, int n_rows_, int n_cols_, int half_,
+			    std::uint16_t* output_, int first_row_, int last_row_ )
+{
+  // allocated once per thread, and emptied again after every row
+  static thread_local sparse_histogram histogram;
+  for( int r = first_row_; r < last_row_; r++ )
+  {
+    int first_i = std::max( 0, r - half_ );
+    int last_i = std::min( n_rows_ - 1, r + half_ );
+    int height = last_i - first_i + 1;
+    // as in filter_rows_huang
+    int first_j = 0;
+    int last_j = -1;
+    int n = 0;
+    int median = 0;
+    int below = 0;
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      for( ; last_j < std::min( n_cols_ - 1, c + half_ ); n += height )
+      {
+	last_j++;
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  std::uint16_t value = input_[ i * n_cols_ + last_j ];
+	  histogram.add( value );
+	  below += value < median;
+	}
+      }
+      for( ; first_j < c - half_; n -= height )
+      {
+	for( int i = first_i; i <= last_i; i++ )
+	{
+	  std::uint16_t value = input_[ i * n_cols_ + first_j ];
+	  histogram.remove( value );
+	  below -= value < median;
+	}
+	first_j++;
+      }
+      int k = ( n - 1 ) / 2;
+      while( below > k )
+      {
+	median = histogram.previous( median );
+	below -= histogram.count( median );
+      }
+      while( below + int( histogram.count( median ) ) <= k )
+      {
+	below += histogram.count( median );
+	median = histogram.next( median + 1 );
+      }
+      int upper = median;
+      if( n % 2 == 0 && below + int( histogram.count( median ) ) <= k + 1 )
+      {
+	upper = histogram.next( median + 1 );
+      }
+      output_[ r * n_cols_ + c ] = n % 2 != 0 ? median : middle_average( std::uint16_t( median ), std::uint16_t( upper ) );
+    }
+    for( ; first_j <= last_j; first_j++ )
+    {
+      for( int i = first_i; i <= last_i; i++ )
+      {
+	histogram.remove( input_[ i * n_cols_ + first_j ] );
+      }
+    }
+  }
+}
+
+
+// the distinct values of the n_ pixels_ in ascending order into levels_ and
+// the index into them of every pixel into ranks_. false if there are more
+// than histogram_levels of them (or a NaN, which has no order)
+bool rank_pixels( const float* pixels_, int n_, std::vector< float >& levels_, std::vector< unsigned char >& ranks_ )
+{
+  // open addressing from the bits of a value to the order it was first seen in
+  const unsigned table_bits = 10;
+  std::uint32_t keys[ 1 << table_bits ];
+  int slots[ 1 << table_bits ];
+  std::fill( slots, slots + ( 1 << table_bits ), -1 );
+  levels_.clear();
+  ranks_.resize( n_ );
+  for( int p = 0; p < n_; p++ )
+  {
+    std::uint32_t key;
+    std::memcpy( &key, pixels_ + p, sizeof( key ) );
+    unsigned slot = ( key * 2654435761u ) >> ( 32 - table_bits );
+    while( slots[ slot ] >= 0 && keys[ slot ] != key )
+    {
+      slot = ( slot + 1 ) & ( ( 1 << table_bits ) - 1 );
+    }
+    if( slots[ slot ] < 0 )
+    {
+      if( levels_.size() == std::size_t( histogram_levels ) || pixels_[ p ] != pixels_[ p ] )
+      {
+	return false;
+      }
+      keys[ slot ] = key;
+      slots[ slot ] = levels_.size();
+      levels_.push_back( pixels_[ p ] );
+    }
+    ranks_[ p ] = slots[ slot ];
+  }
+  // from the order of appearance to ascending order
+  std::vector< unsigned char > order( levels_.size() );
+  for( std::size_t i = 0; i < order.size(); i++ )
+  {
+    order[ i ] = i;
+  }
+  std::sort( order.begin(), order.end(), [ &levels_ ]( unsigned char a_, unsigned char b_ )
+	     { return levels_[ a_ ] < levels_[ b_ ]; } );
+  unsigned char rank_of[ histogram_levels ];
+  std::vector< float > sorted( levels_.size() );
+  for( std::size_t i = 0; i < order.size(); i++ )
+  {
+    rank_of[ order[ i ] ] = i;
+    sorted[ i ] = levels_[ order[ i ] ];
+  }
+  levels_.swap( sorted );
+  for( int p = 0; p < n_; p++ )
+  {
+    ranks_[ p ] = rank_of[ ranks_[ p ] ];
+  }
+  return true;
+}
+
+
+// picks the method for a float image and prepares it. The histogram methods
+// work on the rank of every pixel among the distinct values of the image
+median_method prepare_median( const image_matrix& input_image_, int window_size_, median_method method_,
+			      std::vector< float >& levels_, std::vector< unsigned char >& ranks_ )
+{
+  int n_pixels = input_image_.get_n_rows() * input_image_.get_n_cols();
+  bool histogram = window_size_ <= 255;
+  if( method_ == median_auto || method_ == median_huang || method_ == median_constant_time )
+  {
+    histogram = histogram && rank_pixels( input_image_.data(), n_pixels, levels_, ranks_ );
+  }
+  if( method_ == median_auto )
+  {
+    // SIMD networks for 3x3 and 5x5 windows, histograms for the larger
+    // ones. Without a histogram the sorted window wins from about 9 on
+    if( window_size_ / 2 <= 2 )
+    {
+      method_ = median_selection;
+    }
+    else if( histogram )
+    {
+      method_ = window_size_ <= 9 ? median_huang : median_constant_time;
+    }
+    else
+    {
+      method_ = window_size_ < 9 ? median_selection : median_sorted_window;
+    }
+  }
+  else if( ( method_ == median_huang || method_ == median_constant_time ) && !histogram )
+  {
+    method_ = median_sorted_window;
+  }
+  if( method_ != median_huang && method_ != median_constant_time )
+  {
+    std::vector< float >().swap( levels_ );
+    std::vector< unsigned char >().swap( ranks_ );
+  }
+  return method_;
+}
+
+
+// 8 bit pixels are their own ranks, so only the histogram methods are used
+// and nothing has to be prepared. The column histograms of the constant time
+// method count up to 65535 values, larger windows use Huang
+median_method prepare_median( const image_matrix_u8&, int window_size_, median_method method_,
+			      std::vector< std::uint8_t >& levels_, std::vector< unsigned char >& )
+{
+  if( method_ != median_huang && method_ != median_constant_time )
+  {
+    method_ = window_size_ <= 9 ? median_huang : median_constant_time;
+  }
+  if( window_size_ > 255 )
+  {
+    method_ = median_huang;
+  }
+  levels_.resize( histogram_levels );
+  for( int i = 0; i < histogram_levels; i++ )
+  {
+    levels_[ i ] = i;
+  }
+  return method_;
+}
+
+
+// 16 bit pixels always go through the two level histogram
+median_method prepare_median( const image_matrix_u16&, int, median_method,
+			      std::vector< std::uint16_t >&, std::vector< unsigned char >& )
+{
+  return median_huang;
+}
+
+
+void filter_rows_with( median_method method_, const image_matrix& input_image_, const std::vector< float >& levels_,
+		       const std::vector< unsigned char >& ranks_, int window_size_, image_matrix& filtered_image_,
+		       int first_row_, int last_row_ )
+{
+  int n_rows = input_image_.get_n_rows();
+  int n_cols = input_image_.get_n_cols();
+  int half = window_size_ / 2;
+  switch( method_ )
+  {
+    case median_huang:
+      filter_rows_huang( ranks_.data(), levels_.data(), n_rows, n_cols, half, filtered_image_.data(),
+			 first_row_, last_row_ );
+      break;
+    case median_constant_time:
+      filter_rows_constant_time( ranks_.data(), levels_.data(), n_rows, n_cols, half, filtered_image_.data(),
+				 first_row_, last_row_ );
+      break;
+    case median_sorted_window:
+      filter_rows_sorted_window( input_image_.data(), n_rows, n_cols, half, filtered_image_.data(),
+				 first_row_, last_row_ );
+      break;
+    default:
+      median_filter_rows( input_image_, filtered_image_, first_row_, last_row_, window_size_ );
+      break;
+  }
+}
+
+
+void filter_rows_with( median_method method_, const image_matrix_u8& input_image_,
+		       const std::vector< std::uint8_t >& levels_, const std::vector< unsigned char >&,
+		       int window_size_, image_matrix_u8& filtered_image_, int first_row_, int last_row_ )
+{
+  int n_rows = input_image_.get_n_rows();
+  int n_cols = input_image_.get_n_cols();
+  int half = window_size_ / 2;
+  if( method_ == median_constant_time )
+  {
+    filter_rows_constant_time( input_image_.data(), levels_.data(), n_rows, n_cols, half, filtered_image_.data(),
+			       first_row_, last_row_ );
+  }
+  else
+  {
+    filter_rows_huang( input_image_.data(), levels_.data(), n_rows, n_cols, half, filtered_image_.data(),
+		       first_row_, last_row_ );
+  }
+}
+
+
+void filter_rows_with( median_method, const image_matrix_u16& input_image_, const std::vector< std::uint16_t >&,
+		       const std::vector< unsigned char >&, int window_size_, image_matrix_u16& filtered_image_,
+		       int first_row_, int last_row_ )
+{
+  filter_rows_two_level( input_image_.data(), input_image_.get_n_rows(), input_image_.get_n_cols(), window_size_ / 2,
+			 filtered_image_.data(), first_row_, last_row_ );
+}
+
+}
+
+
+bool median_method_from_name( const std::string& name_, median_method& method_ )
+{
+  for( int m = median_auto; m <= median_sorted_window; m++ )
+  {
+    if( name_ == median_method_name( median_method( m ) ) )
+    {
+      method_ = median_method( m );
+      return true;
+    }
+  }
+  return false;
+}
+
+
+const char* median_method_name( median_method method_ )
+{
+  switch( method_ )
+  {
+    case median_auto: return "auto";
+    case median_selection: return "selection";
+    case median_huang: return "huang";
+    case median_constant_time: return "constant";
+    case median_sorted_window: return "sorted";
+  }
+  return "";
+}
+
+
+template< typename T >
+basic_median_filter< T >::basic_median_filter( const basic_image_matrix< T >& input_image_, int window_size_,
+					       median_method method_ )
+  : _input_image( input_image_ ),
+    _window_size( window_size_ ),
+    _method( method_ )
+{
+  _method = prepare_median( input_image_, window_size_, method_, _levels, _ranks );
+}
+
+
+template< typename T >
+void basic_median_filter< T >::filter_rows( basic_image_matrix< T >& filtered_image_, int first_row_, int last_row_ ) const
+{
+  filter_rows_with( _method, _input_image, _levels, _ranks, _window_size, filtered_image_, first_row_, last_row_ );
+}
+
+
+template< typename T >
+median_method basic_median_filter< T >::method() const
+{
+  return _method;
+}
+
+
+template< typename T >
+int basic_median_filter< T >::window_size() const
+{
+  return _window_size;
+}
+
+
+template class basic_median_filter< float >;
+template class basic_median_filter< std::uint8_t >;
+template class basic_median_filter< std::uint16_t >;
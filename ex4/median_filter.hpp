@@ -0,0 +1,115 @@
+#ifndef MEDIAN_FILTER_HPP_
+#define MEDIAN_FILTER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "image_matrix.hpp"
+
+
+// function that performs the median filtering on pixel p(r_,c_) of input_image_,
+// using a window of size window_size_
+// the function returns the new filtered value p'(r_,c_)
+// (reference version: builds and sorts the window of every pixel; integer
+// pixels round the average of the two middle values half up)
+template< typename T >
+T median_filter_pixel( const basic_image_matrix< T >& input_image_,
+					   int r_,
+					   int c_,
+					   int window_size_ );
+
+
+// the kernels median_filter_rows can run the 3x3 and 5x5 windows inside the
+// image through: the fastest one the cpu supports, or a given one (to test it)
+enum median_kernel
+{
+  kernel_auto,
+  kernel_avx2,
+  kernel_sse,
+  // gathers every window like for the other sizes
+  kernel_scalar
+};
+
+// false if the cpu can't run kernel_
+bool median_kernel_supported( median_kernel kernel_ );
+
+
+// filters the rows [first_row_, last_row_) of input_image_ into filtered_image_
+// with exactly the values median_filter_pixel gives, windows are truncated at
+// the borders and an even number of values averages the two middle ones.
+// the rows are processed in tiles whose windows stay in the cache, every
+// thread gathers its windows in a buffer of its own which is reused, and the
+// median is selected instead of sorting the whole window. 3x3 and 5x5 windows
+// inside the image run through a sorting network on 8 (AVX2) or 4 (SSE)
+// adjacent pixels at once
+void median_filter_rows( const image_matrix& input_image_,
+			 image_matrix& filtered_image_,
+			 int first_row_,
+			 int last_row_,
+			 int window_size_,
+			 median_kernel kernel_ = kernel_auto );
+
+
+// how median_filter finds the median of every window
+enum median_method
+{
+  // picks one of the others from the window size and the number of distinct values
+  median_auto,
+  // median_filter_rows: gathers every window and selects its median
+  median_selection,
+  // Huang: a histogram of the window slides along each row, O(window) per pixel
+  median_huang,
+  // Perreault-Hebert: a histogram per column slides down the image, the
+  // window histogram is the sum of a window of them and slides along the row
+  // with a coarse and a lazily updated fine level, O(1) per pixel
+  median_constant_time,
+  // a sorted copy of the window slides along each row, for images with too
+  // many distinct values for a histogram
+  median_sorted_window
+};
+
+// the method called name_ (auto, selection, huang, constant or sorted), false if there is none
+bool median_method_from_name( const std::string& name_, median_method& method_ );
+
+const char* median_method_name( median_method method_ );
+
+
+// the median filter of one image, the same values as median_filter_pixel.
+// float images: the histogram methods work on the rank of every pixel among
+// the distinct values of the image, so they are exact as long as there are
+// at most 256 distinct values (8 bit sources); otherwise and for windows
+// larger than 255 they fall back to the sorted window.
+// 8 bit images: the pixels are their own ranks, there is nothing to prepare
+// and huang or constant (the default for windows above 9) is used.
+// 16 bit images: always huang, on a histogram which also keeps bits of the
+// values that occur so the median skips the others at once.
+// Once constructed, any number of threads may filter rows concurrently
+template< typename T >
+class basic_median_filter
+{
+  public:
+    basic_median_filter( const basic_image_matrix< T >& input_image_, int window_size_,
+			 median_method method_ = median_auto );
+
+    // filters the rows [first_row_, last_row_) into filtered_image_
+    void filter_rows( basic_image_matrix< T >& filtered_image_, int first_row_, int last_row_ ) const;
+
+    // the method which is used, never median_auto
+    median_method method() const;
+
+    int window_size() const;
+
+  private:
+    const basic_image_matrix< T >& _input_image;
+    int _window_size;
+    median_method _method;
+    // the distinct values in ascending order and the index into them of every pixel
+    std::vector< T > _levels;
+    std::vector< unsigned char > _ranks;
+};
+
+
+typedef basic_median_filter< float > median_filter;
+
+
+#endif
@@ -0,0 +1,102 @@
+// checks median_filter_rows with every kernel the cpu supports (AVX2, SSE and
+// the scalar code) against median_filter_pixel on random images of odd
+// shapes, including images narrower than a vector and tiles cut short by the
+// borders. Run by "make test", exits with 1 if a pixel differs
+
+#include <iostream>
+#include <random>
+
+#include "image_matrix.hpp"
+#include "median_filter.hpp"
+
+
+namespace
+{
+
+const median_kernel kernels[] = { kernel_avx2, kernel_sse, kernel_scalar, kernel_auto };
+const char* const kernel_names[] = { "avx2", "sse", "scalar", "auto" };
+
+// widths around the vector widths (4 and 8) and the tile width (128)
+const int widths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 16, 17, 23, 31, 33, 127, 129, 133 };
+const int heights[] = { 1, 2, 3, 4, 5, 6, 9, 31, 33, 37 };
+const int window_sizes[] = { 3, 5 };
+
+
+// a random image, with few distinct values if levels_ is not 0 so that
+// windows contain equal values
+image_matrix random_image( std::mt19937& random_, int n_rows_, int n_cols_, int levels_ )
+{
+  image_matrix image( n_rows_, n_cols_ );
+  std::uniform_real_distribution< float > value( 0.0f, 1.0f );
+  std::uniform_int_distribution< int > level( 0, levels_ );
+  for( int r = 0; r < n_rows_; r++ )
+  {
+    for( int c = 0; c < n_cols_; c++ )
+    {
+      image.set_pixel( r, c, levels_ == 0 ? value( random_ ) : float( level( random_ ) ) / levels_ );
+    }
+  }
+  return image;
+}
+
+
+// false (and the first difference on std::cerr) if a pixel filtered with
+// kernel_ is not the one median_filter_pixel gives
+bool check( const image_matrix& input_, int window_size_, int kernel_ )
+{
+  int n_rows = input_.get_n_rows();
+  int n_cols = input_.get_n_cols();
+  image_matrix filtered( n_rows, n_cols );
+  median_filter_rows( input_, filtered, 0, n_rows, window_size_, kernels[ kernel_ ] );
+  for( int r = 0; r < n_rows; r++ )
+  {
+    for( int c = 0; c < n_cols; c++ )
+    {
+      float expected = median_filter_pixel( input_, r, c, window_size_ );
+      if( filtered.get_pixel( r, c ) != expected )
+      {
+	std::cerr << kernel_names[ kernel_ ] << ": " << n_rows << "x" << n_cols << " image, window "
+		  << window_size_ << ", pixel (" << r << ", " << c << ") is " << filtered.get_pixel( r, c )
+		  << " instead of " << expected << std::endl;
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+}
+
+
+int main()
+{
+  std::mt19937 random( 42 );
+  bool passed = true;
+  for( int k = 0; k < int( sizeof( kernels ) / sizeof( kernels[ 0 ] ) ); k++ )
+  {
+    if( !median_kernel_supported( kernels[ k ] ) )
+    {
+      std::cout << kernel_names[ k ] << ": not supported by this cpu, skipped" << std::endl;
+      continue;
+    }
+    int n_images = 0;
+    for( int h = 0; h < int( sizeof( heights ) / sizeof( heights[ 0 ] ) ); h++ )
+    {
+      for( int w = 0; w < int( sizeof( widths ) / sizeof( widths[ 0 ] ) ); w++ )
+      {
+	for( int s = 0; s < int( sizeof( window_sizes ) / sizeof( window_sizes[ 0 ] ) ); s++ )
+	{
+	  for( int levels = 0; levels <= 4; levels += 2 )
+	  {
+	    image_matrix input = random_image( random, heights[ h ], widths[ w ], levels );
+	    passed = check( input, window_sizes[ s ], k ) && passed;
+	    n_images++;
+	  }
+	}
+      }
+    }
+    std::cout << kernel_names[ k ] << ": " << n_images << " images checked" << std::endl;
+  }
+  std::cout << ( passed ? "all pixels match median_filter_pixel" : "FAILED" ) << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include "work_stealing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <omp.h>
+
+
+namespace
+{
+
+// the tasks [begin, end) a thread has left, packed into one word so that the
+// thread taking tasks from the front and thieves taking them from the back
+// agree through a single compare and swap. Padded to a cache line, so the
+// threads don't share lines
+struct task_range
+{
+  std::atomic< std::uint64_t > range;
+  char padding[ 64 - sizeof( std::atomic< std::uint64_t > ) ];
+};
+
+
+inline std::uint64_t pack( std::uint32_t begin_, std::uint32_t end_ )
+{
+  return ( std::uint64_t( begin_ ) << 32 ) | end_;
+}
+
+
+// the first task of range_, false if it is empty
+bool pop_front( task_range& range_, int& task_ )
+{
+  std::uint64_t range = range_.range.load();
+  while( true )
+  {
+    std::uint32_t begin = range >> 32;
+    std::uint32_t end = range & 0xffffffff;
+    if( begin >= end )
+    {
+      return false;
+    }
+    if( range_.range.compare_exchange_weak( range, pack( begin + 1, end ) ) )
+    {
+      task_ = begin;
+      return true;
+    }
+  }
+}
+
+
+// moves the back half (at least one task) of the range of another thread
+// into own_, false if all others are empty
+bool steal( std::vector< task_range >& ranges_, int thief_, task_range& own_ )
+{
+  int n = ranges_.size();
+  for( int i = 1; i < n; i++ )
+  {
+    task_range& victim = ranges_[ ( thief_ + i ) % n ];
+    std::uint64_t range = victim.range.load();
+    while( true )
+    {
+      std::uint32_t begin = range >> 32;
+      std::uint32_t end = range & 0xffffffff;
+      if( begin >= end )
+      {
+	break;
+      }
+      std::uint32_t middle = begin + ( end - begin ) / 2;
+      if( victim.range.compare_exchange_weak( range, pack( begin, middle ) ) )
+      {
+	own_.range.store( pack( middle, end ) );
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+}
+
+
+void run_work_stealing( int n_tasks_, int n_threads_, const std::function< void( int ) >& task_ )
+{
+  int n_threads = std::max( 1, std::min( n_threads_, n_tasks_ ) );
+  if( n_tasks_ <= 0 )
+  {
+    return;
+  }
+  std::vector< task_range > ranges( n_threads );
+  for( int t = 0; t < n_threads; t++ )
+  {
+    ranges[ t ].range.store( pack( std::int64_t( n_tasks_ ) * t / n_threads,
+				   std::int64_t( n_tasks_ ) * ( t + 1 ) / n_threads ) );
+  }
+  // threads the runtime does not start have their tasks stolen
+  #pragma omp parallel num_threads( n_threads )
+  {
+    int thread = omp_get_thread_num();
+    task_range& own = ranges[ thread ];
+    int task;
+    do
+    {
+      while( pop_front( own, task ) )
+      {
+	task_( task );
+      }
+    }
+    while( steal( ranges, thread, own ) );
+  }
+}
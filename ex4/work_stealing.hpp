@@ -0,0 +1,15 @@
+#ifndef WORK_STEALING_HPP_
+#define WORK_STEALING_HPP_
+
+#include <functional>
+
+
+// runs task_( i ) for every i in [0, n_tasks_) on up to n_threads_ threads.
+// Every thread starts on a contiguous share of the tasks, and once it has
+// run out of them steals the back half of what another thread has left, so
+// no thread idles while there are tasks which have not been started.
+// Works for any number of tasks and threads, also fewer tasks than threads
+void run_work_stealing( int n_tasks_, int n_threads_, const std::function< void( int ) >& task_ );
+
+
+#endif